@@ -0,0 +1,94 @@
+#include <string.h>
+#include <math.h>
+#include "afc.h"
+
+#define AFC_FILTER_WEIGHT 0.25f   // Of a new measurement in the residual error
+#define AFC_BASELINE_WEIGHT 0.05f // Of the current correction in the baseline
+
+static int32_t afc_clamp(int32_t value, int32_t limit) {
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+void afc_init(afc_t *afc, const afc_config_t *config) {
+    memset(afc, 0, sizeof(*afc));
+    afc->config = *config;
+}
+
+void afc_reset(afc_t *afc) {
+    afc_config_t config = afc->config;
+    afc_init(afc, &config);
+}
+
+bool afc_update(afc_t *afc, int32_t fei_hz, float snr, bool crc_ok, int64_t now_us) {
+    const afc_config_t *c = &afc->config;
+    if (c->invert) {
+        fei_hz = -fei_hz;
+    }
+    if (!crc_ok || snr < c->min_snr || fei_hz > c->max_fei_hz || fei_hz < -c->max_fei_hz) {
+        afc->rejected++;
+        return false;
+    }
+
+    bool changed = afc_idle(afc, now_us);
+    afc->filtered += AFC_FILTER_WEIGHT * (fei_hz - afc->filtered);
+    afc->accepted++;
+    afc->last_us = now_us;
+
+    // Hysteresis: small residuals are left alone until they grow past the
+    // deadband, then corrected until they fall under half of it
+    float error = fabsf(afc->filtered);
+    if (!afc->tracking && error > c->deadband_hz) {
+        afc->tracking = true;
+    } else if (afc->tracking && error < c->deadband_hz / 2) {
+        afc->tracking = false;
+    }
+    if (afc->tracking) {
+        int32_t step = afc_clamp(lrintf(afc->filtered), c->max_step_hz);
+        int32_t correction = afc_clamp(afc->correction + step, c->max_offset_hz);
+        if (correction != afc->correction + step) {
+            afc->saturated++;
+        }
+        step = correction - afc->correction;
+        if (step != 0) {
+            // Later measurements are relative to the new carrier
+            afc->filtered -= step;
+            afc->correction = correction;
+            afc->steps++;
+            changed = true;
+        }
+    }
+    afc->baseline += AFC_BASELINE_WEIGHT * (afc->correction - afc->baseline);
+
+    afc_sample_t *sample = &afc->history[afc->history_count++ % AFC_HISTORY];
+    sample->time_us = now_us;
+    sample->fei_hz = fei_hz;
+    sample->filtered_hz = lrintf(afc->filtered);
+    sample->correction_hz = afc->correction;
+    sample->snr = snr;
+    return changed;
+}
+
+bool afc_idle(afc_t *afc, int64_t now_us) {
+    if (afc->accepted == 0 || now_us - afc->last_us < afc->config.hold_ms * 1000LL) {
+        return false;
+    }
+    // The pass is over, a Doppler shift followed up to the end is wrong for the next one
+    int32_t baseline = lrintf(afc->baseline);
+    afc->last_us = now_us;
+    afc->filtered = 0;
+    afc->tracking = false;
+    if (afc->correction == baseline) {
+        return false;
+    }
+    afc->correction = baseline;
+    afc->holds++;
+    return true;
+}
+
+bool afc_history(const afc_t *afc, uint32_t i, afc_sample_t *sample) {
+    if (i >= afc->history_count || i >= AFC_HISTORY) {
+        return false;
+    }
+    *sample = afc->history[(afc->history_count - 1 - i) % AFC_HISTORY];
+    return true;
+}
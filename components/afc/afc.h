@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AFC_HISTORY 16 // Last measurements kept for the console
+
+typedef struct {
+    int32_t max_step_hz;   // Largest change after one packet
+    int32_t max_offset_hz; // Correction stays within +-this
+    int32_t deadband_hz;   // Start correcting above it, stop below half of it
+    int32_t max_fei_hz;    // Measurements beyond it are rejected as bogus
+    float min_snr;         // dB, FEI is noise below it
+    uint32_t hold_ms;      // Without packets for this long, fall back to the baseline
+    bool invert;           // FEI sign is receiver minus signal on this board
+} afc_config_t;
+
+typedef struct {
+    int64_t time_us;
+    int32_t fei_hz;        // As reported, after the sign convention
+    int32_t filtered_hz;   // Residual error after this packet
+    int32_t correction_hz; // Correction in use after this packet
+    float snr;
+} afc_sample_t;
+
+typedef struct {
+    afc_config_t config;
+    float filtered;        // Residual error, relative to the corrected carrier
+    float baseline;        // Long term correction, the crystal offset
+    int32_t correction;    // Offset to add to the nominal frequency
+    bool tracking;         // Outside the deadband, stepping towards zero error
+    int64_t last_us;       // Time of the last accepted packet
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t steps;
+    uint32_t saturated;    // Steps cut short by max_offset_hz
+    uint32_t holds;        // Returns to the baseline after a silence
+    afc_sample_t history[AFC_HISTORY];
+    uint32_t history_count;
+} afc_t;
+
+void afc_init(afc_t *afc, const afc_config_t *config);
+
+// Feed the frequency error of one received packet. Returns true if the
+// correction changed and the radio should be retuned.
+bool afc_update(afc_t *afc, int32_t fei_hz, float snr, bool crc_ok, int64_t now_us);
+
+// Return to the baseline when no packet came for hold_ms, true if the
+// correction changed. Called between packets.
+bool afc_idle(afc_t *afc, int64_t now_us);
+
+// Forget the measurements and the correction
+void afc_reset(afc_t *afc);
+
+// History entry i, 0 is the most recent; false past the end
+bool afc_history(const afc_t *afc, uint32_t i, afc_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
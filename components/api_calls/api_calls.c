@@ -3,9 +3,12 @@
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_http_client.h"
 #include "api_calls.h"
+#include "token_cache.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "cJSON.h"
@@ -26,66 +29,37 @@ int expires_in;
 nvs_handle_t session;
 TaskHandle_t getTokenTaskHandle;
 
-char* get_token(char* token_name) {
-    ESP_LOGI(TAG, "Get token %s from NVS", token_name);
-    char* token = {0};
-    int32_t token_len = 0;
-    if (strcmp(token_name, "access_token") == 0) {
-        esp_err_t err = nvs_get_i32(session, "access_len", &token_len);
-        if (err != ESP_OK) {
-            ESP_LOGI(TAG, "Get token read len error");
-            if (err == ESP_ERR_NVS_NOT_FOUND) {
-                ESP_LOGI(TAG, "Not found");
-                return "";
-            }
-        }
-        size_t token_size = token_len+1;
-        token = (char*)malloc(token_size);
-        ESP_ERROR_CHECK(nvs_get_str(session, "access_token", token, &token_size));
-    } else if (strcmp(token_name, "refresh_token") == 0) {
-        esp_err_t err = nvs_get_i32(session, "refresh_len", &token_len);
-        if (err != ESP_OK) {
-            ESP_LOGI(TAG, "Get token read len error");
-            if (err == ESP_ERR_NVS_NOT_FOUND) {
-                ESP_LOGI(TAG, "Not found");
-                return "";
-            }
-        }
-        size_t token_size = token_len+1;
-        token = (char*)malloc(token_size);
-        ESP_ERROR_CHECK(nvs_get_str(session, "refresh_token", token, &token_size));
-    }
-    token[token_len] = '\0';
-    ESP_LOGI(TAG, "%s: %s", token_name, token);
-    return token;
-}
-
-bool get_tokens() {
-    ESP_LOGI(TAG, "Load tokens from NVS");
-    char* access_token = get_token("access_token");
-    char* refresh_token = get_token("refresh_token");
-    bool recovered_session = access_token != NULL || refresh_token != NULL;
-    if (recovered_session) {
-        ESP_LOGI(TAG, "NVS recovered session");
-    } else {
-        ESP_LOGI(TAG, "NVS session not found");
-    }
-    return 0;
-}
+// Long-lived client per endpoint, reused across requests with keep-alive
+typedef struct {
+    char base[MAX_URL_SIZE];
+    esp_http_client_handle_t client;
+    SemaphoreHandle_t lock;
+    bool kept_alive; // Connection open since the last request
+    int64_t last_used_us;
+    http_stats_t stats;
+} http_endpoint_t;
+
+// Per-request state handed to the event handler
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    http_endpoint_t *endpoint;
+    http_timing_t *timing; // Optional
+    bool connected;        // A new connection was opened for this request
+} http_response_t;
+
+static http_endpoint_t endpoints[HTTP_ENDPOINTS_MAX];
+static SemaphoreHandle_t endpoints_lock;
 
 bool save_token(char* token_name, char* token) {
-    int32_t token_len = (int32_t)strlen(token);
-    ESP_LOGI(TAG, "Save %s to nvs: %s, len: %li", token_name, token, token_len);
-    if (strcmp(token_name, "access_token") == 0) {
-        ESP_ERROR_CHECK(nvs_set_i32(session, "access_len", token_len));
-        ESP_ERROR_CHECK(nvs_set_str(session, "access_token", token));
-    } else if (strcmp(token_name, "refresh_token")  == 0) {
-        ESP_ERROR_CHECK(nvs_set_i32(session, "refresh_len", token_len));
-        ESP_ERROR_CHECK(nvs_set_str(session, "refresh_token", token));
-    } else {
+    int id = token_cache_id(token_name);
+    if (id < 0) {
         ESP_LOGI(TAG, "Unknown token name: %s", token_name);
+        return 1;
     }
-    return 0;
+    ESP_LOGI(TAG, "Save %s, len: %d", token_name, (int)strlen(token));
+    return token_cache_set(id, token) != ESP_OK;
 }
 
 bool clear_storage() {
@@ -98,7 +72,7 @@ void nvs_session_init() {
     ESP_LOGI(TAG, "NVS session init");
     nvs_flash_init();
     nvs_open("session", NVS_READWRITE, &session);
-    esp_err_t err = get_tokens();
+    esp_err_t err = token_cache_init(session);
     if (err != ESP_OK) {
         ESP_LOGI(TAG, "Error on get tokens");
     }
@@ -179,101 +153,163 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
     return ESP_OK;
 }
 
-void get_token_task(void *pvParameter) {
-    // Poll tokens
-    ESP_LOGI(TAG, "Starting Get Token Task");
-    char* refresh_token = get_token("refresh_token");
+esp_err_t _http_endpoint_event_handler(esp_http_client_event_t *evt) {
+    http_response_t *response = (http_response_t *)evt->user_data;
+    switch(evt->event_id) {
+        case HTTP_EVENT_ON_CONNECTED:
+            // Fires once per new TCP/TLS connection, not for reused keep-alive requests
+            ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED");
+            if (response != NULL) {
+                response->connected = true;
+                response->endpoint->kept_alive = true;
+                response->endpoint->stats.handshakes++;
+                if (response->timing != NULL) {
+                    response->timing->connected_us = esp_timer_get_time();
+                }
+            }
+            break;
+        case HTTP_EVENT_ON_HEADER:
+            if (response != NULL && response->timing != NULL && response->timing->response_us == 0) {
+                response->timing->response_us = esp_timer_get_time();
+            }
+            break;
+        case HTTP_EVENT_ON_DATA:
+            ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
+            if (response != NULL && !esp_http_client_is_chunked_response(evt->client)) {
+                int copy_len = MIN(evt->data_len, (int)(response->size - 1 - response->len));
+                if (copy_len > 0) {
+                    memcpy(response->buf + response->len, evt->data, copy_len);
+                    response->len += copy_len;
+                    response->buf[response->len] = '\0';
+                }
+            }
+            break;
+        case HTTP_EVENT_DISCONNECTED:
+            ESP_LOGI(TAG, "HTTP_EVENT_DISCONNECTED");
+            if (response != NULL) {
+                response->endpoint->kept_alive = false;
+            }
+            break;
+        case HTTP_EVENT_REDIRECT:
+            ESP_LOGD(TAG, "HTTP_EVENT_REDIRECT");
+            esp_http_client_set_redirection(evt->client);
+            break;
+        default:
+            break;
+    }
+    return ESP_OK;
+}
+
+// Poll the token endpoint until tokens are saved or the server gives up
+static void get_tokens() {
+    char refresh_token[TOKEN_MAX_LEN + 1];
+    token_cache_get(TOKEN_REFRESH, refresh_token, sizeof(refresh_token));
     ESP_LOGI(TAG, "Check if exist previous refresh_token...");
-    if (refresh_token != NULL && strlen(refresh_token)) {
+    if (strlen(refresh_token)) {
         ESP_LOGI(TAG, "Refresh token %s", refresh_token);
-    } else {
+    } else if (code != NULL) {
         ESP_LOGI(TAG, "Device code: %ss...", code);
+    } else {
+        ESP_LOGI(TAG, "No refresh token nor device code, run sync first");
+        return;
     }
     ESP_LOGI(TAG, "Polling every: %is...", interval);
     ESP_LOGI(TAG, "Expiration in: %ims...", expires_in);
     int request_wait_time_ms = interval * 1000;
     while(true) {
-        while(true) {
-            // Fetch tokens
-            char url[MAX_URL_SIZE] = "https://api-sls.platzi.com/prod/space-api/auth/token?";
-
-            if (refresh_token != NULL && strlen(refresh_token)) {
-                ESP_LOGI(TAG, "Use refresh_token");
-                strcat(url, "refresh_token=");
-                strcat(url, refresh_token);
-            } else {
-                ESP_LOGI(TAG, "Use device_code");
-                strcat(url, "code=");
-                strcat(url, code);
-            }
+        // Fetch tokens
+        char url[MAX_URL_SIZE] = "https://api-sls.platzi.com/prod/space-api/auth/token?";
+
+        if (strlen(refresh_token)) {
+            ESP_LOGI(TAG, "Use refresh_token");
+            strcat(url, "refresh_token=");
+            strcat(url, refresh_token);
+        } else {
+            ESP_LOGI(TAG, "Use device_code");
+            strcat(url, "code=");
+            strcat(url, code);
+        }
 
-            ESP_LOGI(TAG, "Get token url: %s\n", url);
+        ESP_LOGI(TAG, "Get token url: %s\n", url);
 
-            char resp[DEFAULT_HTTP_BUF_SIZE] = {0};
-            http_get(url, resp);
-            printf("device_code: %s\n", resp);
+        char resp[DEFAULT_HTTP_BUF_SIZE] = {0};
+        http_get(url, resp);
+        printf("device_code: %s\n", resp);
 
-            cJSON *json = cJSON_Parse(resp);
-            if (cJSON_GetObjectItem(json, "message")) {
-                char *message = cJSON_GetObjectItem(json, "message")->valuestring;
-                ESP_LOGI(TAG, "message=%s", message);
+        cJSON *json = cJSON_Parse(resp);
+        if (cJSON_GetObjectItem(json, "message")) {
+            char *message = cJSON_GetObjectItem(json, "message")->valuestring;
+            ESP_LOGI(TAG, "message=%s", message);
+        }
+        if (cJSON_GetObjectItem(json, "error")) {
+            ESP_LOGI(TAG, "Get tokens error, show error...");
+            char *error = cJSON_GetObjectItem(json,"error")->valuestring;
+            ESP_LOGI(TAG, "error=%s", error);
+            if (strcmp(error, "validation_error") == 0) {
+                ESP_LOGI(TAG, "Validation error");
+                cJSON_Delete(json);
+                return;
+            } else if (strcmp(error, "denied") == 0) {
+                ESP_LOGI(TAG, "Denied error");
+                cJSON_Delete(json);
+                return;
+            } else if (strcmp(error, "expired") == 0) {
+                ESP_LOGI(TAG, "Expiration error");
+                cJSON_Delete(json);
+                return;
+            } else if (strcmp(error, "slow_down") == 0) {
+                request_wait_time_ms += REQUEST_WAIT_TIME_INCREMENT_MS;
+                ESP_LOGI(TAG, "Slow down error, new time: %ims", request_wait_time_ms);
+            } else if (strcmp(error, "authorization_pending") == 0) {
+                ESP_LOGI(TAG, "Authorization pending");
+            } else if (strcmp(error, "") != 0) {
+                ESP_LOGI(TAG, "Unknown error: %s", error);
+                cJSON_Delete(json);
+                return;
             }
-            if (cJSON_GetObjectItem(json, "error")) {
-                ESP_LOGI(TAG, "Get tokens error, show error...");
-                char *error = cJSON_GetObjectItem(json,"error")->valuestring;
-                ESP_LOGI(TAG, "error=%s", error);
-                if (strcmp(error, "validation_error") == 0) {
-                    ESP_LOGI(TAG, "Validation error");
-                    break;
-                } else if (strcmp(error, "denied") == 0) {
-                    ESP_LOGI(TAG, "Denied error");
-                    break;
-                } else if (strcmp(error, "expired") == 0) {
-                    ESP_LOGI(TAG, "Expiration error");
-                    break;
-                } else if (strcmp(error, "slow_down") == 0) {
-                    request_wait_time_ms += REQUEST_WAIT_TIME_INCREMENT_MS;
-                    ESP_LOGI(TAG, "Slow down error, new time: %ims", request_wait_time_ms);
-                } else if (strcmp(error, "authorization_pending") == 0) {
-                    ESP_LOGI(TAG, "Authorization pending");
-                } else if (strcmp(error, "") != 0) {
-                    ESP_LOGI(TAG, "Unknown error: %s", error);
-                    break;
-                }
-            } else {
-                ESP_LOGI(TAG, "Get tokens success, save tokens...");
-                char* access_token = {0};
-                char* refresh_token = {0};
-
-                if (cJSON_GetObjectItem(json, "access_token")) {
-                    char *access = cJSON_GetObjectItem(json, "access_token")->valuestring;
-                    access_token = (char *)malloc(strlen(access)+1);
-                    strcpy(access_token, access);
-                    ESP_LOGI(TAG, "access_token=%s", access_token);
-                    save_token("access_token", access_token);
-                }
-                if (cJSON_GetObjectItem(json, "refresh_token")) {
-                    char *refresh = cJSON_GetObjectItem(json, "refresh_token")->valuestring;
-                    refresh_token = (char *)malloc(strlen(refresh)+1);
-                    strcpy(refresh_token, refresh);
-                    ESP_LOGI(TAG, "refresh_token=%s", refresh_token);
-                    save_token("refresh_token", refresh_token);
-                }
-                ESP_LOGI(TAG, "Tokens saved, delete get token task");
-                vTaskDelete(getTokenTaskHandle);
+        } else {
+            ESP_LOGI(TAG, "Get tokens success, save tokens...");
+            if (cJSON_GetObjectItem(json, "access_token")) {
+                char *access = cJSON_GetObjectItem(json, "access_token")->valuestring;
+                ESP_LOGI(TAG, "access_token=%s", access);
+                save_token("access_token", access);
             }
-
+            if (cJSON_GetObjectItem(json, "refresh_token")) {
+                char *refresh = cJSON_GetObjectItem(json, "refresh_token")->valuestring;
+                ESP_LOGI(TAG, "refresh_token=%s", refresh);
+                save_token("refresh_token", refresh);
+            }
+            ESP_LOGI(TAG, "Tokens saved");
             cJSON_Delete(json);
-
-            ESP_LOGI(TAG, "End of get task cycle, wait for next");
-            vTaskDelay(request_wait_time_ms / portTICK_PERIOD_MS);
+            return;
         }
 
-        ESP_LOGI(TAG, "Delete get token task");
-        vTaskDelete(getTokenTaskHandle);
+        cJSON_Delete(json);
+
+        ESP_LOGI(TAG, "End of get task cycle, wait for next");
+        vTaskDelay(request_wait_time_ms / portTICK_PERIOD_MS);
     }
 }
 
+// Lives for the whole uptime and never holds an endpoint lock while waiting,
+// renewals are requested with token_renew()
+void get_token_task(void *pvParameter) {
+    ESP_LOGI(TAG, "Starting Get Token Task");
+    while(true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        get_tokens();
+    }
+}
+
+// Wake the token task. Renewals asked for while one runs are coalesced into
+// the next run; a 401 seen by the token task itself is ignored.
+static void token_renew() {
+    if (getTokenTaskHandle == NULL || xTaskGetCurrentTaskHandle() == getTokenTaskHandle) {
+        return;
+    }
+    xTaskNotifyGive(getTokenTaskHandle);
+}
+
 bool get_url(const char *url, int timeout_ms) {
     printf("Get url: %s, timeout: %ims\n", url, timeout_ms);
     esp_http_client_config_t config = {
@@ -292,10 +328,7 @@ bool get_url(const char *url, int timeout_ms) {
         ESP_LOGI(TAG, "HTTPS Status = %d, content_length = %"PRIu64, status_code, content_length);
         if (status_code == 401) {
             ESP_LOGI(TAG, "Unauthorized request... renew token");
-            if (getTokenTaskHandle != NULL) {
-                vTaskDelete(getTokenTaskHandle);
-            }
-            xTaskCreate(&get_token_task, "get_token_task", 1024 * 8, NULL, 5, &getTokenTaskHandle);
+            token_renew();
         }
     } else {
         ESP_LOGE(TAG, "Error perform http request %s", esp_err_to_name(err));
@@ -304,90 +337,209 @@ bool get_url(const char *url, int timeout_ms) {
     return 0;
 }
 
-bool http_get(const char* url, char* res) {
-    ESP_LOGI(TAG, "HTTP GET %s buff_size: %i\n", url, DEFAULT_HTTP_BUF_SIZE);
-    char local_response_buffer[DEFAULT_HTTP_BUF_SIZE] = {0};
-    esp_http_client_config_t config = {
-        .url = url,
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .cert_pem = platzi_com_root_cert_pem_start,
-        .user_data = local_response_buffer,
-        .event_handler = _http_event_handler,
-    };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_err_t err = esp_http_client_perform(client);
+static bool http_endpoint_matches(const http_endpoint_t *endpoint, const char *url) {
+    size_t base_len = strcspn(url, "?");
+    return endpoint->client != NULL && strlen(endpoint->base) == base_len && strncmp(endpoint->base, url, base_len) == 0;
+}
 
-    int status_code = esp_http_client_get_status_code(client);
-    uint64_t content_length = esp_http_client_get_content_length(client);
-    if (err == ESP_OK) {
-        ESP_LOGI(TAG, "HTTPS Status = %d, content_length = %"PRIu64, status_code, content_length);
-        ESP_LOG_BUFFER_HEX(TAG, local_response_buffer, strlen(local_response_buffer));
-        ESP_LOGI(TAG, "Decoded: %s", (char *)local_response_buffer);
-        strcpy(res, local_response_buffer);
-        if (status_code == 401) {
-            ESP_LOGI(TAG, "Unauthorized request... renew token");
-            if (getTokenTaskHandle != NULL) {
-                vTaskDelete(getTokenTaskHandle);
-            }
-            xTaskCreate(&get_token_task, "get_token_task", 1024 * 8, NULL, 5, &getTokenTaskHandle);
+static http_endpoint_t* http_endpoint_get(const char *url) {
+    size_t base_len = strcspn(url, "?");
+    if (base_len >= MAX_URL_SIZE) {
+        ESP_LOGE(TAG, "URL too long for endpoint table: %s", url);
+        return NULL;
+    }
+
+    http_endpoint_t *endpoint = NULL;
+    http_endpoint_t *oldest = NULL;
+    xSemaphoreTake(endpoints_lock, portMAX_DELAY);
+    for (int i = 0; i < HTTP_ENDPOINTS_MAX; i++) {
+        if (endpoints[i].client == NULL) {
+            if (endpoint == NULL) endpoint = &endpoints[i];
+            continue;
+        }
+        if (http_endpoint_matches(&endpoints[i], url)) {
+            endpoint = &endpoints[i];
+            break;
+        }
+        if (oldest == NULL || endpoints[i].last_used_us < oldest->last_used_us) {
+            oldest = &endpoints[i];
         }
-    } else {
-        ESP_LOGE(TAG, "Error perform http request %s", esp_err_to_name(err));
     }
-    esp_http_client_cleanup(client);
-    return 0;
+    if (endpoint == NULL && oldest != NULL && xSemaphoreTake(oldest->lock, 0) == pdTRUE) {
+        // Table full, close the least recently used client unless a request holds it
+        ESP_LOGI(TAG, "Endpoint table full, close the client for %s", oldest->base);
+        esp_http_client_cleanup(oldest->client);
+        oldest->client = NULL;
+        oldest->base[0] = '\0';
+        oldest->kept_alive = false;
+        memset(&oldest->stats, 0, sizeof(oldest->stats));
+        xSemaphoreGive(oldest->lock);
+        endpoint = oldest;
+    }
+    if (endpoint != NULL && endpoint->client == NULL) {
+        ESP_LOGI(TAG, "New persistent client for %.*s", (int)base_len, url);
+        memcpy(endpoint->base, url, base_len);
+        endpoint->base[base_len] = '\0';
+        esp_http_client_config_t config = {
+            .url = url,
+            .transport_type = HTTP_TRANSPORT_OVER_SSL,
+            .cert_pem = platzi_com_root_cert_pem_start,
+            .event_handler = _http_endpoint_event_handler,
+            .keep_alive_enable = true,
+        };
+        if (endpoint->lock == NULL) {
+            endpoint->lock = xSemaphoreCreateMutex();
+        }
+        endpoint->client = esp_http_client_init(&config);
+    } else if (endpoint == NULL) {
+        ESP_LOGE(TAG, "Endpoint table full and all busy, can not add %s", url);
+    }
+    xSemaphoreGive(endpoints_lock);
+    return endpoint;
 }
 
-bool http_post(const char* url, const char* body, char* res) {
-    ESP_LOGI(TAG, "HTTP POST %s buff_size: %i\n", url, DEFAULT_HTTP_BUF_SIZE);
+static bool http_request(esp_http_client_method_t method, const char* url, const char* body, char* res,
+                         http_timing_t *timing) {
+    http_endpoint_t *endpoint = http_endpoint_get(url);
+    if (endpoint == NULL) {
+        return 1;
+    }
+
     char local_response_buffer[DEFAULT_HTTP_BUF_SIZE] = {0};
-    esp_http_client_config_t config = {
-        .url = url,
-        .method = HTTP_METHOD_POST,
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .cert_pem = platzi_com_root_cert_pem_start,
-        .user_data = local_response_buffer,
-        .event_handler = _http_event_handler,
+    http_response_t response = {
+        .buf = local_response_buffer,
+        .size = sizeof(local_response_buffer),
+        .endpoint = endpoint,
+        .timing = timing,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
 
-    char* access_token = get_token("access_token");
+    xSemaphoreTake(endpoint->lock, portMAX_DELAY);
+    while (!http_endpoint_matches(endpoint, url)) {
+        // Replaced by another URL while this task waited for the lock, look it up again
+        xSemaphoreGive(endpoint->lock);
+        endpoint = http_endpoint_get(url);
+        if (endpoint == NULL) {
+            return 1;
+        }
+        response.endpoint = endpoint;
+        xSemaphoreTake(endpoint->lock, portMAX_DELAY);
+    }
+    endpoint->last_used_us = esp_timer_get_time();
+    esp_http_client_handle_t client = endpoint->client;
+    esp_http_client_set_url(client, url);
+    esp_http_client_set_method(client, method);
+    esp_http_client_set_user_data(client, &response);
+
+    if (method == HTTP_METHOD_POST) {
+        // Served from RAM, the header value is copied by the client
+        char bearer_token[TOKEN_MAX_LEN + 8] = "Bearer ";
+        if (token_cache_get(TOKEN_ACCESS, bearer_token + 7, sizeof(bearer_token) - 7) > 0) {
+            ESP_LOGD(TAG, "Add authorization header");
+            esp_http_client_set_header(client, "Authorization", bearer_token);
+        } else {
+            ESP_LOGI(TAG, "Token not found, skip authorization header");
+            esp_http_client_delete_header(client, "Authorization");
+        }
 
-    if (access_token != NULL) {
-        ESP_LOGI(TAG, "Add authorization header: %s", access_token);
-        int bearer_len = strlen(access_token) + 8; // "Bearer " = 7 chars + 1 end char
-        char bearer_token[bearer_len];
-        sprintf(bearer_token, "Bearer %s", access_token);
-        bearer_token[bearer_len] = '\0';
-        esp_http_client_set_header(client, "Authorization", bearer_token);
+        esp_http_client_set_header(client, "Content-Type", "application/json");
+        esp_http_client_set_post_field(client, body, strlen(body));
     } else {
-        ESP_LOGI(TAG, "Token not found, skip authorization header");
+        esp_http_client_delete_header(client, "Authorization");
+        esp_http_client_delete_header(client, "Content-Type");
+        esp_http_client_set_post_field(client, NULL, 0);
     }
 
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, body, strlen(body));
-
+    int64_t start = esp_timer_get_time();
+    if (timing != NULL) {
+        memset(timing, 0, sizeof(*timing));
+        timing->start_us = start;
+    }
+    bool reused = endpoint->kept_alive;
     esp_err_t err = esp_http_client_perform(client);
+    if (err != ESP_OK && reused && !response.connected &&
+        (err == ESP_ERR_HTTP_CONNECT || err == ESP_ERR_HTTP_WRITE_DATA)) {
+        // Kept-alive connection was closed by the server or lost with WiFi before the
+        // request went out, retry once on a fresh one. Any later error may mean the
+        // server got the request, so the caller decides.
+        ESP_LOGW(TAG, "Request failed on kept-alive connection (%s), reconnecting", esp_err_to_name(err));
+        esp_http_client_close(client);
+        endpoint->stats.reconnects++;
+        response.len = 0;
+        local_response_buffer[0] = '\0';
+        if (timing != NULL) {
+            timing->response_us = 0;
+        }
+        err = esp_http_client_perform(client);
+    }
+    int64_t latency = esp_timer_get_time() - start;
+    if (timing != NULL) {
+        timing->done_us = start + latency;
+    }
+
+    endpoint->stats.requests++;
+    endpoint->stats.last_us = latency;
+    endpoint->stats.total_us += latency;
+    if (latency > endpoint->stats.max_us) endpoint->stats.max_us = latency;
 
     int status_code = esp_http_client_get_status_code(client);
     uint64_t content_length = esp_http_client_get_content_length(client);
     if (err == ESP_OK) {
-        ESP_LOGI(TAG, "HTTPS Status = %d, content_length = %"PRIu64, status_code, content_length);
+        ESP_LOGI(TAG, "HTTPS Status = %d, content_length = %"PRIu64", %"PRId64"ms", status_code, content_length, latency / 1000);
         ESP_LOG_BUFFER_HEX(TAG, local_response_buffer, strlen(local_response_buffer));
         ESP_LOGI(TAG, "Decoded: %s", (char *)local_response_buffer);
         strcpy(res, local_response_buffer);
-        if (status_code == 401) {
-            ESP_LOGI(TAG, "Unauthorized request... renew token");
-            if (getTokenTaskHandle != NULL) {
-                vTaskDelete(getTokenTaskHandle);
-            }
-            xTaskCreate(&get_token_task, "get_token_task", 1024 * 8, NULL, 5, &getTokenTaskHandle);
-        }
     } else {
         ESP_LOGE(TAG, "Error perform http request %s", esp_err_to_name(err));
+        endpoint->stats.errors++;
+        endpoint->kept_alive = false;
+        esp_http_client_close(client);
+    }
+    xSemaphoreGive(endpoint->lock);
+    if (err == ESP_OK && status_code == 401) {
+        // After releasing the endpoint, the token task may need this same one
+        ESP_LOGI(TAG, "Unauthorized request... renew token");
+        token_renew();
+    }
+    // Rejected by the server for now, the caller may retry later
+    return err != ESP_OK || status_code == 401 || status_code >= 500;
+}
+
+void http_client_init() {
+    ESP_LOGI(TAG, "HTTP client init");
+    endpoints_lock = xSemaphoreCreateMutex();
+    xTaskCreate(&get_token_task, "get_token_task", 1024 * 8, NULL, 5, &getTokenTaskHandle);
+}
+
+bool http_get(const char* url, char* res) {
+    ESP_LOGI(TAG, "HTTP GET %s buff_size: %i\n", url, DEFAULT_HTTP_BUF_SIZE);
+    return http_request(HTTP_METHOD_GET, url, NULL, res, NULL);
+}
+
+bool http_post(const char* url, const char* body, char* res) {
+    ESP_LOGI(TAG, "HTTP POST %s buff_size: %i\n", url, DEFAULT_HTTP_BUF_SIZE);
+    return http_request(HTTP_METHOD_POST, url, body, res, NULL);
+}
+
+bool http_post_timed(const char* url, const char* body, char* res, http_timing_t *timing) {
+    ESP_LOGI(TAG, "HTTP POST %s buff_size: %i\n", url, DEFAULT_HTTP_BUF_SIZE);
+    return http_request(HTTP_METHOD_POST, url, body, res, timing);
+}
+
+int http_get_stats(http_stats_t *stats, int max) {
+    int count = 0;
+    for (int i = 0; i < HTTP_ENDPOINTS_MAX && count < max; i++) {
+        if (endpoints[i].client == NULL) continue;
+        stats[count] = endpoints[i].stats;
+        strlcpy(stats[count].url, endpoints[i].base, sizeof(stats[count].url));
+        count++;
+    }
+    return count;
+}
+
+void http_reset_stats() {
+    for (int i = 0; i < HTTP_ENDPOINTS_MAX; i++) {
+        memset(&endpoints[i].stats, 0, sizeof(endpoints[i].stats));
     }
-    esp_http_client_cleanup(client);
-    return 0;
 }
 
 bool sync_account() {
@@ -423,12 +575,7 @@ bool sync_account() {
 		ESP_LOGI(TAG, "expires_in=%i", expires_in);
 	}
     cJSON_Delete(json);
-    if (getTokenTaskHandle != NULL) {
-        ESP_LOGI(TAG, "sync delete previous token task and create new");
-        // vTaskDelete(getTokenTaskHandle);
-    } else {
-        ESP_LOGI(TAG, "sync create first token task");
-    }
-    xTaskCreate(&get_token_task, "get_token_task", 1024 * 8, NULL, 5, &getTokenTaskHandle);
+    ESP_LOGI(TAG, "sync start polling for tokens");
+    token_renew();
     return 0;
 }
\ No newline at end of file
@@ -1,15 +1,47 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Persistent clients, one per URL without query string: the message API,
+// the two auth URLs, the element set URL and 3 mission endpoints, plus one
+// for console requests. The least recently used idle one is replaced when full.
+#define HTTP_ENDPOINTS_MAX 8
+
+// Per-endpoint counters of the persistent HTTPS clients
+typedef struct {
+    char url[96];
+    uint32_t requests;
+    uint32_t errors;
+    uint32_t handshakes; // New TLS connections
+    uint32_t reconnects; // Retries after a dropped keep-alive connection
+    int64_t last_us;
+    int64_t total_us;
+    int64_t max_us;
+} http_stats_t;
+
+// Stage times of one request, esp_timer_get_time() us, 0 if it did not happen
+typedef struct {
+    int64_t start_us;
+    int64_t connected_us; // New TLS connection up, 0 when a kept-alive one was reused
+    int64_t response_us;  // First response header
+    int64_t done_us;
+} http_timing_t;
+
 // Register API Calls functions
 void nvs_session_init();
 bool clear_storage();
 bool get_url(const char *url, int timeout_ms);
 bool http_get(const char *url, char* res);
 bool http_post(const char *url, const char *body, char* res);
+bool http_post_timed(const char *url, const char *body, char* res, http_timing_t *timing);
+void http_client_init();
+int http_get_stats(http_stats_t *stats, int max);
+void http_reset_stats();
 bool sync_account();
 
 #ifdef __cplusplus
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_log.h"
+#include "token_cache.h"
+
+static const char *TAG = "TOKEN_CACHE";
+
+typedef struct {
+    const char *key;     // NVS key of the token
+    const char *len_key; // NVS key of its length, kept for older firmware
+    char *value;
+    size_t len;
+} token_entry_t;
+
+static token_entry_t tokens[TOKEN_COUNT] = {
+    [TOKEN_ACCESS] = { .key = "access_token", .len_key = "access_len" },
+    [TOKEN_REFRESH] = { .key = "refresh_token", .len_key = "refresh_len" },
+};
+
+// Every request reads the access token, writes only happen on login and renewal
+static pthread_rwlock_t tokens_lock = PTHREAD_RWLOCK_INITIALIZER;
+static nvs_handle_t tokens_nvs;
+
+// Replace the cached value, caller holds the write lock
+static esp_err_t token_store(token_entry_t *entry, const char *token, size_t len) {
+    char *value = realloc(entry->value, len + 1);
+    if (value == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(value, token, len);
+    value[len] = '\0';
+    entry->value = value;
+    entry->len = len;
+    return ESP_OK;
+}
+
+esp_err_t token_cache_init(nvs_handle_t session) {
+    tokens_nvs = session;
+    pthread_rwlock_wrlock(&tokens_lock);
+    for (int i = 0; i < TOKEN_COUNT; i++) {
+        size_t size = 0;
+        esp_err_t err = nvs_get_str(session, tokens[i].key, NULL, &size);
+        if (err == ESP_OK) {
+            char *value = realloc(tokens[i].value, size);
+            if (value == NULL) {
+                err = ESP_ERR_NO_MEM;
+            } else {
+                tokens[i].value = value;
+                err = nvs_get_str(session, tokens[i].key, value, &size);
+            }
+        }
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGI(TAG, "%s not found", tokens[i].key);
+            continue;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Read %s failed: %s", tokens[i].key, esp_err_to_name(err));
+            continue;
+        }
+        tokens[i].len = strlen(tokens[i].value);
+        ESP_LOGI(TAG, "Loaded %s, len: %d", tokens[i].key, (int)tokens[i].len);
+    }
+    pthread_rwlock_unlock(&tokens_lock);
+    return ESP_OK;
+}
+
+size_t token_cache_get(token_id_t id, char *out, size_t size) {
+    size_t len = 0;
+    pthread_rwlock_rdlock(&tokens_lock);
+    token_entry_t *entry = &tokens[id];
+    if (entry->len > 0 && entry->len < size) {
+        memcpy(out, entry->value, entry->len + 1);
+        len = entry->len;
+    }
+    pthread_rwlock_unlock(&tokens_lock);
+    if (len == 0 && size > 0) {
+        out[0] = '\0';
+    }
+    return len;
+}
+
+esp_err_t token_cache_set(token_id_t id, const char *token) {
+    size_t len = strlen(token);
+    if (len > TOKEN_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    token_entry_t *entry = &tokens[id];
+    pthread_rwlock_wrlock(&tokens_lock);
+    if (entry->len == len && (len == 0 || memcmp(entry->value, token, len) == 0)) {
+        pthread_rwlock_unlock(&tokens_lock);
+        return ESP_OK;
+    }
+    esp_err_t err = token_store(entry, token, len);
+    if (err == ESP_OK) {
+        err = nvs_set_i32(tokens_nvs, entry->len_key, (int32_t)len);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_str(tokens_nvs, entry->key, token);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(tokens_nvs);
+    }
+    pthread_rwlock_unlock(&tokens_lock);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Save %s failed: %s", entry->key, esp_err_to_name(err));
+    }
+    return err;
+}
+
+int token_cache_id(const char *name) {
+    for (int i = 0; i < TOKEN_COUNT; i++) {
+        if (strcmp(tokens[i].key, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOKEN_MAX_LEN 2048
+
+typedef enum {
+    TOKEN_ACCESS,
+    TOKEN_REFRESH,
+    TOKEN_COUNT,
+} token_id_t;
+
+// Load every token from the session namespace, called once at boot
+esp_err_t token_cache_init(nvs_handle_t session);
+
+// Copy a token into out, returns its length or 0 if it is not set or does not fit
+size_t token_cache_get(token_id_t id, char *out, size_t size);
+
+// Update a token, NVS is only written when the value changes
+esp_err_t token_cache_set(token_id_t id, const char *token);
+
+// Token id from its NVS key, -1 if unknown
+int token_cache_id(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
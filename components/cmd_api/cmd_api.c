@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
 #include "esp_console.h"
 #include "argtable3/argtable3.h"
@@ -7,6 +8,7 @@
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "api_calls.h"
+#include "latency.h"
 
 void initialize_api(void) {
     ESP_LOGI("api", "initialize api");
@@ -68,7 +70,7 @@ static int post(int argc, char **argv) {
         return 1;
     }
     ESP_LOGI(__func__, "post %s to '%s'", post_args.body->sval[0], post_args.url->sval[0]);
-    char res[128] = "";
+    char res[512] = "";
     bool err = http_post(post_args.url->sval[0], post_args.body->sval[0], res);
     if (err) {
         ESP_LOGW(__func__, "Connection timed out");
@@ -99,6 +101,71 @@ static int sync_handler(int argc, char **argv) {
     return 0;
 }
 
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} http_args;
+
+static int http(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &http_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, http_args.end, argv[0]);
+        return 1;
+    }
+    static http_stats_t stats[HTTP_ENDPOINTS_MAX]; // Too large for the console stack
+    int count = http_get_stats(stats, HTTP_ENDPOINTS_MAX);
+    if (count == 0) {
+        printf("No persistent connections yet\n");
+    }
+    for (int i = 0; i < count; i++) {
+        printf("%s\n", stats[i].url);
+        printf("  requests: %"PRIu32", errors: %"PRIu32", TLS handshakes: %"PRIu32", reconnects: %"PRIu32"\n",
+               stats[i].requests, stats[i].errors, stats[i].handshakes, stats[i].reconnects);
+        printf("  latency: last %"PRId64"ms, avg %"PRId64"ms, max %"PRId64"ms\n",
+               stats[i].last_us / 1000,
+               stats[i].requests ? stats[i].total_us / stats[i].requests / 1000 : 0,
+               stats[i].max_us / 1000);
+    }
+    if (http_args.reset->count) {
+        ESP_LOGI(__func__, "Reset HTTP counters");
+        http_reset_stats();
+    }
+    return 0;
+}
+
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} latency_args;
+
+static void print_ms(uint32_t us) {
+    printf(" %9.1f", us / 1000.0);
+}
+
+static int latency(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &latency_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, latency_args.end, argv[0]);
+        return 1;
+    }
+    printf("%-14s %7s %9s %9s %9s %9s  (ms)\n", "stage", "count", "p50", "p90", "p99", "max");
+    for (int i = 0; i < LATENCY_STAGES; i++) {
+        latency_summary_t summary;
+        latency_get(i, &summary);
+        printf("%-14s %7"PRIu32, latency_stage_name(i), summary.count);
+        print_ms(summary.p50_us);
+        print_ms(summary.p90_us);
+        print_ms(summary.p99_us);
+        print_ms(summary.max_us);
+        printf("\n");
+    }
+    if (latency_args.reset->count) {
+        ESP_LOGI(__func__, "Reset latency histograms");
+        latency_reset();
+    }
+    return 0;
+}
+
 void register_api(void) {
     clear_args.end = arg_end(2);
 
@@ -145,8 +212,32 @@ void register_api(void) {
         .argtable = &sync_args
     };
 
+    http_args.reset = arg_lit0("r", "reset", "Reset counters after printing");
+    http_args.end = arg_end(2);
+
+    const esp_console_cmd_t http_cmd = {
+        .command = "http",
+        .help = "Show per-endpoint HTTPS latency and TLS handshake counters",
+        .hint = NULL,
+        .func = &http,
+        .argtable = &http_args
+    };
+
+    latency_args.reset = arg_lit0("r", "reset", "Reset histograms after printing");
+    latency_args.end = arg_end(2);
+
+    const esp_console_cmd_t latency_cmd = {
+        .command = "latency",
+        .help = "Show the time frames spend in each stage from the radio interrupt to the server response",
+        .hint = NULL,
+        .func = &latency,
+        .argtable = &latency_args
+    };
+
     ESP_ERROR_CHECK( esp_console_cmd_register(&clear_cmd) );
     ESP_ERROR_CHECK( esp_console_cmd_register(&get_cmd) );
     ESP_ERROR_CHECK( esp_console_cmd_register(&post_cmd) );
     ESP_ERROR_CHECK( esp_console_cmd_register(&sync_cmd) );
+    ESP_ERROR_CHECK( esp_console_cmd_register(&http_cmd) );
+    ESP_ERROR_CHECK( esp_console_cmd_register(&latency_cmd) );
 }
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "display_service.h"
+#include "cmd_display.h"
+
+static SSD1306_t *display_dev;
+
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} display_args;
+
+static int display(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &display_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, display_args.end, argv[0]);
+        return 1;
+    }
+
+    uint32_t frames = display_dev->_flushCount;
+    printf("Mode: %s\n", display_dev->_framebuffer ? "framebuffer" : "direct");
+    printf("Bus transfers: %"PRIu32", bytes: %"PRIu32"\n", display_dev->_txCount, display_dev->_txBytes);
+    if (frames) {
+        printf("Per frame: %"PRIu32" transfers, %"PRIu32" bytes over %"PRIu32" frames\n",
+               display_dev->_txCount / frames, display_dev->_txBytes / frames, frames);
+    }
+
+    display_stats_t stats;
+    display_service_get_stats(&stats);
+    printf("Commands: %"PRIu32" posted, %"PRIu32" dropped; frames: %"PRIu32" drawn, %"PRIu32" unchanged\n",
+           stats.posted, stats.dropped, stats.frames, stats.skipped);
+
+    if (display_args.reset->count) {
+        ESP_LOGI(__func__, "Reset display counters");
+        ssd1306_reset_stats(display_dev);
+    }
+    return 0;
+}
+
+void register_display(SSD1306_t *dev) {
+    display_dev = dev;
+    display_args.reset = arg_lit0("r", "reset", "Reset bus counters after printing");
+    display_args.end = arg_end(2);
+
+    const esp_console_cmd_t display_cmd = {
+        .command = "display",
+        .help = "Show OLED bus transfers and bytes per frame",
+        .hint = NULL,
+        .func = &display,
+        .argtable = &display_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&display_cmd) );
+}
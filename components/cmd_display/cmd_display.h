@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ssd1306.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register OLED display commands for the given screen
+void register_display(SSD1306_t *dev);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "mission_filter.h"
+#include "cmd_filter.h"
+
+static struct {
+    struct arg_str *add;
+    struct arg_str *prefix;
+    struct arg_str *hex;
+    struct arg_int *offset;
+    struct arg_str *mask;
+    struct arg_str *value;
+    struct arg_int *min_len;
+    struct arg_int *max_len;
+    struct arg_str *action;
+    struct arg_int *endpoint;
+    struct arg_str *remove;
+    struct arg_str *test;
+    struct arg_end *end;
+} filter_args;
+
+static struct {
+    struct arg_int *index;
+    struct arg_str *url;
+    struct arg_lit *clear;
+    struct arg_end *end;
+} endpoint_args;
+
+// Bytes of a hex string, -1 if malformed or longer than size
+static int parse_hex(const char *str, uint8_t *out, int size) {
+    int len = strlen(str);
+    if (len % 2 != 0 || len / 2 > size) {
+        return -1;
+    }
+    for (int i = 0; i < len / 2; i++) {
+        unsigned int byte;
+        if (sscanf(&str[i * 2], "%2x", &byte) != 1) {
+            return -1;
+        }
+        out[i] = byte;
+    }
+    return len / 2;
+}
+
+static void print_hex(const uint8_t *bytes, int len) {
+    for (int i = 0; i < len; i++) {
+        printf("%02x", bytes[i]);
+    }
+}
+
+static void print_prefix(const mission_rule_t *rule) {
+    bool printable = true;
+    for (int i = 0; i < rule->prefix_len; i++) {
+        printable &= rule->prefix[i] >= 0x20 && rule->prefix[i] < 0x7f;
+    }
+    if (rule->prefix_len == 0) {
+        printf("%-18s", "*");
+    } else if (printable) {
+        printf("\"%.*s\"%*s", rule->prefix_len, (const char *)rule->prefix, 16 - rule->prefix_len, "");
+    } else {
+        printf("0x");
+        print_hex(rule->prefix, rule->prefix_len);
+        printf("%*s", 16 - 2 * rule->prefix_len, "");
+    }
+}
+
+static int filter_add() {
+    mission_rule_t rule = {
+        .max_len = UINT16_MAX,
+        .action = MISSION_UPLOAD,
+    };
+    strlcpy(rule.name, filter_args.add->sval[0], sizeof(rule.name));
+    if (filter_args.prefix->count && filter_args.hex->count) {
+        printf("Use either --prefix or --hex\n");
+        return 1;
+    }
+    if (filter_args.prefix->count) {
+        const char *prefix = filter_args.prefix->sval[0];
+        if (strlen(prefix) > MISSION_PREFIX_MAX) {
+            printf("Prefix longer than %d bytes\n", MISSION_PREFIX_MAX);
+            return 1;
+        }
+        rule.prefix_len = strlen(prefix);
+        memcpy(rule.prefix, prefix, rule.prefix_len);
+    } else if (filter_args.hex->count) {
+        int len = parse_hex(filter_args.hex->sval[0], rule.prefix, MISSION_PREFIX_MAX);
+        if (len < 0) {
+            printf("Prefix must be hex, up to %d bytes\n", MISSION_PREFIX_MAX);
+            return 1;
+        }
+        rule.prefix_len = len;
+    }
+    if (filter_args.mask->count || filter_args.value->count) {
+        int mask_len = filter_args.mask->count ? parse_hex(filter_args.mask->sval[0], rule.mask, MISSION_MASK_MAX) : -1;
+        int value_len = filter_args.value->count ? parse_hex(filter_args.value->sval[0], rule.value, MISSION_MASK_MAX) : -1;
+        if (mask_len <= 0 || mask_len != value_len) {
+            printf("--mask and --value must be hex of the same length, up to %d bytes\n", MISSION_MASK_MAX);
+            return 1;
+        }
+        for (int i = 0; i < mask_len; i++) {
+            rule.value[i] &= rule.mask[i];
+        }
+        int offset = filter_args.offset->count ? filter_args.offset->ival[0] : 0;
+        if (offset < 0 || offset > UINT8_MAX) {
+            printf("--offset must be 0 to %d\n", UINT8_MAX);
+            return 1;
+        }
+        rule.mask_len = mask_len;
+        rule.mask_offset = offset;
+    }
+    if (filter_args.min_len->count) {
+        int min_len = filter_args.min_len->ival[0];
+        if (min_len < 0 || min_len > UINT16_MAX) {
+            printf("--min must be 0 to %d\n", UINT16_MAX);
+            return 1;
+        }
+        rule.min_len = min_len;
+    }
+    if (filter_args.max_len->count) {
+        int max_len = filter_args.max_len->ival[0];
+        if (max_len < 0 || max_len > UINT16_MAX) {
+            printf("--max must be 0 to %d\n", UINT16_MAX);
+            return 1;
+        }
+        rule.max_len = max_len;
+    }
+    if (filter_args.action->count) {
+        int action = mission_action_parse(filter_args.action->sval[0]);
+        if (action < 0) {
+            printf("Action must be upload, store, display or drop\n");
+            return 1;
+        }
+        rule.action = action;
+    }
+    if (filter_args.endpoint->count) {
+        int endpoint = filter_args.endpoint->ival[0];
+        if (endpoint < 0 || endpoint >= MISSION_ENDPOINTS) {
+            printf("--endpoint must be 0 to %d\n", MISSION_ENDPOINTS - 1);
+            return 1;
+        }
+        rule.endpoint = endpoint;
+    }
+    esp_err_t err = mission_filter_set(&rule);
+    if (err != ESP_OK) {
+        printf("Rule rejected: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    return 0;
+}
+
+static int filter(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &filter_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, filter_args.end, argv[0]);
+        return 1;
+    }
+
+    if (filter_args.add->count && filter_add() != 0) {
+        return 1;
+    }
+    if (filter_args.remove->count) {
+        esp_err_t err = mission_filter_remove(filter_args.remove->sval[0]);
+        if (err != ESP_OK) {
+            printf("No rule %s\n", filter_args.remove->sval[0]);
+            return 1;
+        }
+    }
+    if (filter_args.test->count) {
+        const char *payload = filter_args.test->sval[0];
+        mission_route_t route;
+        mission_filter_match((const uint8_t *)payload, strlen(payload), &route);
+        if (route.rule < 0) {
+            printf("No rule matches, dropped as unknown\n");
+        } else {
+            printf("Rule %d, %s to endpoint %d\n", route.rule, mission_action_name(route.action), route.endpoint);
+        }
+        return 0;
+    }
+
+    int count = mission_filter_count();
+    if (count == 0) {
+        printf("No rules, every frame is dropped\n");
+        return 0;
+    }
+    printf("  #  name              prefix            length      mask          action    ep  hits\n");
+    mission_rule_t rule;
+    uint32_t hits;
+    for (int i = 0; mission_filter_get(i, &rule, &hits); i++) {
+        printf("%3d  %-16s  ", i, rule.name);
+        print_prefix(&rule);
+        printf("  %5u-%-5u  ", rule.min_len, rule.max_len);
+        if (rule.mask_len > 0) {
+            printf("@%-3u", rule.mask_offset);
+            print_hex(rule.mask, rule.mask_len);
+            printf("=");
+            print_hex(rule.value, rule.mask_len);
+            printf("  ");
+        } else {
+            printf("%-14s", "-");
+        }
+        printf("%-8s  %2u  %"PRIu32"\n", mission_action_name(rule.action), rule.endpoint, hits);
+    }
+    return 0;
+}
+
+static int endpoint(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &endpoint_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, endpoint_args.end, argv[0]);
+        return 1;
+    }
+
+    if (endpoint_args.index->count) {
+        if (!endpoint_args.url->count && !endpoint_args.clear->count) {
+            printf("Give a URL or --clear\n");
+            return 1;
+        }
+        esp_err_t err = mission_filter_set_endpoint(endpoint_args.index->ival[0],
+                                                    endpoint_args.clear->count ? "" : endpoint_args.url->sval[0]);
+        if (err != ESP_OK) {
+            printf("Endpoint not set: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+    }
+
+    char url[MISSION_URL_MAX];
+    for (int i = 0; i < MISSION_ENDPOINTS; i++) {
+        bool set = mission_filter_get_endpoint(i, url, sizeof(url));
+        printf("%d: %s%s\n", i, set ? url : "not set, uses endpoint 0", i == 0 ? " (message API)" : "");
+    }
+    return 0;
+}
+
+void register_filter() {
+    filter_args.add = arg_str0("a", "add", "<name>", "Add a rule or replace the one with this name");
+    filter_args.prefix = arg_str0("p", "prefix", "<text>", "Frames starting with this text");
+    filter_args.hex = arg_str0("x", "hex", "<hex>", "Frames starting with these bytes");
+    filter_args.offset = arg_int0("o", "offset", "<n>", "Position of the masked bytes");
+    filter_args.mask = arg_str0("m", "mask", "<hex>", "Bits compared at --offset");
+    filter_args.value = arg_str0("v", "value", "<hex>", "Value of the masked bits");
+    filter_args.min_len = arg_int0(NULL, "min", "<bytes>", "Shortest frame");
+    filter_args.max_len = arg_int0(NULL, "max", "<bytes>", "Longest frame");
+    filter_args.action = arg_str0("A", "action", "<upload|store|display|drop>", "What to do with a match, upload by default");
+    filter_args.endpoint = arg_int0("e", "endpoint", "<index>", "Endpoint of upload and store, 0 by default");
+    filter_args.remove = arg_str0("d", "delete", "<name>", "Remove a rule");
+    filter_args.test = arg_str0("t", "test", "<payload>", "Show how a payload would be routed");
+    filter_args.end = arg_end(12);
+
+    const esp_console_cmd_t filter_cmd = {
+        .command = "filter",
+        .help = "Show the mission rules with their hit counts, or edit them. The longest matching prefix wins, "
+                "then the rule added first; frames matching no rule are dropped",
+        .hint = NULL,
+        .func = &filter,
+        .argtable = &filter_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&filter_cmd) );
+
+    endpoint_args.index = arg_int0(NULL, NULL, "<index>", "Endpoint to set, 1 to 3");
+    endpoint_args.url = arg_str0(NULL, NULL, "<url>", "URL the frames are posted to");
+    endpoint_args.clear = arg_lit0("c", "clear", "Remove the URL, frames go to endpoint 0");
+    endpoint_args.end = arg_end(3);
+
+    const esp_console_cmd_t endpoint_cmd = {
+        .command = "endpoint",
+        .help = "Show the upload endpoints of the mission rules, or set one",
+        .hint = NULL,
+        .func = &endpoint,
+        .argtable = &endpoint_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&endpoint_cmd) );
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register the mission filter and endpoint commands
+void register_filter();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "lora.h"
+#include "rx_scheduler.h"
+#include "rx_stats.h"
+#include "dedup.h"
+#include "cmd_lora.h"
+
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} radio_args;
+
+static lora_dev_t *radios;
+static int radio_count;
+static const afc_t *radio_afcs[2]; // Radios outside the RX scheduler, by index
+
+static int radio(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &radio_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, radio_args.end, argv[0]);
+        return 1;
+    }
+
+    for (int i = 0; i < radio_count; i++) {
+        lora_dev_t *dev = &radios[i];
+        lora_irq_stats_t stats;
+        lora_rx_stats_t rx;
+        lora_get_irq_stats(dev, &stats);
+        lora_get_rx_stats(dev, &rx);
+        printf("Radio %d, %.3f MHz\n", i, dev->frequency / 1e6);
+        printf("RX wakeup: %s\n", lora_dio0_enabled(dev) ? "DIO0 interrupt" : "polling");
+        printf("SPI transactions: %"PRIu32"\n", lora_spi_transactions(dev));
+        printf("IRQ to read latency: count=%"PRIu32" last=%"PRId64"us avg=%"PRId64"us max=%"PRId64"us\n",
+               stats.count, stats.last_us, stats.count ? stats.total_us / stats.count : 0, stats.max_us);
+        printf("RX done: %"PRIu32" (%"PRIu32" CRC errors), dropped: %"PRIu32"\n", rx.received, rx.crc_errors, rx.dropped);
+        printf("FIFO wraps: %"PRIu32", gaps: %"PRIu32"\n", rx.fifo_wraps, rx.fifo_gaps);
+
+        if (radio_args.reset->count) {
+            lora_reset_irq_stats(dev);
+            lora_reset_rx_stats(dev);
+        }
+    }
+    if (radio_args.reset->count) {
+        ESP_LOGI(__func__, "Reset radio counters");
+    }
+    return 0;
+}
+
+static struct {
+    struct arg_str *add;
+    struct arg_int *freq;
+    struct arg_int *sf;
+    struct arg_int *bw;
+    struct arg_int *cr;
+    struct arg_int *sync;
+    struct arg_int *del;
+    struct arg_lit *reset;
+    struct arg_end *end;
+} rxsched_args;
+
+static int rxsched(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &rxsched_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, rxsched_args.end, argv[0]);
+        return 1;
+    }
+
+    if (rxsched_args.add->count) {
+        if (!rxsched_args.freq->count) {
+            printf("--freq is required with --add\n");
+            return 1;
+        }
+        rx_profile_t entry = {
+            .profile = {
+                .frequency = rxsched_args.freq->ival[0],
+                .spreading_factor = rxsched_args.sf->count ? rxsched_args.sf->ival[0] : 11,
+                .bandwidth = rxsched_args.bw->count ? rxsched_args.bw->ival[0] : 125000,
+                .coding_rate = rxsched_args.cr->count ? rxsched_args.cr->ival[0] : 8,
+                .sync_word = rxsched_args.sync->count ? rxsched_args.sync->ival[0] : 0x12,
+                .preamble_length = 8,
+                .crc = 1,
+                .ldro = LORA_LDRO_AUTO,
+            },
+        };
+        strlcpy(entry.name, rxsched_args.add->sval[0], sizeof(entry.name));
+        esp_err_t err = rx_scheduler_add(&entry);
+        if (err != ESP_OK) {
+            printf("Add failed: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+    }
+    if (rxsched_args.del->count) {
+        esp_err_t err = rx_scheduler_remove(rxsched_args.del->ival[0]);
+        if (err != ESP_OK) {
+            printf("Delete failed: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+    }
+
+    rx_profile_t entry;
+    rx_profile_stats_t stats;
+    int current = rx_scheduler_current();
+    printf("  # name             MHz      SF  BW kHz CR   sync  dwell s  CAD    hits   frames\n");
+    for (int i = 0; rx_scheduler_get(i, &entry, &stats); i++) {
+        const lora_profile_t *p = &entry.profile;
+        printf("%c%2d %-16s %8.4f %2d %7.1f 4/%d 0x%02X %8"PRIu64" %6"PRIu32" %6"PRIu32" %6"PRIu32"\n",
+               i == current ? '*' : ' ', i, entry.name, p->frequency / 1e6, p->spreading_factor,
+               p->bandwidth / 1e3, p->coding_rate, p->sync_word, stats.dwell_us / 1000000,
+               stats.cads, stats.detections, stats.frames);
+        if (stats.offset_hz) {
+            printf("    Doppler correction %+"PRId32" Hz\n", stats.offset_hz);
+        }
+        if (stats.cads) {
+            printf("    hit rate %.1f%%, frames per hit %.2f\n", 100.0 * stats.detections / stats.cads,
+                   stats.detections ? (double)stats.frames / stats.detections : 0.0);
+        }
+    }
+
+    if (rxsched_args.reset->count) {
+        ESP_LOGI(__func__, "Reset RX scheduler counters");
+        rx_scheduler_reset_stats();
+    }
+    return 0;
+}
+
+static struct {
+    struct arg_int *profile;
+    struct arg_int *runs;
+    struct arg_end *end;
+} cad_args;
+
+static int cad(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &cad_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, cad_args.end, argv[0]);
+        return 1;
+    }
+
+    int runs = cad_args.runs->count ? cad_args.runs->ival[0] : 20;
+    int first = cad_args.profile->count ? cad_args.profile->ival[0] : 0;
+    int last = cad_args.profile->count ? first : rx_scheduler_count() - 1;
+    if (runs < 1 || runs > 1000) {
+        printf("--runs must be 1 to 1000\n");
+        return 1;
+    }
+
+    printf("  # name             SF  BW kHz symbol us  runs  busy  min us  avg us  max us  symbols\n");
+    for (int i = first; i <= last; i++) {
+        rx_profile_t entry;
+        rx_profile_stats_t stats;
+        lora_cad_timing_t timing;
+        if (!rx_scheduler_get(i, &entry, &stats)) {
+            printf("No profile %d\n", i);
+            return 1;
+        }
+        // SF12 at 7.8 kHz takes about a second per detection
+        esp_err_t err = rx_scheduler_measure(i, runs, &timing, 2000 + runs * 4 * lora_symbol_us(&entry.profile) / 1000);
+        if (err != ESP_OK) {
+            printf("%3d %-16s measure failed: %s\n", i, entry.name, esp_err_to_name(err));
+            continue;
+        }
+        if (timing.runs == 0) {
+            printf("%3d %-16s no CadDone in %d runs\n", i, entry.name, runs);
+            continue;
+        }
+        printf("%3d %-16s %2d %7.1f %9"PRIu32" %5d %5d %7"PRIu32" %7"PRIu32" %7"PRIu32" %8.2f\n",
+               i, entry.name, timing.spreading_factor, timing.bandwidth / 1e3, timing.symbol_us,
+               timing.runs, timing.detected, timing.min_us, timing.avg_us, timing.max_us,
+               (double)timing.avg_us / timing.symbol_us);
+        if (timing.timeouts) {
+            printf("    %d runs without CadDone\n", timing.timeouts);
+        }
+    }
+    return 0;
+}
+
+static struct {
+    struct arg_lit *history;
+    struct arg_lit *reset;
+    struct arg_end *end;
+} afc_args;
+
+static void print_afc(const char *label, const afc_t *afc, bool history) {
+    printf("%-16s %+7"PRId32" %+7.0f %+7.0f %-8s %6"PRIu32" %6"PRIu32" %5"PRIu32" %5"PRIu32" %5"PRIu32"\n",
+           label, afc->correction, afc->filtered, afc->baseline, afc->tracking ? "tracking" : "locked",
+           afc->accepted, afc->rejected, afc->steps, afc->saturated, afc->holds);
+    afc_sample_t sample;
+    for (uint32_t i = 0; history && afc_history(afc, i, &sample); i++) {
+        printf("    %8.1f s ago  FEI %+6"PRId32"  residual %+6"PRId32"  correction %+6"PRId32"  SNR %5.1f\n",
+               (esp_timer_get_time() - sample.time_us) / 1e6, sample.fei_hz, sample.filtered_hz,
+               sample.correction_hz, sample.snr);
+    }
+}
+
+static int afc(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &afc_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, afc_args.end, argv[0]);
+        return 1;
+    }
+
+    bool history = afc_args.history->count;
+    afc_t state;
+    rx_profile_t entry;
+    rx_profile_stats_t stats;
+    printf("profile          correct residual baseline state  packets reject steps  sat  hold\n");
+    for (int i = 0; rx_scheduler_get_afc(i, &state) && rx_scheduler_get(i, &entry, &stats); i++) {
+        print_afc(entry.name, &state, history);
+    }
+    for (int i = 0; i < radio_count && i < 2; i++) {
+        if (radio_afcs[i] != NULL) {
+            char label[16];
+            snprintf(label, sizeof(label), "radio %d", i);
+            // Snapshot of another task's state, good enough for a printout
+            state = *radio_afcs[i];
+            print_afc(label, &state, history);
+        }
+    }
+
+    if (afc_args.reset->count) {
+        ESP_LOGI(__func__, "Reset RX scheduler AFC");
+        rx_scheduler_reset_afc();
+    }
+    return 0;
+}
+
+static struct {
+    struct arg_lit *save;
+    struct arg_end *end;
+} stats_args;
+
+static int stats(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &stats_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, stats_args.end, argv[0]);
+        return 1;
+    }
+
+    static rx_stats_t rx[RX_STATS_RADIOS]; // Too large for the console stack
+    int count = radio_count < RX_STATS_RADIOS ? radio_count : RX_STATS_RADIOS;
+    for (int i = 0; i < count; i++) {
+        rx_stats_get(i, &rx[i]);
+    }
+    printf("%-16s", "");
+    for (int i = 0; i < count; i++) {
+        printf("   radio %d  lifetime", i);
+    }
+    printf("\n");
+    for (int c = 0; c < RX_STATS_COUNTERS; c++) {
+        printf("%-16s", rx_stats_counter_name(c));
+        for (int i = 0; i < count; i++) {
+            printf(" %9"PRIu32" %9"PRIu32, rx[i].session[c], rx[i].lifetime[c]);
+        }
+        printf("\n");
+    }
+    for (int i = 0; i < count; i++) {
+        if (rx[i].session[RX_STATS_FRAMES] == 0) {
+            continue;
+        }
+        printf("radio %d: RSSI p10/p50/p90 %.0f/%.0f/%.0f dBm (%.0f..%.0f), SNR %.1f/%.1f/%.1f dB (%.1f..%.1f)\n", i,
+               rx[i].rssi[0], rx[i].rssi[1], rx[i].rssi[2], rx[i].rssi_min, rx[i].rssi_max,
+               rx[i].snr[0], rx[i].snr[1], rx[i].snr[2], rx[i].snr_min, rx[i].snr_max);
+        printf("         %"PRIu32" frames last minute, %.2f/min over the last hour, peak %"PRIu32"/min\n",
+               rx[i].last_minute, rx[i].hour_rate, rx[i].peak_minute);
+    }
+
+    if (stats_args.save->count) {
+        esp_err_t err = rx_stats_flush();
+        if (err != ESP_OK) {
+            printf("NVS write failed: %s\n", esp_err_to_name(err));
+        }
+    }
+    dedup_stats_t dedup;
+    dedup_get(&dedup);
+    printf("dedup: %"PRIu32" of %"PRIu32" frames were duplicates within %"PRIu32" s, %"PRIu32" journaled ones not replayed, "
+           "%"PRIu32" evictions, %"PRIu32" collisions\n", dedup.duplicates, dedup.frames, dedup_window_s(),
+           dedup.replay_duplicates, dedup.evictions, dedup.collisions);
+    rx_stats_persist_t persist;
+    rx_stats_get_persist(&persist);
+    printf("boot %"PRIu32", %"PRIu32" checkpoints, restored from %s, ", persist.boots, persist.sequence,
+           persist.restored_from_rtc ? "RTC memory" : persist.boots > 1 ? "NVS" : "nothing");
+    if (persist.nvs_age_ms < 0) {
+        printf("not written to NVS this boot\n");
+    } else {
+        printf("%"PRIu32" NVS writes, last %"PRId64" s ago\n", persist.nvs_writes, persist.nvs_age_ms / 1000);
+    }
+    return 0;
+}
+
+void register_lora_afc(int radio, const afc_t *afc) {
+    if (radio >= 0 && radio < 2) {
+        radio_afcs[radio] = afc;
+    }
+}
+
+void register_lora(lora_dev_t *devs, int count) {
+    radios = devs;
+    radio_count = count;
+
+    radio_args.reset = arg_lit0("r", "reset", "Reset counters after printing");
+    radio_args.end = arg_end(2);
+
+    const esp_console_cmd_t radio_cmd = {
+        .command = "radio",
+        .help = "Show LoRa radio counters",
+        .hint = NULL,
+        .func = &radio,
+        .argtable = &radio_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&radio_cmd) );
+
+    rxsched_args.add = arg_str0("a", "add", "<name>", "Add a profile");
+    rxsched_args.freq = arg_int0("f", "freq", "<hz>", "Frequency of the added profile");
+    rxsched_args.sf = arg_int0("s", "sf", "<6-12>", "Spreading factor, default 11");
+    rxsched_args.bw = arg_int0("b", "bw", "<hz>", "Bandwidth, default 125000");
+    rxsched_args.cr = arg_int0("c", "cr", "<5-8>", "Coding rate 4/x, default 8");
+    rxsched_args.sync = arg_int0("w", "sync", "<byte>", "Sync word, default 0x12");
+    rxsched_args.del = arg_int0("d", "delete", "<index>", "Delete a profile");
+    rxsched_args.reset = arg_lit0("r", "reset", "Reset counters after printing");
+    rxsched_args.end = arg_end(8);
+
+    const esp_console_cmd_t rxsched_cmd = {
+        .command = "rxsched",
+        .help = "List, add or delete the RX scheduler profiles, with dwell time and CAD hit rate",
+        .hint = NULL,
+        .func = &rxsched,
+        .argtable = &rxsched_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&rxsched_cmd) );
+
+    cad_args.profile = arg_int0("p", "profile", "<index>", "Measure this scheduler profile only");
+    cad_args.runs = arg_int0("n", "runs", "<count>", "Detections per profile, default 20");
+    cad_args.end = arg_end(3);
+
+    const esp_console_cmd_t cad_cmd = {
+        .command = "cad",
+        .help = "Measure channel activity detection time for the RX scheduler profiles",
+        .hint = NULL,
+        .func = &cad,
+        .argtable = &cad_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cad_cmd) );
+
+    afc_args.history = arg_lit0("l", "history", "List the last measurements");
+    afc_args.reset = arg_lit0("r", "reset", "Drop the RX scheduler corrections after printing");
+    afc_args.end = arg_end(3);
+
+    const esp_console_cmd_t afc_cmd = {
+        .command = "afc",
+        .help = "Show the automatic frequency correction from the packet FEI",
+        .hint = NULL,
+        .func = &afc,
+        .argtable = &afc_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&afc_cmd) );
+
+    stats_args.save = arg_lit0("s", "save", "Write the lifetime totals to NVS now");
+    stats_args.end = arg_end(2);
+
+    const esp_console_cmd_t stats_cmd = {
+        .command = "stats",
+        .help = "Show RX and upload counters per radio, since boot and lifetime, with RSSI and SNR quantiles",
+        .hint = NULL,
+        .func = &stats,
+        .argtable = &stats_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&stats_cmd) );
+}
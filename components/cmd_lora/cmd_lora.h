@@ -0,0 +1,18 @@
+#pragma once
+
+#include "lora.h"
+#include "afc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register LoRa radio commands for count radios
+void register_lora(lora_dev_t *devs, int count);
+
+// Show the AFC of a radio outside the RX scheduler in the afc command
+void register_lora_afc(int radio, const afc_t *afc);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "sat_tracker.h"
+#include "pass_predictor.h"
+#include "cmd_tracker.h"
+
+static const char *tle_url;
+
+static struct {
+    struct arg_str *name;
+    struct arg_str *line1;
+    struct arg_str *line2;
+    struct arg_int *remove;
+    struct arg_lit *update;
+    struct arg_end *end;
+} tle_args;
+
+static struct {
+    struct arg_lit *refresh;
+    struct arg_int *gap;
+    struct arg_end *end;
+} passes_args;
+
+static void print_utc(const char *fmt, double t, char *out, size_t size) {
+    time_t seconds = (time_t)t;
+    struct tm tm;
+    strftime(out, size, fmt, gmtime_r(&seconds, &tm));
+}
+
+static int tle(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &tle_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, tle_args.end, argv[0]);
+        return 1;
+    }
+
+    if (tle_args.line1->count || tle_args.line2->count) {
+        if (!tle_args.line1->count || !tle_args.line2->count) {
+            printf("Both --line1 and --line2 are required\n");
+            return 1;
+        }
+        char text[SAT_TRACKER_TLE_MAX];
+        snprintf(text, sizeof(text), "%s\n%s\n%s\n", tle_args.name->count ? tle_args.name->sval[0] : "",
+                 tle_args.line1->sval[0], tle_args.line2->sval[0]);
+        esp_err_t err = sat_tracker_add_tle(text);
+        if (err != ESP_OK) {
+            printf("Element set rejected: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+    }
+    if (tle_args.remove->count) {
+        esp_err_t err = sat_tracker_remove(tle_args.remove->ival[0]);
+        if (err != ESP_OK) {
+            printf("No element set %d\n", tle_args.remove->ival[0]);
+            return 1;
+        }
+    }
+    if (tle_args.update->count) {
+        if (tle_url == NULL || tle_url[0] == '\0') {
+            printf("No element set URL configured\n");
+            return 1;
+        }
+        esp_err_t err = sat_tracker_refresh(tle_url);
+        if (err != ESP_OK) {
+            printf("Update failed: %s\n", esp_err_to_name(err));
+            return 1;
+        }
+    }
+
+    if (sat_tracker_count() == 0) {
+        printf("No element set, Doppler correction is off\n");
+        return 0;
+    }
+    bool time_valid = sat_tracker_time_valid();
+    sgp4_tle_t elements;
+    for (int i = 0; sat_tracker_get_tle(i, &elements); i++) {
+        char when[32];
+        print_utc("%Y-%m-%d %H:%M:%S", elements.epoch, when, sizeof(when));
+        printf("%d: %s (%05"PRIu32"), epoch %s UTC%s\n", i, elements.name, elements.catalog, when,
+               i == 0 ? ", Doppler target" : "");
+        printf("   inc %.4f raan %.4f ecc %.7f argp %.4f M %.4f n %.8f rev/day bstar %.4e\n",
+               elements.inclination, elements.raan, elements.eccentricity, elements.arg_perigee,
+               elements.mean_anomaly, elements.mean_motion, elements.bstar);
+        if (!time_valid) {
+            continue;
+        }
+        sat_tracker_state_t state;
+        if (!sat_tracker_update(i, sat_tracker_now(), &state)) {
+            printf("   Propagation failed, the element set is %.1f days old\n", state.tle_age_days);
+            continue;
+        }
+        printf("   age %.1f days, az %.1f el %.1f range %.0f km, range rate %+.3f km/s\n",
+               state.tle_age_days, state.look.azimuth, state.look.elevation, state.look.range, state.look.range_rate);
+        if (i == 0) {
+            printf("   Doppler %+ld Hz, computed in %"PRIu32" us\n", state.doppler_hz, state.compute_us);
+        }
+    }
+    if (!time_valid) {
+        printf("Clock not set by SNTP yet\n");
+    }
+    return 0;
+}
+
+static int passes(int argc, char **argv) {
+    int nerrors = arg_parse(argc, argv, (void **) &passes_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, passes_args.end, argv[0]);
+        return 1;
+    }
+    if (!sat_tracker_time_valid()) {
+        printf("Clock not set by SNTP yet\n");
+        return 1;
+    }
+
+    double now = sat_tracker_now();
+    if (passes_args.refresh->count) {
+        pass_predictor_update(now, true);
+    }
+    static pass_t list[PASS_PREDICTOR_MAX]; // Too large for the console stack
+    pass_predictor_info_t info;
+    int count = pass_predictor_get(list, PASS_PREDICTOR_MAX, &info);
+    if (info.end == 0) {
+        printf("No prediction yet\n");
+        return 0;
+    }
+    char when[32];
+    print_utc("%Y-%m-%d %H:%M", info.start, when, sizeof(when));
+    printf("%d passes from %s UTC over %.0f h, %"PRIu32" propagations in %"PRIu32" ms%s\n",
+           info.count, when, (info.end - info.start) / 3600, info.evaluations, info.compute_ms,
+           info.generation != sat_tracker_generation() ? ", element sets changed since" : "");
+    printf("  #  satellite                AOS UTC      dur  max el  az AOS>LOS  starts\n");
+    for (int i = 0; i < count; i++) {
+        const pass_t *p = &list[i];
+        if (p->los < now) {
+            continue;
+        }
+        char aos[16];
+        char starts[16] = "now";
+        print_utc("%m-%d %H:%M:%S", p->aos, aos, sizeof(aos));
+        if (p->aos > now) {
+            snprintf(starts, sizeof(starts), "in %.0f min", (p->aos - now) / 60);
+        }
+        printf("%3d  %-24s %s %4.1fm %6.1f   %3.0f > %3.0f  %s\n", i, p->name[0] ? p->name : "-", aos,
+               (p->los - p->aos) / 60, p->max_elevation, p->aos_azimuth, p->los_azimuth, starts);
+    }
+
+    uint32_t gap = passes_args.gap->count ? passes_args.gap->ival[0] : 0;
+    double at = pass_next_gap(now, gap);
+    if (at > now) {
+        print_utc("%H:%M:%S", at, when, sizeof(when));
+        printf("%s %s UTC, in %.0f min\n", gap > 0 ? "Next gap starts" : "Pass with guard until", when, (at - now) / 60);
+    } else {
+        printf("%s\n", gap > 0 ? "Gap starts now" : "No pass under way");
+    }
+    return 0;
+}
+
+void register_tracker(const char *url) {
+    tle_url = url;
+
+    tle_args.name = arg_str0("n", "name", "<name>", "Satellite name, line 0");
+    tle_args.line1 = arg_str0("1", "line1", "<line>", "First element line, quoted");
+    tle_args.line2 = arg_str0("2", "line2", "<line>", "Second element line, quoted");
+    tle_args.remove = arg_int0("d", "delete", "<index>", "Remove an element set from the list");
+    tle_args.update = arg_lit0("u", "update", "Replace the list with the element sets from the API");
+    tle_args.end = arg_end(6);
+
+    const esp_console_cmd_t tle_cmd = {
+        .command = "tle",
+        .help = "Show the tracked element sets with their look angles, or add one (replacing the same satellite). "
+                "The first one is used for Doppler correction",
+        .hint = NULL,
+        .func = &tle,
+        .argtable = &tle_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&tle_cmd) );
+
+    passes_args.refresh = arg_lit0("r", "refresh", "Predict again now");
+    passes_args.gap = arg_int0("g", "gap", "<s>", "Show when this many seconds are free of passes");
+    passes_args.end = arg_end(2);
+
+    const esp_console_cmd_t passes_cmd = {
+        .command = "passes",
+        .help = "Predicted passes of the tracked satellites. OTA, journal replay and compaction wait for the gaps",
+        .hint = NULL,
+        .func = &passes,
+        .argtable = &passes_args
+    };
+
+    ESP_ERROR_CHECK( esp_console_cmd_register(&passes_cmd) );
+}
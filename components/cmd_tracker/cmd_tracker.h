@@ -0,0 +1,12 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register the element set and pass commands, tle_url is fetched by tle --update
+void register_tracker(const char *tle_url);
+
+#ifdef __cplusplus
+}
+#endif
@@ -231,6 +231,14 @@ static int connect(int argc, char **argv)
     return 0;
 }
 
+bool wifi_is_connected(void)
+{
+    if (wifi_event_group == NULL) {
+        return false;
+    }
+    return (xEventGroupGetBits(wifi_event_group) & CONNECTED_BIT) != 0;
+}
+
 static bool network_status()
 {
     int bits = xEventGroupGetBits(wifi_event_group);
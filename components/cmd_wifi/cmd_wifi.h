@@ -13,6 +13,8 @@
 */
 #pragma once
 
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,6 +22,7 @@ extern "C" {
 // Register WiFi functions
 void register_wifi(void);
 void initialize_wifi(void);
+bool wifi_is_connected(void);
 
 #ifdef __cplusplus
 }
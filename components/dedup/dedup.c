@@ -0,0 +1,159 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_timer.h"
+#include "dedup.h"
+
+#define DEDUP_BITS 8 // log2(DEDUP_SLOTS)
+
+_Static_assert(DEDUP_SLOTS == 1 << DEDUP_BITS, "DEDUP_BITS must match DEDUP_SLOTS");
+
+static dedup_entry_t slots[DEDUP_SLOTS];
+static int64_t window_us;
+
+// Written by the upload task, read by the console
+static _Atomic uint32_t frames;
+static _Atomic uint32_t duplicates;
+static _Atomic uint32_t evictions;
+static _Atomic uint32_t collisions;
+static _Atomic uint32_t replay_duplicates;
+
+void dedup_init(uint32_t window_s) {
+    memset(slots, 0, sizeof(slots));
+    window_us = window_s * 1000000LL;
+    atomic_store(&frames, 0);
+    atomic_store(&duplicates, 0);
+    atomic_store(&evictions, 0);
+    atomic_store(&collisions, 0);
+    atomic_store(&replay_duplicates, 0);
+}
+
+// FNV-1a with a final mix, 0 is kept for free slots
+uint64_t dedup_hash(const uint8_t *payload, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= payload[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+static bool dedup_expired(const dedup_entry_t *e, int64_t now) {
+    return e->hash == 0 || now - e->last_us >= window_us;
+}
+
+// Entry of the payload with hash, or the slot a new one goes to: the first
+// expired one of the probe sequence, else the least recently seen
+static dedup_entry_t *dedup_probe(uint64_t hash, const packet_t *pkt, int64_t now, bool *found) {
+    // Top bits of a Fibonacci multiply, the low bits of the hash already went into the mix
+    uint32_t start = (hash * 0x9e3779b97f4a7c15ULL) >> (64 - DEDUP_BITS);
+    dedup_entry_t *free_slot = NULL;
+    dedup_entry_t *oldest = NULL;
+
+    *found = false;
+    // Expired entries are reused but not emptied, so the whole sequence is
+    // probed: a live copy can sit past them
+    for (int i = 0; i < DEDUP_PROBES; i++) {
+        dedup_entry_t *e = &slots[(start + i) & (DEDUP_SLOTS - 1)];
+        if (dedup_expired(e, now)) {
+            if (free_slot == NULL) {
+                free_slot = e;
+            }
+            if (e->hash == 0) {
+                break; // Never used, nothing was inserted further
+            }
+            continue;
+        }
+        if (e->hash == hash) {
+            if (e->len == pkt->len) {
+                *found = true;
+                return e;
+            }
+            atomic_fetch_add_explicit(&collisions, 1, memory_order_relaxed);
+        }
+        if (oldest == NULL || e->last_us < oldest->last_us) {
+            oldest = e;
+        }
+    }
+    return free_slot != NULL ? free_slot : oldest;
+}
+
+static void dedup_insert(dedup_entry_t *e, uint64_t hash, const packet_t *pkt, int64_t now) {
+    if (!dedup_expired(e, now)) {
+        atomic_fetch_add_explicit(&evictions, 1, memory_order_relaxed);
+    }
+    *e = (dedup_entry_t){
+        .hash = hash,
+        .first_us = now,
+        .last_us = now,
+        .len = pkt->len,
+        .rssi = pkt->rssi,
+        .snr = pkt->snr,
+        .radio = pkt->radio,
+        .copies = 1,
+    };
+}
+
+// The window runs on this boot's clock. pkt->timestamp is the RX time in the
+// boot that received the frame, a journaled one can be ahead of it.
+bool dedup_frame(const packet_t *pkt, dedup_entry_t *entry) {
+    uint64_t hash = dedup_hash(pkt->payload, pkt->len);
+    int64_t now = esp_timer_get_time();
+    bool found;
+    dedup_entry_t *e = dedup_probe(hash, pkt, now, &found);
+
+    atomic_fetch_add_explicit(&frames, 1, memory_order_relaxed);
+    if (found) {
+        e->last_us = now;
+        e->copies++;
+        if (pkt->rssi > e->rssi) {
+            e->rssi = pkt->rssi;
+            e->snr = pkt->snr;
+            e->radio = pkt->radio;
+        }
+        atomic_fetch_add_explicit(&duplicates, 1, memory_order_relaxed);
+    } else {
+        dedup_insert(e, hash, pkt, now);
+    }
+    if (entry != NULL) {
+        *entry = *e;
+    }
+    return found;
+}
+
+void dedup_delivered(const packet_t *pkt) {
+    uint64_t hash = dedup_hash(pkt->payload, pkt->len);
+    int64_t now = esp_timer_get_time();
+    bool found;
+    dedup_entry_t *e = dedup_probe(hash, pkt, now, &found);
+
+    if (!found) {
+        dedup_insert(e, hash, pkt, now);
+    }
+    e->delivered = true;
+}
+
+bool dedup_replayed(const packet_t *pkt) {
+    bool found;
+    dedup_entry_t *e = dedup_probe(dedup_hash(pkt->payload, pkt->len), pkt, esp_timer_get_time(), &found);
+
+    if (!found || !e->delivered) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&replay_duplicates, 1, memory_order_relaxed);
+    return true;
+}
+
+void dedup_get(dedup_stats_t *stats) {
+    stats->frames = atomic_load_explicit(&frames, memory_order_relaxed);
+    stats->duplicates = atomic_load_explicit(&duplicates, memory_order_relaxed);
+    stats->evictions = atomic_load_explicit(&evictions, memory_order_relaxed);
+    stats->collisions = atomic_load_explicit(&collisions, memory_order_relaxed);
+    stats->replay_duplicates = atomic_load_explicit(&replay_duplicates, memory_order_relaxed);
+}
+
+uint32_t dedup_window_s() {
+    return window_us / 1000000;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "packet_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEDUP_SLOTS 256 // Power of two, 8 KB of entries
+#define DEDUP_PROBES 8  // Longest probe sequence, bounds the work per frame
+
+typedef struct {
+    uint32_t frames;     // Checked
+    uint32_t duplicates; // Seen before within the window, not uploaded again
+    uint32_t evictions;  // Live entries replaced because their probe sequence was full
+    uint32_t collisions; // Same hash with a different length, kept apart
+    uint32_t replay_duplicates; // Journaled frames not replayed, a copy was already delivered
+} dedup_stats_t;
+
+// Best copy of one payload seen within the window
+typedef struct {
+    uint64_t hash;     // 0 for a free slot
+    int64_t first_us;  // esp_timer_get_time() when the first copy was checked
+    int64_t last_us;   // Same for the latest copy, the entry expires a window after it
+    uint16_t len;
+    int16_t rssi;      // Best copy, dBm
+    float snr;         // dB
+    uint8_t radio;
+    bool delivered;    // A copy reached the server
+    uint16_t copies;
+} dedup_entry_t;
+
+// Frames repeating a payload seen less than window_s ago are duplicates
+void dedup_init(uint32_t window_s);
+
+// True if pkt repeats a payload still in the window. Its metadata is merged
+// into the entry of the first copy, which is refreshed. Constant time, only
+// called by the upload task.
+bool dedup_frame(const packet_t *pkt, dedup_entry_t *entry);
+
+// A copy of pkt reached the server, live or replayed
+void dedup_delivered(const packet_t *pkt);
+
+// True if a journaled frame need not be replayed: a copy of it still in the
+// window was already delivered
+bool dedup_replayed(const packet_t *pkt);
+
+uint64_t dedup_hash(const uint8_t *payload, size_t len);
+
+void dedup_get(dedup_stats_t *stats);
+uint32_t dedup_window_s();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,319 @@
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_crc.h"
+#include "journal.h"
+
+// The partition is a circular log of fixed 512-byte slots, 8 per 4 KB sector.
+// Records are written at the head and replayed from the tail; a sector is
+// erased just before the head enters it, so wear is spread over the whole
+// partition. A replayed record is marked by clearing its state word, which
+// NOR flash allows without an erase.
+
+#define JOURNAL_MAGIC 0xA5
+#define JOURNAL_STATE_PENDING 0xFFFFFFFF
+#define JOURNAL_STATE_CONSUMED 0x00000000
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_SLOTS_PER_SECTOR (JOURNAL_SECTOR_SIZE / JOURNAL_SLOT_SIZE)
+
+typedef struct {
+    uint8_t magic;
+    uint8_t tag;
+    uint16_t len;
+    uint32_t seq;
+    uint32_t crc;   // Over magic, tag, len, seq and the record
+    uint32_t state; // Cleared once the record is replayed
+} journal_header_t;
+
+_Static_assert(sizeof(journal_header_t) == JOURNAL_SLOT_SIZE - JOURNAL_RECORD_MAX, "journal header size");
+
+static const char *TAG = "JOURNAL";
+
+static const esp_partition_t *partition;
+static uint32_t slots;
+static uint32_t sectors;
+static uint32_t head;    // Next slot to write
+static uint32_t tail;    // Oldest slot not replayed yet
+static uint32_t pending; // Slots in [tail, head)
+static uint32_t next_seq;
+static int32_t ready_sector = -1; // Erased in advance by journal_maintain()
+static journal_stats_t stats;
+static uint8_t slot_buf[JOURNAL_SLOT_SIZE] __attribute__((aligned(4)));
+
+static uint32_t journal_crc(const journal_header_t *header, const uint8_t *data) {
+    uint32_t crc = esp_crc32_le(0, (const uint8_t *)header, offsetof(journal_header_t, crc));
+    return esp_crc32_le(crc, data, header->len);
+}
+
+static bool journal_sector_has_pending(uint32_t sector) {
+    if (pending == 0) {
+        return false;
+    }
+    uint32_t first = sector * JOURNAL_SLOTS_PER_SECTOR;
+    uint32_t distance = (first + slots - tail) % slots;
+    // Sector starts inside the pending range, or the tail sits inside the sector
+    return distance < pending || distance > slots - JOURNAL_SLOTS_PER_SECTOR;
+}
+
+static esp_err_t journal_erase_sector(uint32_t sector) {
+    // Journal full: the oldest records live here and are lost
+    while (pending > 0 && tail / JOURNAL_SLOTS_PER_SECTOR == sector) {
+        tail = (tail + 1) % slots;
+        pending--;
+        stats.dropped++;
+    }
+    esp_err_t err = esp_partition_erase_range(partition, sector * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Erase sector %"PRIu32" failed: %s", sector, esp_err_to_name(err));
+        return err;
+    }
+    stats.erases++;
+    return ESP_OK;
+}
+
+// Read a whole slot into slot_buf, valid if it holds a record with a matching CRC
+static esp_err_t journal_read_slot(uint32_t slot, bool *valid) {
+    esp_err_t err = esp_partition_read(partition, slot * JOURNAL_SLOT_SIZE, slot_buf, JOURNAL_SLOT_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const journal_header_t *header = (const journal_header_t *)slot_buf;
+    *valid = header->magic == JOURNAL_MAGIC && header->len <= JOURNAL_RECORD_MAX &&
+             header->crc == journal_crc(header, slot_buf + sizeof(journal_header_t));
+    return ESP_OK;
+}
+
+static bool journal_slot_blank(uint32_t slot) {
+    journal_header_t header;
+    if (esp_partition_read(partition, slot * JOURNAL_SLOT_SIZE, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    const uint8_t *bytes = (const uint8_t *)&header;
+    for (int i = 0; i < sizeof(header); i++) {
+        if (bytes[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+esp_err_t journal_init() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "Partition '%s' not found", JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    sectors = partition->size / JOURNAL_SECTOR_SIZE;
+    slots = sectors * JOURNAL_SLOTS_PER_SECTOR;
+    memset(&stats, 0, sizeof(stats));
+    stats.capacity = slots;
+
+    // Recover head from the newest record and tail from the oldest pending one.
+    // Anything without a valid magic is either erased or torn by a power loss.
+    // A header torn after its magic still has the unwritten bytes of seq at
+    // 0xFF, so each candidate is checked against its CRC and a torn one is
+    // invalidated before scanning again. Sequence numbers compare modulo 2^32.
+    bool found;
+    bool found_pending;
+    uint32_t max_seq;
+    uint32_t max_slot;
+    uint32_t min_slot;
+    for (;;) {
+        found = false;
+        found_pending = false;
+        max_seq = 0;
+        uint32_t min_seq = 0;
+        max_slot = 0;
+        min_slot = 0;
+        journal_header_t header;
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            esp_err_t err = esp_partition_read(partition, slot * JOURNAL_SLOT_SIZE, &header, sizeof(header));
+            if (err != ESP_OK) {
+                return err;
+            }
+            if (header.magic != JOURNAL_MAGIC || header.len > JOURNAL_RECORD_MAX) {
+                continue;
+            }
+            if (!found || (int32_t)(header.seq - max_seq) > 0) {
+                max_seq = header.seq;
+                max_slot = slot;
+                found = true;
+            }
+            if (header.state == JOURNAL_STATE_PENDING && (!found_pending || (int32_t)(header.seq - min_seq) < 0)) {
+                min_seq = header.seq;
+                min_slot = slot;
+                found_pending = true;
+            }
+        }
+
+        uint32_t torn = UINT32_MAX;
+        bool valid;
+        if (found) {
+            esp_err_t err = journal_read_slot(max_slot, &valid);
+            if (err != ESP_OK) {
+                return err;
+            }
+            if (!valid) {
+                torn = max_slot;
+            }
+        }
+        if (torn == UINT32_MAX && found_pending) {
+            esp_err_t err = journal_read_slot(min_slot, &valid);
+            if (err != ESP_OK) {
+                return err;
+            }
+            if (!valid) {
+                torn = min_slot;
+            }
+        }
+        if (torn == UINT32_MAX) {
+            break;
+        }
+        // Clearing the magic keeps the slot dirty, so it is still never reused
+        ESP_LOGW(TAG, "Invalidate torn slot %"PRIu32, torn);
+        uint32_t cleared = 0;
+        esp_err_t err = esp_partition_write(partition, torn * JOURNAL_SLOT_SIZE, &cleared, sizeof(cleared));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (!found) {
+        head = 0;
+        next_seq = 1;
+    } else {
+        next_seq = max_seq + 1;
+        head = (max_slot + 1) % slots;
+        // A write interrupted by a power loss leaves a dirty slot behind the newest
+        // record; it can not be programmed again, so start on the next sector
+        if (head % JOURNAL_SLOTS_PER_SECTOR != 0 && !journal_slot_blank(head)) {
+            ESP_LOGW(TAG, "Torn slot %"PRIu32" after power loss, skipping to next sector", head);
+            head = ((head / JOURNAL_SLOTS_PER_SECTOR + 1) % sectors) * JOURNAL_SLOTS_PER_SECTOR;
+        }
+    }
+    tail = found_pending ? min_slot : head;
+    pending = (head + slots - tail) % slots;
+    ready_sector = -1;
+    stats.pending = pending;
+
+    ESP_LOGI(TAG, "Mounted %"PRIu32" slots, head %"PRIu32", tail %"PRIu32", %"PRIu32" pending",
+             slots, head, tail, pending);
+    return ESP_OK;
+}
+
+esp_err_t journal_append(uint8_t tag, const void *data, size_t len) {
+    if (partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > JOURNAL_RECORD_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (head % JOURNAL_SLOTS_PER_SECTOR == 0) {
+        uint32_t sector = head / JOURNAL_SLOTS_PER_SECTOR;
+        if ((int32_t)sector != ready_sector) {
+            esp_err_t err = journal_erase_sector(sector);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        ready_sector = -1;
+    }
+
+    journal_header_t *header = (journal_header_t *)slot_buf;
+    header->magic = JOURNAL_MAGIC;
+    header->tag = tag;
+    header->len = len;
+    header->seq = next_seq;
+    memcpy(slot_buf + sizeof(journal_header_t), data, len);
+    header->crc = journal_crc(header, slot_buf + sizeof(journal_header_t));
+    header->state = JOURNAL_STATE_PENDING;
+
+    size_t write_len = (sizeof(journal_header_t) + len + 3) & ~3;
+    esp_err_t err = esp_partition_write(partition, head * JOURNAL_SLOT_SIZE, slot_buf, write_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Write slot %"PRIu32" failed: %s", head, esp_err_to_name(err));
+        // Slot may be half programmed, never reuse it
+        head = (head + 1) % slots;
+        pending++;
+        return err;
+    }
+    head = (head + 1) % slots;
+    next_seq++;
+    pending++;
+    stats.appended++;
+    return ESP_OK;
+}
+
+esp_err_t journal_peek(uint8_t *tag, void *data, size_t *len) {
+    if (partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    journal_header_t *header = (journal_header_t *)slot_buf;
+    while (pending > 0) {
+        bool valid;
+        esp_err_t err = journal_read_slot(tail, &valid);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (valid && header->state == JOURNAL_STATE_PENDING) {
+            if (header->len > *len) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            memcpy(data, slot_buf + sizeof(journal_header_t), header->len);
+            *len = header->len;
+            *tag = header->tag;
+            return ESP_OK;
+        }
+        if (!valid && header->magic == JOURNAL_MAGIC) {
+            ESP_LOGW(TAG, "Skip corrupted slot %"PRIu32, tail);
+            stats.corrupted++;
+        }
+        tail = (tail + 1) % slots;
+        pending--;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t journal_consume() {
+    if (partition == NULL || pending == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t consumed = JOURNAL_STATE_CONSUMED;
+    esp_err_t err = esp_partition_write(partition, tail * JOURNAL_SLOT_SIZE + offsetof(journal_header_t, state),
+                                        &consumed, sizeof(consumed));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Mark slot %"PRIu32" failed: %s", tail, esp_err_to_name(err));
+        return err;
+    }
+    tail = (tail + 1) % slots;
+    pending--;
+    stats.consumed++;
+    return ESP_OK;
+}
+
+void journal_maintain() {
+    if (partition == NULL || ready_sector >= 0) {
+        return;
+    }
+    // The head's own sector if it sits on a boundary, otherwise the one after it
+    uint32_t sector = head / JOURNAL_SLOTS_PER_SECTOR;
+    if (head % JOURNAL_SLOTS_PER_SECTOR != 0) {
+        sector = (sector + 1) % sectors;
+    }
+    if (journal_sector_has_pending(sector)) {
+        // Journal is full, leave the overwrite decision to the next append
+        return;
+    }
+    if (journal_erase_sector(sector) == ESP_OK) {
+        ready_sector = sector;
+    }
+}
+
+uint32_t journal_pending() {
+    return pending;
+}
+
+void journal_get_stats(journal_stats_t *out) {
+    *out = stats;
+    out->pending = pending;
+}
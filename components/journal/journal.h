@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOURNAL_PARTITION_LABEL "journal"
+#define JOURNAL_SLOT_SIZE 512 // Two flash pages per record
+#define JOURNAL_RECORD_MAX (JOURNAL_SLOT_SIZE - 16) // Minus the slot header
+
+typedef struct {
+    uint32_t capacity;  // Slots in the partition
+    uint32_t pending;   // Records waiting to be replayed
+    uint32_t appended;  // Since boot
+    uint32_t consumed;  // Since boot
+    uint32_t dropped;   // Oldest records overwritten because the journal was full
+    uint32_t corrupted; // Records skipped on a CRC mismatch
+    uint32_t erases;    // Sector erases since boot
+} journal_stats_t;
+
+// Mount the journal partition and recover head/tail after a reset or power loss
+esp_err_t journal_init();
+
+// Append one record at the head. Cost is a single page-aligned slot write,
+// plus a sector erase only if journal_maintain() has not prepared the next sector.
+esp_err_t journal_append(uint8_t tag, const void *data, size_t len);
+
+// Copy the oldest pending record, ESP_ERR_NOT_FOUND if the journal is empty
+esp_err_t journal_peek(uint8_t *tag, void *data, size_t *len);
+
+// Mark the record returned by journal_peek() as delivered
+esp_err_t journal_consume();
+
+// Erase the sector ahead of the head outside the append path
+void journal_maintain();
+
+uint32_t journal_pending();
+void journal_get_stats(journal_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,241 @@
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "json_writer.h"
+
+// Escape class of every byte: 0 copies it as is, 'u' writes \u00XX, '8'
+// starts a UTF-8 sequence copied as is when valid, anything else is the
+// character that follows the backslash.
+static const uint8_t escape_table[256] = {
+    ['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't',
+    ['"'] = '"', ['\\'] = '\\',
+    [0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    [0x0B] = 'u', [0x0E] = 'u', [0x0F] = 'u',
+    [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u', [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u',
+    [0x18] = 'u', [0x19] = 'u', [0x1A] = 'u', [0x1B] = 'u', [0x1C] = 'u', [0x1D] = 'u', [0x1E] = 'u', [0x1F] = 'u',
+    [0x7F] = 'u',
+    [0x80 ... 0xFF] = '8',
+};
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+static const char base64_digits[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Length of the valid UTF-8 sequence at data[0], 0 if it is not one
+// (stray continuation, overlong form, surrogate, beyond U+10FFFF or cut short)
+static size_t utf8_sequence(const uint8_t *data, size_t len) {
+    uint8_t c = data[0];
+    uint8_t lo = 0x80, hi = 0xBF;
+    size_t n;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        return 0;
+    }
+    if (len < n || data[1] < lo || data[1] > hi) {
+        return 0;
+    }
+    for (size_t i = 2; i < n; i++) {
+        if ((data[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+// Reserve n bytes plus the NUL terminator, NULL once the buffer is full
+static char *json_reserve(json_writer_t *w, size_t n) {
+    if (w->overflow || w->len + n + 1 > w->size) {
+        w->overflow = true;
+        return NULL;
+    }
+    char *out = w->buf + w->len;
+    w->len += n;
+    return out;
+}
+
+static void json_put(json_writer_t *w, const char *data, size_t n) {
+    char *out = json_reserve(w, n);
+    if (out != NULL) {
+        memcpy(out, data, n);
+    }
+}
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size) {
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->comma = false;
+    w->overflow = size == 0;
+}
+
+int json_writer_finish(json_writer_t *w) {
+    if (w->overflow) {
+        if (w->size > 0) {
+            w->buf[0] = '\0';
+        }
+        return -1;
+    }
+    w->buf[w->len] = '\0';
+    return w->len;
+}
+
+void json_object_begin(json_writer_t *w) {
+    json_put(w, "{", 1);
+    w->comma = false;
+}
+
+void json_object_end(json_writer_t *w) {
+    json_put(w, "}", 1);
+    w->comma = true;
+}
+
+void json_key(json_writer_t *w, const char *key) {
+    size_t len = strlen(key);
+    char *out = json_reserve(w, len + 3 + w->comma);
+    if (out == NULL) {
+        return;
+    }
+    if (w->comma) {
+        *out++ = ',';
+    }
+    *out++ = '"';
+    memcpy(out, key, len);
+    out += len;
+    *out++ = '"';
+    *out = ':';
+    w->comma = true;
+}
+
+void json_string(json_writer_t *w, const uint8_t *data, size_t len) {
+    // Buffers sized with JSON_STRING_MAX take the single pass; otherwise size
+    // the output first so the loop can still write without bounds checks
+    size_t n = JSON_STRING_MAX(len);
+    if (w->overflow || w->len + n + 1 > w->size) {
+        n = 2;
+        for (size_t i = 0; i < len; i++) {
+            uint8_t e = escape_table[data[i]];
+            if (e == '8') {
+                size_t seq = utf8_sequence(data + i, len - i);
+                if (seq > 0) {
+                    n += seq;
+                    i += seq - 1;
+                    continue;
+                }
+                e = 'u';
+            }
+            n += e == 0 ? 1 : e == 'u' ? 6 : 2;
+        }
+    }
+    char *start = json_reserve(w, n);
+    if (start == NULL) {
+        return;
+    }
+    char *out = start;
+    *out++ = '"';
+    size_t i = 0;
+    while (i < len) {
+        // Copy the run of plain bytes and valid UTF-8 sequences in one go
+        size_t run = i;
+        size_t seq;
+        while (run < len) {
+            uint8_t e = escape_table[data[run]];
+            if (e == 0) {
+                run++;
+            } else if (e == '8' && (seq = utf8_sequence(data + run, len - run)) > 0) {
+                run += seq;
+            } else {
+                break;
+            }
+        }
+        if (run > i) {
+            memcpy(out, data + i, run - i);
+            out += run - i;
+            i = run;
+        }
+        if (i == len) {
+            break;
+        }
+        uint8_t e = escape_table[data[i]];
+        if (e == '8') {
+            e = 'u'; // Not valid UTF-8, or the run above would have taken it
+        }
+        uint8_t c = data[i++];
+        *out++ = '\\';
+        *out++ = e;
+        if (e == 'u') {
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex_digits[c >> 4];
+            *out++ = hex_digits[c & 0x0F];
+        }
+    }
+    *out++ = '"';
+    // Give back what the worst case reserved and escaping did not use
+    w->len -= n - (out - start);
+}
+
+void json_hex(json_writer_t *w, const uint8_t *data, size_t len) {
+    char *out = json_reserve(w, len * 2 + 2);
+    if (out == NULL) {
+        return;
+    }
+    *out++ = '"';
+    for (size_t i = 0; i < len; i++) {
+        *out++ = hex_digits[data[i] >> 4];
+        *out++ = hex_digits[data[i] & 0x0F];
+    }
+    *out = '"';
+}
+
+void json_base64(json_writer_t *w, const uint8_t *data, size_t len) {
+    char *out = json_reserve(w, (len + 2) / 3 * 4 + 2);
+    if (out == NULL) {
+        return;
+    }
+    *out++ = '"';
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        *out++ = base64_digits[v >> 18];
+        *out++ = base64_digits[(v >> 12) & 0x3F];
+        *out++ = base64_digits[(v >> 6) & 0x3F];
+        *out++ = base64_digits[v & 0x3F];
+    }
+    if (i < len) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < len) {
+            v |= data[i + 1] << 8;
+        }
+        *out++ = base64_digits[v >> 18];
+        *out++ = base64_digits[(v >> 12) & 0x3F];
+        *out++ = i + 1 < len ? base64_digits[(v >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+    *out = '"';
+}
+
+void json_int(json_writer_t *w, int64_t value) {
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%lld", (long long)value);
+    json_put(w, digits, n);
+}
+
+void json_float(json_writer_t *w, float value, int decimals) {
+    if (!isfinite(value)) {
+        json_put(w, "null", 4);
+        return;
+    }
+    char digits[32];
+    int n = snprintf(digits, sizeof(digits), "%.*f", decimals, (double)value);
+    json_put(w, digits, n);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming JSON writer into a caller supplied buffer, no allocation.
+// Once the buffer is too small every further write is ignored and
+// json_writer_finish() reports the overflow.
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool comma;    // A value was written at this level, next key needs a separator
+    bool overflow;
+} json_writer_t;
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size);
+
+// NUL terminate, returns the length or -1 if the output did not fit
+int json_writer_finish(json_writer_t *w);
+
+void json_object_begin(json_writer_t *w);
+void json_object_end(json_writer_t *w);
+void json_key(json_writer_t *w, const char *key);
+
+// Escaped string value. Valid UTF-8 passes through as is; quotes,
+// backslashes, control bytes and bytes that are not part of a valid UTF-8
+// sequence become escapes (\u0000 to \u00ff), so any byte sequence, NUL
+// included, comes out as valid JSON. Use json_hex() or json_base64() when
+// binary payloads must map back byte for byte.
+void json_string(json_writer_t *w, const uint8_t *data, size_t len);
+void json_hex(json_writer_t *w, const uint8_t *data, size_t len);
+void json_base64(json_writer_t *w, const uint8_t *data, size_t len);
+void json_int(json_writer_t *w, int64_t value);
+void json_float(json_writer_t *w, float value, int decimals);
+
+// Worst case output of each string encoding, quotes included
+#define JSON_STRING_MAX(len) ((len) * 6 + 2)
+#define JSON_HEX_MAX(len) ((len) * 2 + 2)
+#define JSON_BASE64_MAX(len) (((len) + 2) / 3 * 4 + 2)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,112 @@
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "latency.h"
+
+// Log-linear buckets: every power of two is split in 1 << LATENCY_SUB_BITS,
+// so a bucket is at most 25% wider than its lower bound
+#define LATENCY_SUB_BITS 2
+#define LATENCY_RANGE_BITS 28 // 268 s
+#define LATENCY_BUCKETS ((LATENCY_RANGE_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+#define LATENCY_MAX_US ((1u << LATENCY_RANGE_BITS) - 1)
+
+// One per stage and core. Each core only adds to its own, the atomics are
+// for tasks preempted on the same core and cost no bus contention.
+typedef struct {
+    _Atomic uint32_t buckets[LATENCY_BUCKETS];
+    _Atomic uint32_t max_us;
+} latency_hist_t;
+
+static latency_hist_t hists[LATENCY_STAGES][portNUM_PROCESSORS];
+
+static const char *names[LATENCY_STAGES] = {
+    [LATENCY_DRAIN] = "irq>drain",
+    [LATENCY_ENQUEUE] = "drain>queue",
+    [LATENCY_ENCODE] = "queue>encode",
+    [LATENCY_BATCH] = "encode>post",
+    [LATENCY_CONNECT] = "post>tls",
+    [LATENCY_RESPONSE] = "sent>response",
+    [LATENCY_TOTAL] = "irq>ack",
+};
+
+static uint32_t latency_bucket(uint32_t us) {
+    if (us < (1u << LATENCY_SUB_BITS)) {
+        return us;
+    }
+    uint32_t exp = 31 - __builtin_clz(us);
+    uint32_t sub = (us >> (exp - LATENCY_SUB_BITS)) & ((1u << LATENCY_SUB_BITS) - 1);
+    return ((exp - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+// Largest value that falls in bucket
+static uint32_t latency_bucket_limit(uint32_t bucket) {
+    if (bucket < (1u << LATENCY_SUB_BITS)) {
+        return bucket;
+    }
+    uint32_t exp = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint32_t sub = bucket & ((1u << LATENCY_SUB_BITS) - 1);
+    uint32_t width = 1u << (exp - LATENCY_SUB_BITS);
+    return (((1u << LATENCY_SUB_BITS) + sub) << (exp - LATENCY_SUB_BITS)) + width - 1;
+}
+
+void latency_record(latency_stage_t stage, int64_t us) {
+    uint32_t value = us < 0 ? 0 : us > LATENCY_MAX_US ? LATENCY_MAX_US : (uint32_t)us;
+    latency_hist_t *h = &hists[stage][xPortGetCoreID()];
+    atomic_fetch_add_explicit(&h->buckets[latency_bucket(value)], 1, memory_order_relaxed);
+    uint32_t max = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&h->max_us, &max, value,
+                                                                 memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void latency_get(latency_stage_t stage, latency_summary_t *summary) {
+    static uint32_t merged[LATENCY_BUCKETS]; // Only the console task reads
+    const uint32_t quantiles[] = {50, 90, 99};
+    uint32_t *out[] = {&summary->p50_us, &summary->p90_us, &summary->p99_us};
+    uint32_t total = 0;
+
+    summary->max_us = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        merged[b] = 0;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            merged[b] += atomic_load_explicit(&hists[stage][core].buckets[b], memory_order_relaxed);
+        }
+        total += merged[b];
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t max = atomic_load_explicit(&hists[stage][core].max_us, memory_order_relaxed);
+        if (max > summary->max_us) {
+            summary->max_us = max;
+        }
+    }
+    summary->count = total;
+
+    int q = 0;
+    uint32_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS && q < 3; b++) {
+        seen += merged[b];
+        while (q < 3 && total > 0 && (uint64_t)seen * 100 >= (uint64_t)total * quantiles[q]) {
+            uint32_t limit = latency_bucket_limit(b);
+            *out[q++] = limit < summary->max_us ? limit : summary->max_us;
+        }
+    }
+    while (q < 3) {
+        *out[q++] = 0;
+    }
+}
+
+const char *latency_stage_name(latency_stage_t stage) {
+    return stage < LATENCY_STAGES ? names[stage] : "?";
+}
+
+void latency_reset() {
+    for (int s = 0; s < LATENCY_STAGES; s++) {
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            latency_hist_t *h = &hists[s][core];
+            for (int b = 0; b < LATENCY_BUCKETS; b++) {
+                atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+            }
+            atomic_store_explicit(&h->max_us, 0, memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stages of a received frame on its way to the server
+typedef enum {
+    LATENCY_DRAIN,    // DIO0 interrupt to payload read from the FIFO
+    LATENCY_ENQUEUE,  // FIFO read to frame committed to the RX ring
+    LATENCY_ENCODE,   // RX ring to JSON object in the batch, queue wait included
+    LATENCY_BATCH,    // In the batch until its POST starts
+    LATENCY_CONNECT,  // POST start to TLS connected, new connections only
+    LATENCY_RESPONSE, // Request sent to response received
+    LATENCY_TOTAL,    // DIO0 interrupt to response received, frames delivered live
+    LATENCY_STAGES
+} latency_stage_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us; // Upper bound of the bucket holding the quantile
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} latency_summary_t;
+
+// Add one measurement, from any task on any core. Longer than about 268 s
+// counts as that.
+void latency_record(latency_stage_t stage, int64_t us);
+
+// Merged over the cores
+void latency_get(latency_stage_t stage, latency_summary_t *summary);
+const char *latency_stage_name(latency_stage_t stage);
+void latency_reset();
+
+#ifdef __cplusplus
+}
+#endif
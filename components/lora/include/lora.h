@@ -1,29 +1,196 @@
 #ifndef __LORA_H__
 #define __LORA_H__
 
-void lora_reset(void);
-void lora_explicit_header_mode(void);
-void lora_implicit_header_mode(int size);
-void lora_idle(void);
-void lora_sleep(void); 
-void lora_receive(void);
-void lora_set_tx_power(int level);
-void lora_set_frequency(long frequency);
-void lora_set_spreading_factor(int sf);
-void lora_set_bandwidth(long sbw);
-void lora_set_coding_rate(int denominator);
-void lora_set_preamble_length(long length);
-void lora_set_sync_word(int sw);
-void lora_enable_crc(void);
-void lora_disable_crc(void);
-int lora_init(void);
-void lora_send_packet(uint8_t *buf, int size);
-int lora_receive_packet(uint8_t *buf, int size);
-int lora_received(void);
-int lora_packet_rssi(void);
-float lora_packet_snr(void);
-void lora_close(void);
-int lora_initialized(void);
-void lora_dump_registers(void);
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/spi_master.h"
+
+/*
+ * Time from the DIO0 (RxDone) interrupt until the payload is read.
+ */
+typedef struct {
+   uint32_t count;
+   int64_t last_us;
+   int64_t max_us;
+   int64_t total_us;
+} lora_irq_stats_t;
+
+/*
+ * Low data rate optimization, required when a symbol lasts over 16 ms.
+ * Must match the transmitter.
+ */
+typedef enum {
+   LORA_LDRO_AUTO,         // On when the symbol time calls for it
+   LORA_LDRO_ON,
+   LORA_LDRO_OFF
+} lora_ldro_t;
+
+/*
+ * Complete modem configuration, applied with lora_apply_profile().
+ */
+typedef struct {
+   long frequency;         // Carrier, Hz
+   int spreading_factor;   // 6-12
+   long bandwidth;         // Hz, up to 500000
+   int coding_rate;        // 5-8, denominator of 4/x
+   int sync_word;
+   long preamble_length;   // Symbols
+   int crc;                // Non-zero to append/verify the payload CRC
+   int implicit_len;       // Fixed payload size in implicit header mode, 0 for explicit
+   lora_ldro_t ldro;
+} lora_profile_t;
+
+/*
+ * Receive counters since boot or the last reset.
+ */
+typedef struct {
+   uint32_t received;      // RxDone interrupts serviced
+   uint32_t crc_errors;    // Of those, dropped on a payload CRC error
+   uint32_t dropped;       // Valid headers that never reached a serviced RxDone
+   uint32_t fifo_wraps;    // Packets that wrapped around the end of the FIFO
+   uint32_t fifo_gaps;     // Packets not starting where the previous one ended
+} lora_rx_stats_t;
+
+/*
+ * Radio metadata of one received packet, latched by the modem at RxDone.
+ */
+typedef struct {
+   int64_t timestamp_us;   // DIO0 interrupt time, or read time when polling
+   int16_t rssi;           // Packet RSSI in dBm, corrected below the noise floor
+   float snr;              // Packet SNR in dB
+   int32_t freq_error;     // Carrier offset estimated by the modem (FEI), Hz
+   uint8_t crc_on;         // Header announced a payload CRC
+   uint8_t crc_error;      // Payload CRC check failed
+   uint8_t coding_rate;    // 5-8, denominator of 4/x from the received header
+   uint8_t len;            // Payload length in the FIFO
+} lora_packet_info_t;
+
+#define LORA_SHADOW_SIZE 0x40   // Registers 0x00-0x3f
+
+/*
+ * CAD duration measured by lora_cad_measure()
+ */
+typedef struct {
+   int spreading_factor;
+   long bandwidth;
+   uint32_t symbol_us;     // One symbol at this SF and bandwidth
+   int runs;               // Detections that completed
+   int detected;           // Of those, preambles found
+   int timeouts;           // Detections without CadDone
+   uint32_t min_us;
+   uint32_t avg_us;
+   uint32_t max_us;
+} lora_cad_timing_t;
+
+/*
+ * SPI bus and pins of one radio. Radios on the same host share MISO,
+ * MOSI and SCK and differ in chip select.
+ */
+typedef struct {
+   spi_host_device_t host;
+   int miso;
+   int mosi;
+   int sck;
+   int cs;
+   int rst;
+   int dio0;               // -1 if not wired, reception then polls
+} lora_config_t;
+
+/*
+ * Radio wired as configured in menuconfig
+ */
+#define LORA_CONFIG_DEFAULT() {        \
+   .host = VSPI_HOST,                  \
+   .miso = CONFIG_MISO_GPIO,           \
+   .mosi = CONFIG_MOSI_GPIO,           \
+   .sck = CONFIG_SCK_GPIO,             \
+   .cs = CONFIG_CS_GPIO,               \
+   .rst = CONFIG_RST_GPIO,             \
+   .dio0 = CONFIG_DIO0_GPIO,           \
+}
+
+/*
+ * State of one radio. Every lora_*() call takes the handle, so several
+ * radios can be driven from their own tasks.
+ */
+typedef struct {
+   spi_device_handle_t spi;
+   uint32_t spi_transactions;
+   int rst;
+   int dio0;
+   int implicit;
+   long frequency;
+
+   uint8_t shadow[LORA_SHADOW_SIZE]; // Configuration registers as last written
+   uint64_t shadow_valid;
+
+   TaskHandle_t rx_task;            // Woken by the DIO0 interrupt
+   volatile int64_t irq_time;
+   portMUX_TYPE irq_lock;           // The 64-bit stamp takes two stores on the 32-bit core
+   int dio0_enabled;
+   lora_irq_stats_t irq_stats;
+
+   int rx_continuous;               // Modem stays in RX while the FIFO is read
+   int rx_next_addr;                // FIFO address where the next packet should start
+   int rx_header_count;             // REG_RX_HEADER_CNT at the last read
+   int rx_header_pending;           // That read saw the header of a packet still in the air
+   lora_rx_stats_t rx_stats;
+
+   int dio_mapping;                 // REG_DIO_MAPPING_1 as last written
+   volatile int cad_active;         // DIO0 reports CadDone instead of RxDone
+   int64_t cad_start_time;
+   volatile int64_t cad_done_time;
+   uint32_t cad_us[7][10];          // Measured CAD duration by SF 6-12 and bandwidth
+} lora_dev_t;
+
+void lora_write_reg(lora_dev_t *dev, int reg, int val);
+int lora_read_reg(lora_dev_t *dev, int reg);
+void lora_write_burst(lora_dev_t *dev, int reg, const uint8_t *buf, int len);
+void lora_read_burst(lora_dev_t *dev, int reg, uint8_t *buf, int len);
+void lora_write_fifo(lora_dev_t *dev, const uint8_t *buf, int len);
+void lora_read_fifo(lora_dev_t *dev, uint8_t *buf, int len);
+uint32_t lora_spi_transactions(lora_dev_t *dev);
+void lora_reset(lora_dev_t *dev);
+void lora_explicit_header_mode(lora_dev_t *dev);
+void lora_implicit_header_mode(lora_dev_t *dev, int size);
+void lora_idle(lora_dev_t *dev);
+void lora_sleep(lora_dev_t *dev);
+void lora_receive(lora_dev_t *dev);
+void lora_receive_continuous(lora_dev_t *dev);
+void lora_set_tx_power(lora_dev_t *dev, int level);
+void lora_set_frequency(lora_dev_t *dev, long frequency);
+void lora_set_spreading_factor(lora_dev_t *dev, int sf);
+void lora_set_bandwidth(lora_dev_t *dev, long sbw);
+void lora_set_coding_rate(lora_dev_t *dev, int denominator);
+void lora_set_preamble_length(lora_dev_t *dev, long length);
+void lora_set_sync_word(lora_dev_t *dev, int sw);
+void lora_enable_crc(lora_dev_t *dev);
+void lora_disable_crc(lora_dev_t *dev);
+void lora_apply_profile(lora_dev_t *dev, const lora_profile_t *profile);
+int lora_init(lora_dev_t *dev, const lora_config_t *config);
+void lora_send_packet(lora_dev_t *dev, uint8_t *buf, int size);
+int lora_receive_packet(lora_dev_t *dev, uint8_t *buf, int size);
+int lora_receive_packet_info(lora_dev_t *dev, uint8_t *buf, int size, lora_packet_info_t *info);
+int lora_received(lora_dev_t *dev);
+int lora_rx_busy(lora_dev_t *dev);
+void lora_cad_start(lora_dev_t *dev);
+int lora_cad_result(lora_dev_t *dev);
+int lora_cad(lora_dev_t *dev, int timeout_ms);
+uint32_t lora_cad_last_us(lora_dev_t *dev);
+void lora_cad_measure(lora_dev_t *dev, int runs, lora_cad_timing_t *timing);
+uint32_t lora_cad_duration_us(lora_dev_t *dev);
+uint32_t lora_symbol_us(const lora_profile_t *profile);
+uint32_t lora_airtime_us(const lora_profile_t *profile, int len);
+int lora_dio0_enabled(lora_dev_t *dev);
+int lora_wait_received(lora_dev_t *dev, int timeout_ms);
+void lora_get_irq_stats(lora_dev_t *dev, lora_irq_stats_t *stats);
+void lora_reset_irq_stats(lora_dev_t *dev);
+void lora_get_rx_stats(lora_dev_t *dev, lora_rx_stats_t *stats);
+void lora_reset_rx_stats(lora_dev_t *dev);
+int lora_packet_rssi(lora_dev_t *dev);
+float lora_packet_snr(lora_dev_t *dev);
+void lora_close(lora_dev_t *dev);
+void lora_dump_registers(lora_dev_t *dev);
 
 #endif
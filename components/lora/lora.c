@@ -4,6 +4,8 @@
 #include "driver/spi_master.h"
 #include "soc/gpio_struct.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "lora.h"
 #include <string.h>
 
 /*
@@ -22,14 +24,24 @@
 #define REG_FIFO_RX_CURRENT_ADDR       0x10
 #define REG_IRQ_FLAGS                  0x12
 #define REG_RX_NB_BYTES                0x13
+#define REG_RX_HEADER_CNT_MSB          0x14
+#define REG_RX_HEADER_CNT_LSB          0x15
+#define REG_MODEM_STAT                 0x18
 #define REG_PKT_SNR_VALUE              0x19
 #define REG_PKT_RSSI_VALUE             0x1a
+#define REG_HOP_CHANNEL                0x1c
 #define REG_MODEM_CONFIG_1             0x1d
 #define REG_MODEM_CONFIG_2             0x1e
+#define REG_SYMB_TIMEOUT_LSB           0x1f
 #define REG_PREAMBLE_MSB               0x20
 #define REG_PREAMBLE_LSB               0x21
 #define REG_PAYLOAD_LENGTH             0x22
+#define REG_MAX_PAYLOAD_LENGTH         0x23
+#define REG_HOP_PERIOD                 0x24
 #define REG_MODEM_CONFIG_3             0x26
+#define REG_FEI_MSB                    0x28
+#define REG_FEI_MID                    0x29
+#define REG_FEI_LSB                    0x2a
 #define REG_RSSI_WIDEBAND              0x2c
 #define REG_DETECTION_OPTIMIZE         0x31
 #define REG_DETECTION_THRESHOLD        0x37
@@ -46,6 +58,7 @@
 #define MODE_TX                        0x03
 #define MODE_RX_CONTINUOUS             0x05
 #define MODE_RX_SINGLE                 0x06
+#define MODE_CAD                       0x07
 
 /*
  * PA configuration
@@ -55,19 +68,78 @@
 /*
  * IRQ masks
  */
+#define IRQ_CAD_DETECTED_MASK          0x01
+#define IRQ_CAD_DONE_MASK              0x04
 #define IRQ_TX_DONE_MASK               0x08
 #define IRQ_PAYLOAD_CRC_ERROR_MASK     0x20
 #define IRQ_RX_DONE_MASK               0x40
 
+/*
+ * DIO mapping: DIO0 RxDone in receive, CadDone and DIO1 CadDetected in CAD
+ */
+#define DIO_MAPPING_RX                 0x00
+#define DIO_MAPPING_CAD                0xa0
+
+/*
+ * Modem status bits
+ */
+#define MODEM_STAT_SIGNAL_DETECTED     0x01
+#define MODEM_STAT_SIGNAL_SYNC         0x02
+#define MODEM_STAT_RX_ONGOING          0x04
+#define MODEM_STAT_HEADER_VALID        0x08
+
 #define PA_OUTPUT_RFO_PIN              0
 #define PA_OUTPUT_PA_BOOST_PIN         1
 
 #define TIMEOUT_RESET                  100
 
-static spi_device_handle_t __spi;
+/*
+ * Packet status registers read in one burst at RxDone:
+ * REG_FIFO_RX_CURRENT_ADDR through REG_FEI_LSB
+ */
+#define RX_STATUS_FIRST                REG_FIFO_RX_CURRENT_ADDR
+#define RX_STATUS_LEN                  (REG_FEI_LSB - RX_STATUS_FIRST + 1)
+#define RX_STATUS(regs, reg)           ((regs)[(reg) - RX_STATUS_FIRST])
+
+/*
+ * Configuration registers kept in the shadow. They change only when
+ * written, so their last written value is what the radio holds.
+ */
+#define SHADOW_SIZE                    LORA_SHADOW_SIZE
+#define SHADOW_BIT(reg)                (1ULL << (reg))
+#define SHADOW_CACHEABLE                                                    \
+   (SHADOW_BIT(REG_FRF_MSB) | SHADOW_BIT(REG_FRF_MID) | SHADOW_BIT(REG_FRF_LSB) | \
+    SHADOW_BIT(REG_PA_CONFIG) | SHADOW_BIT(REG_LNA) |                       \
+    SHADOW_BIT(REG_FIFO_TX_BASE_ADDR) | SHADOW_BIT(REG_FIFO_RX_BASE_ADDR) | \
+    SHADOW_BIT(REG_MODEM_CONFIG_1) | SHADOW_BIT(REG_MODEM_CONFIG_2) |       \
+    SHADOW_BIT(REG_SYMB_TIMEOUT_LSB) | SHADOW_BIT(REG_PREAMBLE_MSB) |      \
+    SHADOW_BIT(REG_PREAMBLE_LSB) | SHADOW_BIT(REG_PAYLOAD_LENGTH) |        \
+    SHADOW_BIT(REG_MAX_PAYLOAD_LENGTH) | SHADOW_BIT(REG_HOP_PERIOD) |      \
+    SHADOW_BIT(REG_MODEM_CONFIG_3) | SHADOW_BIT(REG_DETECTION_OPTIMIZE) |  \
+    SHADOW_BIT(REG_DETECTION_THRESHOLD) | SHADOW_BIT(REG_SYNC_WORD))
+
+/*
+ * Unchanged registers a profile burst may rewrite to join two runs,
+ * cheaper than starting another transaction
+ */
+#define SHADOW_MAX_BRIDGE              2
+
+/*
+ * Longest symbol time allowed without the low data rate optimization, ms
+ */
+#define LDRO_SYMBOL_MS                 16
+
+/*
+ * FIFO size, largest possible burst transfer
+ */
+#define LORA_FIFO_SIZE                 256
 
-static int __implicit;
-static long __frequency;
+/*
+ * Bandwidth in Hz of each REG_MODEM_CONFIG_1 setting
+ */
+static const long __bandwidths[] = {
+   7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
 
 /**
  * Write a value to a register.
@@ -75,7 +147,7 @@ static long __frequency;
  * @param val Value to write.
  */
 void 
-lora_write_reg(int reg, int val)
+lora_write_reg(lora_dev_t *dev, int reg, int val)
 {
    uint8_t out[2] = { 0x80 | reg, val };
    uint8_t in[2];
@@ -87,9 +159,13 @@ lora_write_reg(int reg, int val)
       .rx_buffer = in  
    };
 
-   gpio_set_level(CONFIG_CS_GPIO, 0);
-   spi_device_transmit(__spi, &t);
-   gpio_set_level(CONFIG_CS_GPIO, 1);
+   spi_device_transmit(dev->spi, &t);
+   dev->spi_transactions++;
+
+   if(reg < SHADOW_SIZE && (SHADOW_CACHEABLE & SHADOW_BIT(reg))) {
+      dev->shadow[reg] = val;
+      dev->shadow_valid |= SHADOW_BIT(reg);
+   }
 }
 
 /**
@@ -98,7 +174,7 @@ lora_write_reg(int reg, int val)
  * @return Value of the register.
  */
 int
-lora_read_reg(int reg)
+lora_read_reg(lora_dev_t *dev, int reg)
 {
    uint8_t out[2] = { reg, 0xff };
    uint8_t in[2];
@@ -110,22 +186,213 @@ lora_read_reg(int reg)
       .rx_buffer = in
    };
 
-   gpio_set_level(CONFIG_CS_GPIO, 0);
-   spi_device_transmit(__spi, &t);
-   gpio_set_level(CONFIG_CS_GPIO, 1);
+   spi_device_transmit(dev->spi, &t);
+   dev->spi_transactions++;
    return in[1];
 }
 
+/**
+ * Write consecutive registers in a single SPI transaction.
+ * The radio increments the address after every byte, except for
+ * REG_FIFO where all bytes go to the FIFO data pointer.
+ * @param reg First register index.
+ * @param buf Values to write.
+ * @param len Number of bytes (up to LORA_FIFO_SIZE).
+ */
+void
+lora_write_burst(lora_dev_t *dev, int reg, const uint8_t *buf, int len)
+{
+   if(len <= 0) return;
+   if(len > LORA_FIFO_SIZE) len = LORA_FIFO_SIZE;
+
+   spi_transaction_ext_t t = {
+      .base = {
+         .flags = SPI_TRANS_VARIABLE_ADDR,
+         .addr = 0x80 | reg,
+         .length = 8 * len,
+         .tx_buffer = buf,
+         .rx_buffer = NULL
+      },
+      .address_bits = 8
+   };
+
+   spi_device_transmit(dev->spi, (spi_transaction_t *)&t);
+   dev->spi_transactions++;
+
+   if(reg == REG_FIFO) return;
+   for(int i = 0; i < len && reg + i < SHADOW_SIZE; i++) {
+      if(SHADOW_CACHEABLE & SHADOW_BIT(reg + i)) {
+         dev->shadow[reg + i] = buf[i];
+         dev->shadow_valid |= SHADOW_BIT(reg + i);
+      }
+   }
+}
+
+/**
+ * Read consecutive registers in a single SPI transaction.
+ * @param reg First register index.
+ * @param buf Buffer for the values.
+ * @param len Number of bytes (up to LORA_FIFO_SIZE).
+ */
+void
+lora_read_burst(lora_dev_t *dev, int reg, uint8_t *buf, int len)
+{
+   if(len <= 0) return;
+   if(len > LORA_FIFO_SIZE) len = LORA_FIFO_SIZE;
+
+   spi_transaction_ext_t t = {
+      .base = {
+         .flags = SPI_TRANS_VARIABLE_ADDR,
+         .addr = reg,
+         .length = 8 * len,
+         .tx_buffer = NULL,
+         .rx_buffer = buf
+      },
+      .address_bits = 8
+   };
+
+   spi_device_transmit(dev->spi, (spi_transaction_t *)&t);
+   dev->spi_transactions++;
+}
+
+/**
+ * Write a block of data to the FIFO at the current FIFO pointer.
+ * @param buf Data to write.
+ * @param len Number of bytes.
+ */
+void
+lora_write_fifo(lora_dev_t *dev, const uint8_t *buf, int len)
+{
+   lora_write_burst(dev, REG_FIFO, buf, len);
+}
+
+/**
+ * Read a block of data from the FIFO at the current FIFO pointer.
+ * @param buf Buffer for the data.
+ * @param len Number of bytes.
+ */
+void
+lora_read_fifo(lora_dev_t *dev, uint8_t *buf, int len)
+{
+   lora_read_burst(dev, REG_FIFO, buf, len);
+}
+
+/**
+ * Number of SPI transactions issued since boot.
+ */
+uint32_t
+lora_spi_transactions(lora_dev_t *dev)
+{
+   return dev->spi_transactions;
+}
+
+/**
+ * Fill the shadow from the radio with a single burst read.
+ */
+static void
+lora_shadow_load(lora_dev_t *dev)
+{
+   uint8_t regs[SHADOW_SIZE];
+
+   // REG_FIFO is left out, reading it pops a byte
+   lora_read_burst(dev, REG_OP_MODE, regs + REG_OP_MODE, SHADOW_SIZE - REG_OP_MODE);
+   for(int reg = REG_OP_MODE; reg < SHADOW_SIZE; reg++) {
+      if(SHADOW_CACHEABLE & SHADOW_BIT(reg)) dev->shadow[reg] = regs[reg];
+   }
+   dev->shadow_valid = SHADOW_CACHEABLE;
+}
+
+/**
+ * Value of a configuration register, from the shadow when known.
+ * @param reg Register index, must be in SHADOW_CACHEABLE.
+ */
+static int
+lora_read_shadow(lora_dev_t *dev, int reg)
+{
+   if(!(dev->shadow_valid & SHADOW_BIT(reg))) {
+      dev->shadow[reg] = lora_read_reg(dev, reg);
+      dev->shadow_valid |= SHADOW_BIT(reg);
+   }
+   return dev->shadow[reg];
+}
+
+/**
+ * Read-modify-write of a configuration register through the shadow.
+ * Nothing goes over SPI when the bits already hold the value.
+ * @param reg Register index, must be in SHADOW_CACHEABLE.
+ * @param mask Bits to change.
+ * @param val New value of those bits.
+ */
+static void
+lora_update_reg(lora_dev_t *dev, int reg, int mask, int val)
+{
+   int old = lora_read_shadow(dev, reg);
+   int next = (old & ~mask) | (val & mask);
+
+   if(next != old) lora_write_reg(dev, reg, next);
+}
+
+/**
+ * Staged registers whose value differs from the shadow.
+ * @param stage Register values, indexed by register.
+ * @param staged Mask of the registers in stage.
+ */
+static uint64_t
+lora_staged_changes(lora_dev_t *dev, const uint8_t *stage, uint64_t staged)
+{
+   uint64_t changed = 0;
+
+   for(int r = 0; r < SHADOW_SIZE; r++) {
+      if((staged & SHADOW_BIT(r)) &&
+         (!(dev->shadow_valid & SHADOW_BIT(r)) || dev->shadow[r] != stage[r])) changed |= SHADOW_BIT(r);
+   }
+   return changed;
+}
+
+/**
+ * Write the changed registers in as few bursts as possible. Runs of
+ * changed registers are joined over up to SHADOW_MAX_BRIDGE unchanged
+ * ones by rewriting their shadow value.
+ * @param stage Register values, indexed by register.
+ * @param staged Mask of the registers in stage.
+ * @param changed Mask from lora_staged_changes().
+ */
+static void
+lora_write_staged(lora_dev_t *dev, const uint8_t *stage, uint64_t staged, uint64_t changed)
+{
+   uint8_t buf[SHADOW_SIZE];
+   int reg = 0;
+
+   while(reg < SHADOW_SIZE) {
+      if(!(changed & SHADOW_BIT(reg))) {
+         reg++;
+         continue;
+      }
+      int start = reg;
+      int end = reg + 1;
+      for(int r = end; r < SHADOW_SIZE && r - end < SHADOW_MAX_BRIDGE + 1; r++) {
+         if(changed & SHADOW_BIT(r)) end = r + 1;
+         else if(!(staged & SHADOW_BIT(r)) && !(dev->shadow_valid & SHADOW_BIT(r))) break;
+      }
+      for(int r = start; r < end; r++) {
+         buf[r - start] = (staged & SHADOW_BIT(r)) ? stage[r] : dev->shadow[r];
+      }
+      lora_write_burst(dev, start, buf, end - start);
+      reg = end;
+   }
+}
+
 /**
  * Perform physical reset on the Lora chip
  */
 void 
-lora_reset(void)
+lora_reset(lora_dev_t *dev)
 {
-   gpio_set_level(CONFIG_RST_GPIO, 0);
+   gpio_set_level(dev->rst, 0);
    vTaskDelay(pdMS_TO_TICKS(1));
-   gpio_set_level(CONFIG_RST_GPIO, 1);
+   gpio_set_level(dev->rst, 1);
    vTaskDelay(pdMS_TO_TICKS(10));
+   dev->shadow_valid = 0;
 }
 
 /**
@@ -133,10 +400,10 @@ lora_reset(void)
  * Packet size will be included in the frame.
  */
 void 
-lora_explicit_header_mode(void)
+lora_explicit_header_mode(lora_dev_t *dev)
 {
-   __implicit = 0;
-   lora_write_reg(REG_MODEM_CONFIG_1, lora_read_reg(REG_MODEM_CONFIG_1) & 0xfe);
+   dev->implicit = 0;
+   lora_update_reg(dev, REG_MODEM_CONFIG_1, 0x01, 0x00);
 }
 
 /**
@@ -145,11 +412,23 @@ lora_explicit_header_mode(void)
  * @param size Size of the packets.
  */
 void 
-lora_implicit_header_mode(int size)
+lora_implicit_header_mode(lora_dev_t *dev, int size)
 {
-   __implicit = 1;
-   lora_write_reg(REG_MODEM_CONFIG_1, lora_read_reg(REG_MODEM_CONFIG_1) | 0x01);
-   lora_write_reg(REG_PAYLOAD_LENGTH, size);
+   dev->implicit = 1;
+   lora_update_reg(dev, REG_MODEM_CONFIG_1, 0x01, 0x01);
+   lora_update_reg(dev, REG_PAYLOAD_LENGTH, 0xff, size);
+}
+
+/**
+ * Route the interrupt sources to the DIO pins, skipped when unchanged.
+ * @param mapping REG_DIO_MAPPING_1 value.
+ */
+static void
+lora_set_dio_mapping(lora_dev_t *dev, int mapping)
+{
+   if(dev->dio_mapping == mapping) return;
+   lora_write_reg(dev, REG_DIO_MAPPING_1, mapping);
+   dev->dio_mapping = mapping;
 }
 
 /**
@@ -157,9 +436,11 @@ lora_implicit_header_mode(int size)
  * Must be used to change registers and access the FIFO.
  */
 void 
-lora_idle(void)
+lora_idle(lora_dev_t *dev)
 {
-   lora_write_reg(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
+   dev->rx_continuous = 0;
+   dev->cad_active = 0;
+   lora_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
 }
 
 /**
@@ -167,9 +448,11 @@ lora_idle(void)
  * Low power consumption and FIFO is lost.
  */
 void 
-lora_sleep(void)
+lora_sleep(lora_dev_t *dev)
 { 
-   lora_write_reg(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
+   dev->rx_continuous = 0;
+   dev->rx_header_count = -1;   // counters are cleared in sleep
+   lora_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
 }
 
 /**
@@ -177,9 +460,157 @@ lora_sleep(void)
  * Incoming packets will be received.
  */
 void 
-lora_receive(void)
+lora_receive(lora_dev_t *dev)
+{
+   dev->rx_continuous = 0;
+   lora_set_dio_mapping(dev, DIO_MAPPING_RX);
+   lora_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
+}
+
+/**
+ * Sets the radio transceiver in receive mode and keeps it there:
+ * packets are read from the FIFO without going through standby, so a
+ * preamble arriving meanwhile is not missed. Consecutive packets are
+ * written one after the other around the 256-byte FIFO.
+ * Does nothing if the radio is already receiving this way, so it can be
+ * called on every loop to re-arm after a transmission.
+ */
+void
+lora_receive_continuous(lora_dev_t *dev)
+{
+   if(dev->rx_continuous) return;
+   lora_set_dio_mapping(dev, DIO_MAPPING_RX);
+   lora_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
+   dev->rx_continuous = 1;
+   dev->rx_next_addr = -1;
+}
+
+/**
+ * DIO0 rising edge: RxDone in receive mode, CadDone during a CAD.
+ * Stamps the interrupt and wakes the task waiting in lora_wait_received()
+ * or lora_cad().
+ */
+static void IRAM_ATTR
+lora_dio0_isr(void *arg)
+{
+   lora_dev_t *dev = arg;
+   BaseType_t woken = pdFALSE;
+
+   int64_t now = esp_timer_get_time();
+
+   portENTER_CRITICAL_ISR(&dev->irq_lock);
+   if(dev->cad_active) dev->cad_done_time = now;
+   else dev->irq_time = now;
+   portEXIT_CRITICAL_ISR(&dev->irq_lock);
+   if(dev->rx_task != NULL) vTaskNotifyGiveFromISR(dev->rx_task, &woken);
+   if(woken) portYIELD_FROM_ISR();
+}
+
+/**
+ * Hook the DIO0 pin to lora_dio0_isr(), if the board has it wired.
+ */
+static void
+lora_dio0_init(lora_dev_t *dev)
+{
+   esp_err_t ret;
+
+   if(dev->dio0 < 0) return;
+   gpio_reset_pin(dev->dio0);
+   gpio_set_direction(dev->dio0, GPIO_MODE_INPUT);
+   gpio_set_intr_type(dev->dio0, GPIO_INTR_POSEDGE);
+
+   ret = gpio_install_isr_service(0);
+   if(ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) return;   // already installed is fine
+   if(gpio_isr_handler_add(dev->dio0, lora_dio0_isr, dev) != ESP_OK) return;
+   dev->dio0_enabled = 1;
+}
+
+/**
+ * Returns non-zero if RxDone is signalled through the DIO0 interrupt,
+ * zero if lora_wait_received() falls back to polling.
+ */
+int
+lora_dio0_enabled(lora_dev_t *dev)
+{
+   return dev->dio0_enabled;
+}
+
+/**
+ * Block the calling task until a packet is received.
+ * Sleeps on a task notification from the DIO0 interrupt when available,
+ * otherwise polls REG_IRQ_FLAGS once per tick.
+ * @param timeout_ms Maximum wait, negative to wait forever.
+ * @return Non-zero if there is a packet to read.
+ */
+int
+lora_wait_received(lora_dev_t *dev, int timeout_ms)
+{
+   TickType_t timeout = timeout_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+
+   if(dev->dio0_enabled) {
+      dev->rx_task = xTaskGetCurrentTaskHandle();
+      if(lora_received(dev)) return 1;
+      ulTaskNotifyTake(pdTRUE, timeout);
+      return lora_received(dev);
+   }
+
+   TickType_t start = xTaskGetTickCount();
+   while(!lora_received(dev)) {
+      if(timeout != portMAX_DELAY && xTaskGetTickCount() - start >= timeout) return 0;
+      vTaskDelay(1);
+   }
+   return 1;
+}
+
+/**
+ * Copy the interrupt-to-read latency counters.
+ * @param stats Destination for the counters.
+ */
+void
+lora_get_irq_stats(lora_dev_t *dev, lora_irq_stats_t *stats)
+{
+   *stats = dev->irq_stats;
+}
+
+/**
+ * Reset the interrupt-to-read latency counters.
+ */
+void
+lora_reset_irq_stats(lora_dev_t *dev)
+{
+   memset(&dev->irq_stats, 0, sizeof(dev->irq_stats));
+}
+
+/**
+ * Copy the receive counters.
+ * @param stats Destination for the counters.
+ */
+void
+lora_get_rx_stats(lora_dev_t *dev, lora_rx_stats_t *stats)
+{
+   *stats = dev->rx_stats;
+}
+
+/**
+ * Reset the receive counters.
+ */
+void
+lora_reset_rx_stats(lora_dev_t *dev)
 {
-   lora_write_reg(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
+   memset(&dev->rx_stats, 0, sizeof(dev->rx_stats));
+}
+
+/**
+ * REG_MODEM_CONFIG_1 bandwidth setting for a bandwidth.
+ * @param sbw Bandwidth in Hz, rounded up to the next supported one.
+ */
+static int
+lora_bandwidth_index(long sbw)
+{
+   int bw = 0;
+
+   while(bw < 9 && sbw > __bandwidths[bw]) bw++;
+   return bw;
 }
 
 /**
@@ -187,12 +618,12 @@ lora_receive(void)
  * @param level 2-17, from least to most power
  */
 void 
-lora_set_tx_power(int level)
+lora_set_tx_power(lora_dev_t *dev, int level)
 {
    // RF9x module uses PA_BOOST pin
    if (level < 2) level = 2;
    else if (level > 17) level = 17;
-   lora_write_reg(REG_PA_CONFIG, PA_BOOST | (level - 2));
+   lora_write_reg(dev, REG_PA_CONFIG, PA_BOOST | (level - 2));
 }
 
 /**
@@ -200,15 +631,15 @@ lora_set_tx_power(int level)
  * @param frequency Frequency in Hz
  */
 void 
-lora_set_frequency(long frequency)
+lora_set_frequency(lora_dev_t *dev, long frequency)
 {
-   __frequency = frequency;
+   dev->frequency = frequency;
 
    uint64_t frf = ((uint64_t)frequency << 19) / 32000000;
 
-   lora_write_reg(REG_FRF_MSB, (uint8_t)(frf >> 16));
-   lora_write_reg(REG_FRF_MID, (uint8_t)(frf >> 8));
-   lora_write_reg(REG_FRF_LSB, (uint8_t)(frf >> 0));
+   lora_write_reg(dev, REG_FRF_MSB, (uint8_t)(frf >> 16));
+   lora_write_reg(dev, REG_FRF_MID, (uint8_t)(frf >> 8));
+   lora_write_reg(dev, REG_FRF_LSB, (uint8_t)(frf >> 0));
 }
 
 /**
@@ -216,20 +647,20 @@ lora_set_frequency(long frequency)
  * @param sf 6-12, Spreading factor to use.
  */
 void 
-lora_set_spreading_factor(int sf)
+lora_set_spreading_factor(lora_dev_t *dev, int sf)
 {
    if (sf < 6) sf = 6;
    else if (sf > 12) sf = 12;
 
    if (sf == 6) {
-      lora_write_reg(REG_DETECTION_OPTIMIZE, 0xc5);
-      lora_write_reg(REG_DETECTION_THRESHOLD, 0x0c);
+      lora_write_reg(dev, REG_DETECTION_OPTIMIZE, 0xc5);
+      lora_write_reg(dev, REG_DETECTION_THRESHOLD, 0x0c);
    } else {
-      lora_write_reg(REG_DETECTION_OPTIMIZE, 0xc3);
-      lora_write_reg(REG_DETECTION_THRESHOLD, 0x0a);
+      lora_write_reg(dev, REG_DETECTION_OPTIMIZE, 0xc3);
+      lora_write_reg(dev, REG_DETECTION_THRESHOLD, 0x0a);
    }
 
-   lora_write_reg(REG_MODEM_CONFIG_2, (lora_read_reg(REG_MODEM_CONFIG_2) & 0x0f) | ((sf << 4) & 0xf0));
+   lora_update_reg(dev, REG_MODEM_CONFIG_2, 0xf0, sf << 4);
 }
 
 /**
@@ -237,21 +668,9 @@ lora_set_spreading_factor(int sf)
  * @param sbw Bandwidth in Hz (up to 500000)
  */
 void 
-lora_set_bandwidth(long sbw)
+lora_set_bandwidth(lora_dev_t *dev, long sbw)
 {
-   int bw;
-
-   if (sbw <= 7.8E3) bw = 0;
-   else if (sbw <= 10.4E3) bw = 1;
-   else if (sbw <= 15.6E3) bw = 2;
-   else if (sbw <= 20.8E3) bw = 3;
-   else if (sbw <= 31.25E3) bw = 4;
-   else if (sbw <= 41.7E3) bw = 5;
-   else if (sbw <= 62.5E3) bw = 6;
-   else if (sbw <= 125E3) bw = 7;
-   else if (sbw <= 250E3) bw = 8;
-   else bw = 9;
-   lora_write_reg(REG_MODEM_CONFIG_1, (lora_read_reg(REG_MODEM_CONFIG_1) & 0x0f) | (bw << 4));
+   lora_update_reg(dev, REG_MODEM_CONFIG_1, 0xf0, lora_bandwidth_index(sbw) << 4);
 }
 
 /**
@@ -259,13 +678,13 @@ lora_set_bandwidth(long sbw)
  * @param denominator 5-8, Denominator for the coding rate 4/x
  */ 
 void 
-lora_set_coding_rate(int denominator)
+lora_set_coding_rate(lora_dev_t *dev, int denominator)
 {
    if (denominator < 5) denominator = 5;
    else if (denominator > 8) denominator = 8;
 
    int cr = denominator - 4;
-   lora_write_reg(REG_MODEM_CONFIG_1, (lora_read_reg(REG_MODEM_CONFIG_1) & 0xf1) | (cr << 1));
+   lora_update_reg(dev, REG_MODEM_CONFIG_1, 0x0e, cr << 1);
 }
 
 /**
@@ -273,10 +692,10 @@ lora_set_coding_rate(int denominator)
  * @param length Preamble length in symbols.
  */
 void 
-lora_set_preamble_length(long length)
+lora_set_preamble_length(lora_dev_t *dev, long length)
 {
-   lora_write_reg(REG_PREAMBLE_MSB, (uint8_t)(length >> 8));
-   lora_write_reg(REG_PREAMBLE_LSB, (uint8_t)(length >> 0));
+   lora_write_reg(dev, REG_PREAMBLE_MSB, (uint8_t)(length >> 8));
+   lora_write_reg(dev, REG_PREAMBLE_LSB, (uint8_t)(length >> 0));
 }
 
 /**
@@ -284,72 +703,137 @@ lora_set_preamble_length(long length)
  * @param sw New sync word to use.
  */
 void 
-lora_set_sync_word(int sw)
+lora_set_sync_word(lora_dev_t *dev, int sw)
 {
-   lora_write_reg(REG_SYNC_WORD, sw);
+   lora_write_reg(dev, REG_SYNC_WORD, sw);
 }
 
 /**
  * Enable appending/verifying packet CRC.
  */
 void 
-lora_enable_crc(void)
+lora_enable_crc(lora_dev_t *dev)
 {
-   lora_write_reg(REG_MODEM_CONFIG_2, lora_read_reg(REG_MODEM_CONFIG_2) | 0x04);
+   lora_update_reg(dev, REG_MODEM_CONFIG_2, 0x04, 0x04);
 }
 
 /**
  * Disable appending/verifying packet CRC.
  */
 void 
-lora_disable_crc(void)
+lora_disable_crc(lora_dev_t *dev)
 {
-   lora_write_reg(REG_MODEM_CONFIG_2, lora_read_reg(REG_MODEM_CONFIG_2) & 0xfb);
+   lora_update_reg(dev, REG_MODEM_CONFIG_2, 0x04, 0x00);
+}
+
+/**
+ * Apply a complete modem configuration.
+ * All register values are computed from the profile and the shadow,
+ * then only the ones that differ are written, joined into bursts.
+ * Applying the boot profile takes three SPI transactions and no reads,
+ * a frequency hop three and an unchanged profile none. When something
+ * changes the radio goes through standby and back to continuous
+ * receive if it was there, so this can run between packets.
+ * @param profile Configuration to apply.
+ */
+void
+lora_apply_profile(lora_dev_t *dev, const lora_profile_t *profile)
+{
+   uint8_t stage[SHADOW_SIZE];
+   uint64_t staged = 0;
+   int rx = dev->rx_continuous;
+
+   int sf = profile->spreading_factor;
+   if (sf < 6) sf = 6;
+   else if (sf > 12) sf = 12;
+   int cr = profile->coding_rate;
+   if (cr < 5) cr = 5;
+   else if (cr > 8) cr = 8;
+   int bw = lora_bandwidth_index(profile->bandwidth);
+   uint64_t frf = ((uint64_t)profile->frequency << 19) / 32000000;
+
+   int ldro;
+   if (profile->ldro == LORA_LDRO_AUTO) ldro = (1000L << sf) > LDRO_SYMBOL_MS * __bandwidths[bw];
+   else ldro = profile->ldro == LORA_LDRO_ON;
+
+#define STAGE(reg, val) do { stage[reg] = (val); staged |= SHADOW_BIT(reg); } while(0)
+   STAGE(REG_FRF_MSB, frf >> 16);
+   STAGE(REG_FRF_MID, frf >> 8);
+   STAGE(REG_FRF_LSB, frf >> 0);
+   STAGE(REG_MODEM_CONFIG_1, (bw << 4) | ((cr - 4) << 1) | (profile->implicit_len ? 0x01 : 0x00));
+   STAGE(REG_MODEM_CONFIG_2, (lora_read_shadow(dev, REG_MODEM_CONFIG_2) & 0x0b) | (sf << 4) | (profile->crc ? 0x04 : 0x00));
+   STAGE(REG_PREAMBLE_MSB, profile->preamble_length >> 8);
+   STAGE(REG_PREAMBLE_LSB, profile->preamble_length >> 0);
+   if (profile->implicit_len) STAGE(REG_PAYLOAD_LENGTH, profile->implicit_len);
+   STAGE(REG_MODEM_CONFIG_3, (lora_read_shadow(dev, REG_MODEM_CONFIG_3) & ~0x08) | (ldro ? 0x08 : 0x00));
+   STAGE(REG_DETECTION_OPTIMIZE, sf == 6 ? 0xc5 : 0xc3);
+   STAGE(REG_DETECTION_THRESHOLD, sf == 6 ? 0x0c : 0x0a);
+   STAGE(REG_SYNC_WORD, profile->sync_word);
+#undef STAGE
+
+   dev->frequency = profile->frequency;
+   dev->implicit = profile->implicit_len != 0;
+
+   uint64_t changed = lora_staged_changes(dev, stage, staged);
+   if(changed == 0) return;
+   lora_idle(dev);
+   lora_write_staged(dev, stage, staged, changed);
+   if(rx) lora_receive_continuous(dev);
 }
 
 /**
  * Perform hardware initialization.
+ * Radios may share an SPI host, each with its own chip select; the bus
+ * is set up by the first one and the driver serializes their transfers.
+ * @param dev Radio handle to initialize.
+ * @param config Bus and pins of this radio.
+ * @return 1 on success, 0 if the radio did not answer.
  */
 int 
-lora_init(void)
+lora_init(lora_dev_t *dev, const lora_config_t *config)
 {
    esp_err_t ret;
 
+   memset(dev, 0, sizeof(*dev));
+   dev->rst = config->rst;
+   dev->dio0 = config->dio0;
+   dev->rx_next_addr = -1;
+   dev->rx_header_count = -1;
+   dev->irq_lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+
    /*
     * Configure CPU hardware to communicate with the radio chip
     */
-   gpio_reset_pin(CONFIG_RST_GPIO);
-   gpio_set_direction(CONFIG_RST_GPIO, GPIO_MODE_OUTPUT);
-   gpio_reset_pin(CONFIG_CS_GPIO);
-   gpio_set_direction(CONFIG_CS_GPIO, GPIO_MODE_OUTPUT);
+   gpio_reset_pin(dev->rst);
+   gpio_set_direction(dev->rst, GPIO_MODE_OUTPUT);
 
    spi_bus_config_t bus = {
-      .miso_io_num = CONFIG_MISO_GPIO,
-      .mosi_io_num = CONFIG_MOSI_GPIO,
-      .sclk_io_num = CONFIG_SCK_GPIO,
+      .miso_io_num = config->miso,
+      .mosi_io_num = config->mosi,
+      .sclk_io_num = config->sck,
       .quadwp_io_num = -1,
       .quadhd_io_num = -1,
-      .max_transfer_sz = 0
+      .max_transfer_sz = LORA_FIFO_SIZE
    };
            
-   ret = spi_bus_initialize(VSPI_HOST, &bus, 0);
-   assert(ret == ESP_OK);
+   ret = spi_bus_initialize(config->host, &bus, SPI_DMA_CH_AUTO);
+   assert(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE);   // already initialized by another radio
 
-   spi_device_interface_config_t dev = {
+   spi_device_interface_config_t spi = {
       .clock_speed_hz = 9000000,
       .mode = 0,
-      .spics_io_num = -1,
+      .spics_io_num = config->cs,
       .queue_size = 1,
       .flags = 0,
       .pre_cb = NULL
    };
-   ret = spi_bus_add_device(VSPI_HOST, &dev, &__spi);
+   ret = spi_bus_add_device(config->host, &spi, &dev->spi);
    assert(ret == ESP_OK);
 
    /*
     * Perform hardware reset.
     */
-   lora_reset();
+   lora_reset(dev);
 
    /*
     * Check version.
@@ -357,23 +841,28 @@ lora_init(void)
    uint8_t version;
    uint8_t i = 0;
    while(i++ < TIMEOUT_RESET) {
-      version = lora_read_reg(REG_VERSION);
+      version = lora_read_reg(dev, REG_VERSION);
       if(version == 0x12) break;
       vTaskDelay(2);
    }
-   assert(i <= TIMEOUT_RESET + 1); // at the end of the loop above, the max value i can reach is TIMEOUT_RESET + 1
+   if(version != 0x12) return 0;
 
    /*
     * Default configuration.
     */
-   lora_sleep();
-   lora_write_reg(REG_FIFO_RX_BASE_ADDR, 0);
-   lora_write_reg(REG_FIFO_TX_BASE_ADDR, 0);
-   lora_write_reg(REG_LNA, lora_read_reg(REG_LNA) | 0x03);
-   lora_write_reg(REG_MODEM_CONFIG_3, 0x04);
-   lora_set_tx_power(17);
-
-   lora_idle();
+   lora_sleep(dev);
+   lora_shadow_load(dev);
+   lora_write_reg(dev, REG_FIFO_RX_BASE_ADDR, 0);
+   lora_write_reg(dev, REG_FIFO_TX_BASE_ADDR, 0);
+   lora_update_reg(dev, REG_LNA, 0x03, 0x03);
+   lora_write_reg(dev, REG_MODEM_CONFIG_3, 0x04);
+   dev->dio_mapping = -1;
+   lora_set_dio_mapping(dev, DIO_MAPPING_RX);   // DIO0 = RxDone / TxDone
+   lora_set_tx_power(dev, 17);
+
+   lora_dio0_init(dev);
+
+   lora_idle(dev);
    return 1;
 }
 
@@ -383,27 +872,116 @@ lora_init(void)
  * @param size Size of data.
  */
 void 
-lora_send_packet(uint8_t *buf, int size)
+lora_send_packet(lora_dev_t *dev, uint8_t *buf, int size)
 {
    /*
     * Transfer data to radio.
     */
-   lora_idle();
-   lora_write_reg(REG_FIFO_ADDR_PTR, 0);
-
-   for(int i=0; i<size; i++) 
-      lora_write_reg(REG_FIFO, *buf++);
+   lora_idle(dev);
+   lora_write_reg(dev, REG_FIFO_ADDR_PTR, 0);
+   lora_write_fifo(dev, buf, size);
    
-   lora_write_reg(REG_PAYLOAD_LENGTH, size);
+   lora_write_reg(dev, REG_PAYLOAD_LENGTH, size);
    
    /*
     * Start transmission and wait for conclusion.
     */
-   lora_write_reg(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
-   while((lora_read_reg(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK) == 0)
+   lora_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
+   while((lora_read_reg(dev, REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK) == 0)
       vTaskDelay(2);
 
-   lora_write_reg(REG_IRQ_FLAGS, IRQ_TX_DONE_MASK);
+   lora_write_reg(dev, REG_IRQ_FLAGS, IRQ_TX_DONE_MASK);
+}
+
+/**
+ * Decode the packet status registers into info.
+ * @param regs RX_STATUS_LEN registers starting at RX_STATUS_FIRST.
+ * @param info Destination for the metadata.
+ */
+static void
+lora_decode_packet_info(lora_dev_t *dev, const uint8_t *regs, lora_packet_info_t *info)
+{
+   int8_t snr = (int8_t)RX_STATUS(regs, REG_PKT_SNR_VALUE);
+   int packet_rssi = RX_STATUS(regs, REG_PKT_RSSI_VALUE);
+   int rssi = -(dev->frequency < 868E6 ? 164 : 157);
+   int irq = RX_STATUS(regs, REG_IRQ_FLAGS);
+   int bw = RX_STATUS(regs, REG_MODEM_CONFIG_1) >> 4;
+
+   /*
+    * Datasheet 5.5.5: above the noise floor PacketRssi is scaled by 16/15.
+    * Below it the register reads the noise, so the (negative) SNR in
+    * quarter dB is added to get the signal strength. Both rounded.
+    */
+   if(snr >= 0) rssi += (packet_rssi * 16 + 7) / 15;
+   else rssi += packet_rssi - (-snr + 2) / 4;
+   info->rssi = rssi;
+   info->snr = snr * 0.25;
+
+   /*
+    * FEI is a signed 20-bit value: Ferr = FEI * 2^24 / Fxtal * BW / 500 kHz
+    */
+   int32_t fei = ((RX_STATUS(regs, REG_FEI_MSB) & 0x0f) << 16) |
+                 (RX_STATUS(regs, REG_FEI_MID) << 8) |
+                 RX_STATUS(regs, REG_FEI_LSB);
+   if(fei & 0x80000) fei -= 0x100000;
+   if(bw > 9) bw = 9;
+   info->freq_error = (int32_t)((int64_t)fei * (1 << 24) * __bandwidths[bw] / (32000000LL * 500000));
+
+   info->crc_on = (RX_STATUS(regs, REG_HOP_CHANNEL) & 0x40) != 0;
+   info->crc_error = (irq & IRQ_PAYLOAD_CRC_ERROR_MASK) != 0;
+   info->coding_rate = (RX_STATUS(regs, REG_MODEM_STAT) >> 5) + 4;
+   info->len = dev->implicit ? RX_STATUS(regs, REG_PAYLOAD_LENGTH) : RX_STATUS(regs, REG_RX_NB_BYTES);
+}
+
+/**
+ * Update the receive counters with the packet status just read.
+ * @param regs RX_STATUS_LEN registers starting at RX_STATUS_FIRST.
+ * @param info Decoded metadata of the packet.
+ */
+static void
+lora_account_packet(lora_dev_t *dev, const uint8_t *regs, const lora_packet_info_t *info)
+{
+   int headers = (RX_STATUS(regs, REG_RX_HEADER_CNT_MSB) << 8) | RX_STATUS(regs, REG_RX_HEADER_CNT_LSB);
+   int in_flight = (RX_STATUS(regs, REG_MODEM_STAT) & MODEM_STAT_HEADER_VALID) != 0;
+   int addr = RX_STATUS(regs, REG_FIFO_RX_CURRENT_ADDR);
+
+   dev->rx_stats.received++;
+   if(info->crc_error) dev->rx_stats.crc_errors++;
+
+   /*
+    * Every valid header should end in one RxDone we service. A header
+    * counted for a packet still in the air belongs to the next read.
+    */
+   if(dev->rx_header_count >= 0) {
+      int headers_new = ((headers - dev->rx_header_count) & 0xffff) + dev->rx_header_pending - in_flight;
+      if(headers_new > 1) dev->rx_stats.dropped += headers_new - 1;
+   }
+   dev->rx_header_count = headers;
+   dev->rx_header_pending = in_flight;
+
+   /*
+    * In continuous mode each packet starts where the previous one ended.
+    */
+   if(dev->rx_continuous) {
+      if(dev->rx_next_addr >= 0 && addr != dev->rx_next_addr) dev->rx_stats.fifo_gaps++;
+      if(addr + info->len > LORA_FIFO_SIZE) dev->rx_stats.fifo_wraps++;
+      dev->rx_next_addr = (addr + info->len) & (LORA_FIFO_SIZE - 1);
+   }
+}
+
+/**
+ * Read and clear the stamp of the last RxDone interrupt, 0 if none.
+ */
+static int64_t
+lora_take_irq_time(lora_dev_t *dev)
+{
+   int64_t irq_time;
+
+   portENTER_CRITICAL(&dev->irq_lock);
+   irq_time = dev->irq_time;
+   dev->irq_time = 0;
+   portEXIT_CRITICAL(&dev->irq_lock);
+   return irq_time;
 }
 
 /**
@@ -413,32 +991,74 @@ lora_send_packet(uint8_t *buf, int size)
  * @return Number of bytes received (zero if no packet available).
  */
 int 
-lora_receive_packet(uint8_t *buf, int size)
+lora_receive_packet(lora_dev_t *dev, uint8_t *buf, int size)
+{
+   return lora_receive_packet_info(dev, buf, size, NULL);
+}
+
+/**
+ * Read a received packet together with its radio metadata.
+ * IRQ flags, length, FIFO address, SNR, RSSI, header info and FEI are
+ * taken from a single burst read before the modem leaves RX, so they
+ * belong to this packet and cost one SPI transaction.
+ * @param buf Buffer for the data.
+ * @param size Available size in buffer (bytes).
+ * @param info Destination for the metadata, may be NULL. Filled in also
+ *             when the packet is dropped on a CRC error.
+ * @return Number of bytes received (zero if no packet available).
+ */
+int 
+lora_receive_packet_info(lora_dev_t *dev, uint8_t *buf, int size, lora_packet_info_t *info)
 {
+   uint8_t regs[RX_STATUS_LEN];
+   lora_packet_info_t local;
+   int64_t now = esp_timer_get_time();
+   int64_t irq_time;
    int len = 0;
 
+   if(info == NULL) info = &local;
+   memset(info, 0, sizeof(*info));
+
    /*
-    * Check interrupts.
+    * Take the RxDone stamp once. In continuous RX the next packet can
+    * interrupt while this one is read and leaves its own stamp for the
+    * next call.
     */
-   int irq = lora_read_reg(REG_IRQ_FLAGS);
-   lora_write_reg(REG_IRQ_FLAGS, irq);
-   if((irq & IRQ_RX_DONE_MASK) == 0) return 0;
-   if(irq & IRQ_PAYLOAD_CRC_ERROR_MASK) return 0;
+   irq_time = lora_take_irq_time(dev);
 
    /*
-    * Find packet size.
+    * Check interrupts and latch the packet status.
     */
-   if (__implicit) len = lora_read_reg(REG_PAYLOAD_LENGTH);
-   else len = lora_read_reg(REG_RX_NB_BYTES);
+   lora_read_burst(dev, RX_STATUS_FIRST, regs, RX_STATUS_LEN);
+   int irq = RX_STATUS(regs, REG_IRQ_FLAGS);
+   lora_write_reg(dev, REG_IRQ_FLAGS, irq);
+   if((irq & IRQ_RX_DONE_MASK) == 0) return 0;
+   if(!irq_time) irq_time = lora_take_irq_time(dev);   // RxDone raised after the stamp was taken
+
+   lora_decode_packet_info(dev, regs, info);
+   info->timestamp_us = irq_time ? irq_time : now;
+   lora_account_packet(dev, regs, info);
+   if(info->crc_error) return 0;
 
    /*
     * Transfer data from radio.
     */
-   lora_idle();   
-   lora_write_reg(REG_FIFO_ADDR_PTR, lora_read_reg(REG_FIFO_RX_CURRENT_ADDR));
+   len = info->len;
+   if(!dev->rx_continuous) lora_idle(dev);
+   lora_write_reg(dev, REG_FIFO_ADDR_PTR, RX_STATUS(regs, REG_FIFO_RX_CURRENT_ADDR));
    if(len > size) len = size;
-   for(int i=0; i<len; i++) 
-      *buf++ = lora_read_reg(REG_FIFO);
+   lora_read_fifo(dev, buf, len);   // the 8-bit FIFO pointer wraps past 0xff by itself
+
+   /*
+    * Account time since the RxDone interrupt.
+    */
+   if(irq_time) {
+      int64_t latency = esp_timer_get_time() - irq_time;
+      dev->irq_stats.count++;
+      dev->irq_stats.last_us = latency;
+      dev->irq_stats.total_us += latency;
+      if(latency > dev->irq_stats.max_us) dev->irq_stats.max_us = latency;
+   }
 
    return len;
 }
@@ -447,52 +1067,229 @@ lora_receive_packet(uint8_t *buf, int size)
  * Returns non-zero if there is data to read (packet received).
  */
 int
-lora_received(void)
+lora_received(lora_dev_t *dev)
 {
-   if(lora_read_reg(REG_IRQ_FLAGS) & IRQ_RX_DONE_MASK) return 1;
+   if(lora_read_reg(dev, REG_IRQ_FLAGS) & IRQ_RX_DONE_MASK) return 1;
    return 0;
 }
 
+/**
+ * Returns non-zero while the modem is synchronized on a packet that has
+ * not completed yet (preamble or header seen, RxDone not raised).
+ */
+int
+lora_rx_busy(lora_dev_t *dev)
+{
+   return (lora_read_reg(dev, REG_MODEM_STAT) &
+           (MODEM_STAT_SIGNAL_SYNC | MODEM_STAT_RX_ONGOING | MODEM_STAT_HEADER_VALID)) != 0;
+}
+
+/**
+ * Start a Channel Activity Detection with the current configuration
+ * and return at once. The radio listens for about two symbols, raises
+ * CadDone on DIO0 (CadDetected on DIO1) and goes back to standby.
+ * The DIO0 interrupt wakes the task that called this function.
+ */
+void
+lora_cad_start(lora_dev_t *dev)
+{
+   lora_idle(dev);
+   lora_set_dio_mapping(dev, DIO_MAPPING_CAD);
+   lora_write_reg(dev, REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+   dev->rx_task = xTaskGetCurrentTaskHandle();
+   dev->cad_done_time = 0;
+   dev->cad_start_time = esp_timer_get_time();
+   dev->cad_active = 1;
+   lora_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_CAD);
+}
+
+/**
+ * Result of the CAD started by lora_cad_start(), without blocking.
+ * @return 1 if a LoRa preamble was detected, 0 if not, -1 while the
+ *         detection is still running.
+ */
+int
+lora_cad_result(lora_dev_t *dev)
+{
+   int irq = lora_read_reg(dev, REG_IRQ_FLAGS);
+
+   if((irq & IRQ_CAD_DONE_MASK) == 0) return -1;
+   if(dev->cad_done_time == 0) dev->cad_done_time = esp_timer_get_time();
+   lora_write_reg(dev, REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+   dev->cad_active = 0;
+   return (irq & IRQ_CAD_DETECTED_MASK) != 0;
+}
+
+/**
+ * Run one Channel Activity Detection and wait for it.
+ * Sleeps on the DIO0 interrupt when wired, otherwise polls once per tick.
+ * @param timeout_ms Give up if CadDone is not raised within this time.
+ * @return 1 if a LoRa preamble was detected, 0 if not, -1 on timeout.
+ */
+int
+lora_cad(lora_dev_t *dev, int timeout_ms)
+{
+   TickType_t start = xTaskGetTickCount();
+   TickType_t timeout = pdMS_TO_TICKS(timeout_ms) + 1;
+   int result;
+
+   lora_cad_start(dev);
+   while((result = lora_cad_result(dev)) < 0) {
+      TickType_t elapsed = xTaskGetTickCount() - start;
+      if(elapsed >= timeout) {
+         lora_idle(dev);
+         return -1;
+      }
+      if(dev->dio0_enabled) ulTaskNotifyTake(pdTRUE, timeout - elapsed);
+      else vTaskDelay(1);
+   }
+   return result;
+}
+
+/**
+ * Time from lora_cad_start() to CadDone of the last detection, taken
+ * from the DIO0 interrupt when wired.
+ */
+uint32_t
+lora_cad_last_us(lora_dev_t *dev)
+{
+   return dev->cad_done_time ? (uint32_t)(dev->cad_done_time - dev->cad_start_time) : 0;
+}
+
+/**
+ * Measure how long a CAD takes with the current configuration, from
+ * entering CAD mode to CadDone. Each run sleeps in lora_cad(), so other
+ * tasks keep the CPU; CadDone is stamped by the DIO0 interrupt when wired,
+ * otherwise the result is rounded up to the tick. The average is kept per
+ * SF and bandwidth and returned by lora_cad_duration_us() from then on.
+ * @param runs Number of detections.
+ * @param timing Destination for the measurement.
+ */
+void
+lora_cad_measure(lora_dev_t *dev, int runs, lora_cad_timing_t *timing)
+{
+   int sf = lora_read_shadow(dev, REG_MODEM_CONFIG_2) >> 4;
+   int bw = lora_read_shadow(dev, REG_MODEM_CONFIG_1) >> 4;
+   uint64_t total = 0;
+
+   memset(timing, 0, sizeof(*timing));
+   timing->spreading_factor = sf;
+   timing->bandwidth = __bandwidths[bw > 9 ? 9 : bw];
+   timing->symbol_us = (uint32_t)((1000000ULL << sf) / timing->bandwidth);
+   timing->min_us = UINT32_MAX;
+
+   for(int i = 0; i < runs; i++) {
+      int result = lora_cad(dev, (4 * timing->symbol_us + 10000) / 1000);
+
+      if(result < 0) {
+         timing->timeouts++;
+         continue;
+      }
+      uint32_t us = lora_cad_last_us(dev);
+      timing->runs++;
+      timing->detected += result;
+      total += us;
+      if(us < timing->min_us) timing->min_us = us;
+      if(us > timing->max_us) timing->max_us = us;
+   }
+   if(timing->runs == 0) {
+      timing->min_us = 0;
+      return;
+   }
+   timing->avg_us = total / timing->runs;
+   if(sf >= 6 && sf <= 12 && bw <= 9) dev->cad_us[sf - 6][bw] = timing->avg_us;
+}
+
+/**
+ * Expected CAD duration with the current configuration: the measured
+ * average if lora_cad_measure() ran for this SF and bandwidth, else two
+ * symbols.
+ */
+uint32_t
+lora_cad_duration_us(lora_dev_t *dev)
+{
+   int sf = lora_read_shadow(dev, REG_MODEM_CONFIG_2) >> 4;
+   int bw = lora_read_shadow(dev, REG_MODEM_CONFIG_1) >> 4;
+
+   if(sf < 6 || sf > 12 || bw > 9) return 0;
+   if(dev->cad_us[sf - 6][bw]) return dev->cad_us[sf - 6][bw];
+   return (uint32_t)((2000000ULL << sf) / __bandwidths[bw]);
+}
+
+/**
+ * Duration of one symbol.
+ * @param profile Modem configuration.
+ * @return Symbol time in microseconds.
+ */
+uint32_t
+lora_symbol_us(const lora_profile_t *profile)
+{
+   return (uint32_t)((1000000ULL << profile->spreading_factor) / __bandwidths[lora_bandwidth_index(profile->bandwidth)]);
+}
+
+/**
+ * Time on air of a packet, from the Semtech SX127x datasheet formula.
+ * @param profile Modem configuration.
+ * @param len Payload length in bytes.
+ * @return Airtime in microseconds, preamble included.
+ */
+uint32_t
+lora_airtime_us(const lora_profile_t *profile, int len)
+{
+   int sf = profile->spreading_factor;
+   int bw = lora_bandwidth_index(profile->bandwidth);
+   uint32_t symbol = lora_symbol_us(profile);
+   int ldro = profile->ldro == LORA_LDRO_ON ||
+              (profile->ldro == LORA_LDRO_AUTO && (1000L << sf) > LDRO_SYMBOL_MS * __bandwidths[bw]);
+   int bits = 8 * len - 4 * sf + 28 + (profile->crc ? 16 : 0) - (profile->implicit_len ? 20 : 0);
+   int per_block = 4 * (sf - (ldro ? 2 : 0));
+   int blocks = bits > 0 ? (bits + per_block - 1) / per_block : 0;
+   int payload_symbols = 8 + blocks * profile->coding_rate;
+
+   // Preamble plus 4.25 sync symbols, counted in quarter symbols
+   return ((profile->preamble_length * 4 + 17) * symbol) / 4 + payload_symbols * symbol;
+}
+
 /**
  * Return last packet's RSSI.
  */
 int 
-lora_packet_rssi(void)
+lora_packet_rssi(lora_dev_t *dev)
 {
-   return (lora_read_reg(REG_PKT_RSSI_VALUE) - (__frequency < 868E6 ? 164 : 157));
+   return (lora_read_reg(dev, REG_PKT_RSSI_VALUE) - (dev->frequency < 868E6 ? 164 : 157));
 }
 
 /**
  * Return last packet's SNR (signal to noise ratio).
  */
 float 
-lora_packet_snr(void)
+lora_packet_snr(lora_dev_t *dev)
 {
-   return ((int8_t)lora_read_reg(REG_PKT_SNR_VALUE)) * 0.25;
+   return ((int8_t)lora_read_reg(dev, REG_PKT_SNR_VALUE)) * 0.25;
 }
 
 /**
  * Shutdown hardware.
  */
 void 
-lora_close(void)
+lora_close(lora_dev_t *dev)
 {
-   lora_sleep();
-//   close(__spi);  FIXME: end hardware features after lora_close
+   lora_sleep(dev);
+//   close(dev->spi);  FIXME: end hardware features after lora_close
 //   close(__cs);
 //   close(__rst);
-//   __spi = -1;
+//   dev->spi = -1;
 //   __cs = -1;
 //   __rst = -1;
 }
 
 void 
-lora_dump_registers(void)
+lora_dump_registers(lora_dev_t *dev)
 {
    int i;
    printf("00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\n");
    for(i=0; i<0x40; i++) {
-      printf("%02X ", lora_read_reg(i));
+      printf("%02X ", lora_read_reg(dev, i));
       if((i & 0x0f) == 0x0f) printf("\n");
    }
    printf("\n");
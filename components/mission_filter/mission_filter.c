@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "mission_filter.h"
+
+#define MISSION_NAMESPACE "missions"
+#define MISSION_RULES_KEY "rules"
+#define MISSION_NODES_MAX (1 + MISSION_RULES_MAX * MISSION_PREFIX_MAX)
+
+static const char *TAG = "MISSION";
+
+// Prefix trie flattened into an array. The children of a node are
+// contiguous and sorted by byte; the root's are reached through a jump
+// table on the first byte, so a lookup costs one step per prefix byte
+// whatever the number of rules.
+typedef struct {
+    uint16_t child_start;
+    uint8_t child_count;
+    uint8_t byte;        // Edge from the parent
+    uint8_t rule_start;  // In node_rules, rules whose prefix ends here
+    uint8_t rule_count;
+} mission_node_t;
+
+// Stored in NVS as is
+typedef struct {
+    uint32_t count;
+    mission_rule_t rules[MISSION_RULES_MAX];
+} mission_rules_t;
+
+static const char *action_names[MISSION_ACTIONS] = {
+    [MISSION_UPLOAD] = "upload",
+    [MISSION_STORE] = "store",
+    [MISSION_DISPLAY] = "display",
+    [MISSION_DROP] = "drop",
+};
+
+static SemaphoreHandle_t lock; // RX tasks match while the console edits
+static mission_rules_t table;
+static mission_node_t nodes[MISSION_NODES_MAX];
+static int node_count;
+static uint8_t node_rules[MISSION_RULES_MAX];
+static int node_rules_count;
+static uint16_t jump[256]; // Root child by first byte, 0 for none
+static _Atomic uint32_t hits[MISSION_RULES_MAX];
+static char endpoints[MISSION_ENDPOINTS][MISSION_URL_MAX];
+
+// Fill node for the rules in set, in table order, which share their first
+// depth bytes. Children are allocated together before recursing into them.
+static void mission_compile_node(int node, const uint8_t *set, int n, int depth) {
+    uint8_t rest[MISSION_RULES_MAX];
+    int rest_count = 0;
+    nodes[node].rule_start = node_rules_count;
+    for (int i = 0; i < n; i++) {
+        if (table.rules[set[i]].prefix_len == depth) {
+            node_rules[node_rules_count++] = set[i];
+        } else {
+            rest[rest_count++] = set[i];
+        }
+    }
+    nodes[node].rule_count = node_rules_count - nodes[node].rule_start;
+
+    // Distinct next bytes in ascending order
+    uint8_t bytes[MISSION_RULES_MAX];
+    int byte_count = 0;
+    for (int i = 0; i < rest_count; i++) {
+        uint8_t b = table.rules[rest[i]].prefix[depth];
+        int j = byte_count;
+        while (j > 0 && bytes[j - 1] > b) {
+            j--;
+        }
+        if (j > 0 && bytes[j - 1] == b) {
+            continue;
+        }
+        memmove(&bytes[j + 1], &bytes[j], byte_count - j);
+        bytes[j] = b;
+        byte_count++;
+    }
+    nodes[node].child_start = node_count;
+    nodes[node].child_count = byte_count;
+    node_count += byte_count;
+
+    for (int c = 0; c < byte_count; c++) {
+        uint8_t subset[MISSION_RULES_MAX];
+        int subset_count = 0;
+        for (int i = 0; i < rest_count; i++) {
+            if (table.rules[rest[i]].prefix[depth] == bytes[c]) {
+                subset[subset_count++] = rest[i];
+            }
+        }
+        int child = nodes[node].child_start + c;
+        nodes[child].byte = bytes[c];
+        mission_compile_node(child, subset, subset_count, depth + 1);
+    }
+}
+
+// Rebuild the trie from table, the caller holds lock
+static void mission_compile() {
+    uint8_t all[MISSION_RULES_MAX];
+    for (int i = 0; i < table.count; i++) {
+        all[i] = i;
+    }
+    memset(jump, 0, sizeof(jump));
+    node_count = 1;
+    node_rules_count = 0;
+    mission_compile_node(0, all, table.count, 0);
+    for (int c = 0; c < nodes[0].child_count; c++) {
+        int child = nodes[0].child_start + c;
+        jump[nodes[child].byte] = child;
+    }
+}
+
+static int mission_child(const mission_node_t *node, uint8_t byte) {
+    int lo = node->child_start;
+    int hi = node->child_start + node->child_count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (nodes[mid].byte == byte) {
+            return mid;
+        }
+        if (nodes[mid].byte < byte) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return 0;
+}
+
+static bool mission_accepts(const mission_rule_t *rule, const uint8_t *payload, size_t len) {
+    if (len < rule->min_len || len > rule->max_len) {
+        return false;
+    }
+    if (rule->mask_len > 0) {
+        if (rule->mask_offset + rule->mask_len > len) {
+            return false;
+        }
+        for (int i = 0; i < rule->mask_len; i++) {
+            if ((payload[rule->mask_offset + i] & rule->mask[i]) != rule->value[i]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static esp_err_t mission_save() {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(MISSION_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, MISSION_RULES_KEY, &table,
+                       offsetof(mission_rules_t, rules) + table.count * sizeof(mission_rule_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+esp_err_t mission_filter_init(const char *default_url) {
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    strlcpy(endpoints[0], default_url, sizeof(endpoints[0]));
+
+    nvs_handle_t nvs;
+    size_t size = sizeof(table);
+    esp_err_t err = nvs_open(MISSION_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, MISSION_RULES_KEY, &table, &size);
+        for (int i = 1; i < MISSION_ENDPOINTS; i++) {
+            char key[8];
+            size_t url_size = sizeof(endpoints[i]);
+            snprintf(key, sizeof(key), "ep%d", i);
+            if (nvs_get_str(nvs, key, endpoints[i], &url_size) != ESP_OK) {
+                endpoints[i][0] = '\0';
+            }
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK || size != offsetof(mission_rules_t, rules) + table.count * sizeof(mission_rule_t) ||
+        table.count > MISSION_RULES_MAX) {
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "Stored rules unusable (%s), using the defaults", esp_err_to_name(err));
+        }
+        // PlatziSat-1 beacons start with FO014, the only frames accepted before the table
+        memset(&table, 0, sizeof(table));
+        mission_rule_t *rule = &table.rules[0];
+        strlcpy(rule->name, "platzisat1", sizeof(rule->name));
+        memcpy(rule->prefix, "FO014", 5);
+        rule->prefix_len = 5;
+        rule->min_len = 5;
+        rule->max_len = UINT16_MAX;
+        rule->action = MISSION_UPLOAD;
+        table.count = 1;
+    }
+    mission_compile();
+    ESP_LOGI(TAG, "%"PRIu32" rules, %d trie nodes", table.count, node_count);
+    return ESP_OK;
+}
+
+void mission_filter_match(const uint8_t *payload, size_t len, mission_route_t *route) {
+    int path[MISSION_PREFIX_MAX + 1];
+    int depth = 0;
+
+    route->rule = -1;
+    route->action = MISSION_DROP;
+    route->endpoint = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    path[0] = 0;
+    int node = len > 0 ? jump[payload[0]] : 0;
+    while (node != 0) {
+        path[++depth] = node;
+        if (depth == len || depth == MISSION_PREFIX_MAX) {
+            break;
+        }
+        node = mission_child(&nodes[node], payload[depth]);
+    }
+    // Deepest node first, the longest prefix is the most specific rule
+    for (; depth >= 0 && route->rule < 0; depth--) {
+        const mission_node_t *n = &nodes[path[depth]];
+        for (int i = 0; i < n->rule_count; i++) {
+            int r = node_rules[n->rule_start + i];
+            if (mission_accepts(&table.rules[r], payload, len)) {
+                route->rule = r;
+                route->action = table.rules[r].action;
+                route->endpoint = table.rules[r].endpoint;
+                atomic_fetch_add_explicit(&hits[r], 1, memory_order_relaxed);
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+esp_err_t mission_filter_set(const mission_rule_t *rule) {
+    if (rule->name[0] == '\0' || rule->prefix_len > MISSION_PREFIX_MAX || rule->mask_len > MISSION_MASK_MAX ||
+        rule->min_len > rule->max_len || rule->action >= MISSION_ACTIONS || rule->endpoint >= MISSION_ENDPOINTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t index = 0;
+    while (index < table.count && strcmp(table.rules[index].name, rule->name) != 0) {
+        index++;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (index < MISSION_RULES_MAX) {
+        if (index == table.count) {
+            table.count++;
+        }
+        table.rules[index] = *rule;
+        atomic_store_explicit(&hits[index], 0, memory_order_relaxed);
+        mission_compile();
+        err = mission_save();
+    }
+    xSemaphoreGive(lock);
+    return err;
+}
+
+esp_err_t mission_filter_remove(const char *name) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    for (uint32_t i = 0; i < table.count; i++) {
+        if (strcmp(table.rules[i].name, name) != 0) {
+            continue;
+        }
+        for (uint32_t j = i; j + 1 < table.count; j++) {
+            table.rules[j] = table.rules[j + 1];
+            atomic_store_explicit(&hits[j], atomic_load_explicit(&hits[j + 1], memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        table.count--;
+        mission_compile();
+        err = mission_save();
+        break;
+    }
+    xSemaphoreGive(lock);
+    return err;
+}
+
+int mission_filter_count() {
+    return table.count;
+}
+
+bool mission_filter_get(int index, mission_rule_t *rule, uint32_t *rule_hits) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = index >= 0 && index < table.count;
+    if (found) {
+        *rule = table.rules[index];
+        *rule_hits = atomic_load_explicit(&hits[index], memory_order_relaxed);
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+esp_err_t mission_filter_set_endpoint(int index, const char *url) {
+    if (index <= 0 || index >= MISSION_ENDPOINTS || strlen(url) >= MISSION_URL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "ep%d", index);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    strlcpy(endpoints[index], url, sizeof(endpoints[index]));
+    xSemaphoreGive(lock);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(MISSION_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = url[0] ? nvs_set_str(nvs, key, url) : nvs_erase_key(nvs, key);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+bool mission_filter_get_endpoint(int index, char *url, size_t size) {
+    if (index < 0 || index >= MISSION_ENDPOINTS) {
+        url[0] = '\0';
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    strlcpy(url, endpoints[index], size);
+    xSemaphoreGive(lock);
+    return url[0] != '\0';
+}
+
+const char *mission_action_name(mission_action_t action) {
+    return action < MISSION_ACTIONS ? action_names[action] : "?";
+}
+
+int mission_action_parse(const char *name) {
+    for (int i = 0; i < MISSION_ACTIONS; i++) {
+        if (strcmp(name, action_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
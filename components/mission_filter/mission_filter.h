@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MISSION_RULES_MAX 16
+#define MISSION_NAME_MAX 16
+#define MISSION_PREFIX_MAX 16
+#define MISSION_MASK_MAX 8
+#define MISSION_ENDPOINTS 4    // 0 is the message API, the others are set from the console
+#define MISSION_URL_MAX 128
+
+typedef enum {
+    MISSION_UPLOAD,  // Upload live to the rule's endpoint
+    MISSION_STORE,   // Journal only, it reaches the endpoint through the replay between passes
+    MISSION_DISPLAY, // Show on the screen, not uploaded
+    MISSION_DROP,
+    MISSION_ACTIONS
+} mission_action_t;
+
+// A frame matches when it starts with prefix, its length is within
+// [min_len, max_len] and (payload[offset + i] & mask[i]) == value[i] for the
+// mask_len bytes at offset
+typedef struct {
+    char name[MISSION_NAME_MAX];
+    uint8_t prefix[MISSION_PREFIX_MAX];
+    uint8_t prefix_len;
+    uint8_t mask_offset;
+    uint8_t mask_len;
+    uint8_t mask[MISSION_MASK_MAX];
+    uint8_t value[MISSION_MASK_MAX];
+    uint16_t min_len;
+    uint16_t max_len;
+    uint8_t action;   // mission_action_t
+    uint8_t endpoint; // For MISSION_UPLOAD and MISSION_STORE
+} mission_rule_t;
+
+typedef struct {
+    int rule;         // Index of the matching rule, -1 if none matched
+    mission_action_t action;
+    uint8_t endpoint;
+} mission_route_t;
+
+// Load the rules and endpoints from NVS, or the PlatziSat-1 rule if none
+// are stored. default_url is endpoint 0.
+esp_err_t mission_filter_init(const char *default_url);
+
+// Route of one frame. The longest matching prefix wins, then the rule
+// added first. Without a match the action is MISSION_DROP and rule is -1.
+void mission_filter_match(const uint8_t *payload, size_t len, mission_route_t *route);
+
+// Add a rule or replace the one with the same name, stored in NVS
+esp_err_t mission_filter_set(const mission_rule_t *rule);
+esp_err_t mission_filter_remove(const char *name);
+
+int mission_filter_count();
+bool mission_filter_get(int index, mission_rule_t *rule, uint32_t *hits);
+
+// URL of endpoint index, empty if not set. Endpoint 0 is fixed.
+esp_err_t mission_filter_set_endpoint(int index, const char *url);
+bool mission_filter_get_endpoint(int index, char *url, size_t size);
+
+const char *mission_action_name(mission_action_t action);
+int mission_action_parse(const char *name); // -1 if unknown
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+#include <assert.h>
+#include "packet_ring.h"
+
+void packet_ring_init(packet_ring_t *ring, packet_t *slots, uint32_t size) {
+    assert(size != 0 && (size & (size - 1)) == 0);
+    ring->slots = slots;
+    ring->size = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overflows, 0);
+    atomic_init(&ring->high_water, 0);
+}
+
+// Returns the next free slot, or NULL (and counts an overflow) if the ring is full.
+// The slot is only visible to the consumer after packet_ring_commit().
+packet_t *packet_ring_reserve(packet_ring_t *ring) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= ring->size) {
+        atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+        return NULL;
+    }
+    return &ring->slots[head & (ring->size - 1)];
+}
+
+void packet_ring_commit(packet_ring_t *ring) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) + 1;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    uint32_t used = head - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (used > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, used, memory_order_relaxed);
+    }
+}
+
+// Returns the oldest committed slot, or NULL if the ring is empty.
+// The slot stays owned by the consumer until packet_ring_release().
+packet_t *packet_ring_peek(packet_ring_t *ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    return &ring->slots[tail & (ring->size - 1)];
+}
+
+packet_t *packet_ring_peek_oldest(packet_ring_t *rings, int count, int *index) {
+    packet_t *oldest = NULL;
+    for (int i = 0; i < count; i++) {
+        packet_t *pkt = packet_ring_peek(&rings[i]);
+        if (pkt != NULL && (oldest == NULL || pkt->timestamp < oldest->timestamp)) {
+            oldest = pkt;
+            *index = i;
+        }
+    }
+    return oldest;
+}
+
+void packet_ring_release(packet_ring_t *ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+uint32_t packet_ring_count(packet_ring_t *ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+uint32_t packet_ring_overflows(packet_ring_t *ring) {
+    return atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+}
+
+uint32_t packet_ring_high_water(packet_ring_t *ring) {
+    return atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACKET_PAYLOAD_MAX 255 // Largest LoRa payload
+#define PACKET_FORMAT_VERSION 4 // Bump when the fields before payload change
+
+// One received frame with its radio metadata.
+// Payload goes last so a record can be stored as offsetof(packet_t, payload) + len bytes.
+typedef struct {
+    int64_t timestamp;  // esp_timer_get_time() at RxDone, us
+    uint16_t len;
+    int16_t rssi;       // dBm
+    float snr;          // dB
+    int32_t freq_error; // Carrier offset measured by the radio, Hz
+    uint8_t crc_on;     // Payload CRC was present and checked
+    uint8_t coding_rate; // Denominator of 4/x from the LoRa header
+    uint8_t radio;      // Index of the receiving radio
+    uint8_t endpoint;   // Mission endpoint it is uploaded to
+    uint8_t payload[PACKET_PAYLOAD_MAX + 1]; // +1 keeps room for a NUL terminator
+} packet_t;
+
+#define PACKET_RECORD_SIZE(pkt) (offsetof(packet_t, payload) + (pkt)->len)
+
+// Single-producer/single-consumer ring of packet records.
+// The producer only moves head, the consumer only moves tail, so no lock is needed.
+typedef struct {
+    packet_t *slots;
+    uint32_t size; // Power of two
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t overflows;
+    _Atomic uint32_t high_water;
+} packet_ring_t;
+
+// Ring setup, size must be a power of two
+void packet_ring_init(packet_ring_t *ring, packet_t *slots, uint32_t size);
+
+// Producer side
+packet_t *packet_ring_reserve(packet_ring_t *ring);
+void packet_ring_commit(packet_ring_t *ring);
+
+// Consumer side
+packet_t *packet_ring_peek(packet_ring_t *ring);
+void packet_ring_release(packet_ring_t *ring);
+
+// Consumer side over several rings, one per producer: oldest committed
+// frame by timestamp, NULL if all are empty. *index is set to its ring.
+packet_t *packet_ring_peek_oldest(packet_ring_t *rings, int count, int *index);
+
+// Counters, safe to read from any task
+uint32_t packet_ring_count(packet_ring_t *ring);
+uint32_t packet_ring_overflows(packet_ring_t *ring);
+uint32_t packet_ring_high_water(packet_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,259 @@
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sat_tracker.h"
+#include "pass_predictor.h"
+
+#define PASS_SCAN_STEP_S 30      // Shorter passes above the minimum elevation can be missed
+#define PASS_LOOKBACK_S 1200     // Scan starts this far back so a pass under way gets its real AOS
+#define PASS_REFINE_S 1.0        // Precision of AOS, LOS and TCA
+#define PASS_WAIT_STEP_MS 60000  // Longest sleep in pass_wait_gap, the prediction may change meanwhile
+
+static const char *TAG = "PASS";
+
+static pass_predictor_config_t cfg;
+static SemaphoreHandle_t lock; // The Doppler task predicts while the console and the OTA task read
+static SemaphoreHandle_t update_lock; // The console can force a prediction while the Doppler task makes one
+static pass_t passes[PASS_PREDICTOR_MAX];
+static pass_t scratch[PASS_PREDICTOR_MAX]; // Prediction in progress, under update_lock
+static pass_predictor_info_t info;
+static bool valid;
+static uint32_t evaluations;
+
+// Elevation of satellite index at t, false if it does not propagate
+static bool pass_elevation(int index, double t, float *elevation, float *azimuth) {
+    sat_tracker_state_t state;
+    evaluations++;
+    if (!sat_tracker_update(index, t, &state)) {
+        return false;
+    }
+    *elevation = state.look.elevation;
+    if (azimuth != NULL) {
+        *azimuth = state.look.azimuth;
+    }
+    return true;
+}
+
+// Time the elevation crosses the minimum between below and above, by bisection
+static double pass_crossing(int index, double below, double above) {
+    float elevation;
+    while (below - above > PASS_REFINE_S || above - below > PASS_REFINE_S) {
+        double mid = (below + above) / 2;
+        if (!pass_elevation(index, mid, &elevation, NULL)) {
+            break;
+        }
+        if (elevation >= cfg.min_elevation) {
+            above = mid;
+        } else {
+            below = mid;
+        }
+    }
+    return above;
+}
+
+// Highest elevation between a and b, by golden section search around the
+// best coarse sample. The elevation has a single maximum there.
+static double pass_culmination(int index, double a, double b, float *max_elevation) {
+    const double ratio = 0.6180339887;
+    float ec, ed;
+    double c = b - ratio * (b - a);
+    double d = a + ratio * (b - a);
+    if (!pass_elevation(index, c, &ec, NULL) || !pass_elevation(index, d, &ed, NULL)) {
+        return (a + b) / 2;
+    }
+    while (b - a > PASS_REFINE_S) {
+        if (ec > ed) {
+            b = d;
+            d = c;
+            ed = ec;
+            c = b - ratio * (b - a);
+            if (!pass_elevation(index, c, &ec, NULL)) {
+                break;
+            }
+        } else {
+            a = c;
+            c = d;
+            ec = ed;
+            d = a + ratio * (b - a);
+            if (!pass_elevation(index, d, &ed, NULL)) {
+                break;
+            }
+        }
+    }
+    *max_elevation = ec > ed ? ec : ed;
+    return ec > ed ? c : d;
+}
+
+// Keep the list ordered by AOS, dropping the latest pass when full
+static void pass_insert(pass_t *list, int *count, const pass_t *pass) {
+    int i = *count < PASS_PREDICTOR_MAX ? *count : PASS_PREDICTOR_MAX - 1;
+    if (i == PASS_PREDICTOR_MAX - 1 && *count == PASS_PREDICTOR_MAX && list[i].aos <= pass->aos) {
+        return;
+    }
+    while (i > 0 && list[i - 1].aos > pass->aos) {
+        list[i] = list[i - 1];
+        i--;
+    }
+    list[i] = *pass;
+    if (*count < PASS_PREDICTOR_MAX) {
+        (*count)++;
+    }
+}
+
+// Coarse scan of one satellite from start to end, refining each crossing.
+// Passes that ended before now are left out.
+static void pass_scan(int index, double start, double now, double end, pass_t *list, int *count) {
+    sgp4_tle_t tle;
+    pass_t pass;
+    float elevation, azimuth, edge;
+    float best = -90;
+    double best_t = start;
+    double prev = start;
+
+    if (!sat_tracker_get_tle(index, &tle) || !pass_elevation(index, start, &elevation, &azimuth)) {
+        return;
+    }
+    memset(&pass, 0, sizeof(pass));
+    pass.sat = index;
+    pass.catalog = tle.catalog;
+    strlcpy(pass.name, tle.name, sizeof(pass.name));
+    bool up = elevation >= cfg.min_elevation;
+    if (up) {
+        pass.aos = start;
+        pass.aos_azimuth = azimuth;
+    }
+
+    for (double t = start + PASS_SCAN_STEP_S; t <= end + PASS_SCAN_STEP_S; t += PASS_SCAN_STEP_S) {
+        if (t > end) {
+            t = end;
+        }
+        if (!pass_elevation(index, t, &elevation, NULL)) {
+            ESP_LOGW(TAG, "%05"PRIu32" stops propagating %.0f h ahead", tle.catalog, (t - now) / 3600);
+            return;
+        }
+        if (!up && elevation >= cfg.min_elevation) {
+            pass.aos = pass_crossing(index, prev, t);
+            pass_elevation(index, pass.aos, &edge, &pass.aos_azimuth);
+            best = -90;
+            up = true;
+        }
+        if (up && elevation > best) {
+            best = elevation;
+            best_t = t;
+        }
+        if (up && (elevation < cfg.min_elevation || t == end)) {
+            pass.los = elevation < cfg.min_elevation ? pass_crossing(index, t, prev) : end;
+            pass_elevation(index, pass.los, &edge, &pass.los_azimuth);
+            double a = best_t - PASS_SCAN_STEP_S > pass.aos ? best_t - PASS_SCAN_STEP_S : pass.aos;
+            double b = best_t + PASS_SCAN_STEP_S < pass.los ? best_t + PASS_SCAN_STEP_S : pass.los;
+            pass.max_elevation = best;
+            pass.tca = pass_culmination(index, a, b, &pass.max_elevation);
+            if (pass.los >= now) {
+                pass_insert(list, count, &pass);
+            }
+            up = false;
+        }
+        prev = t;
+        if (t == end) {
+            break;
+        }
+    }
+}
+
+esp_err_t pass_predictor_init(const pass_predictor_config_t *config) {
+    cfg = *config;
+    lock = xSemaphoreCreateMutex();
+    update_lock = xSemaphoreCreateMutex();
+    return lock == NULL || update_lock == NULL ? ESP_ERR_NO_MEM : ESP_OK;
+}
+
+bool pass_predictor_update(double now, bool force) {
+    if (!sat_tracker_time_valid()) {
+        return false;
+    }
+    uint32_t generation = sat_tracker_generation();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool stale = !valid || info.generation != generation || now > info.start + cfg.horizon_s / 2;
+    xSemaphoreGive(lock);
+    if (!force && (!stale || (valid && !pass_window_free(now, 0)))) {
+        return false;
+    }
+
+    xSemaphoreTake(update_lock, portMAX_DELAY);
+    int64_t begin = esp_timer_get_time();
+    int count = 0;
+    evaluations = 0;
+    for (int i = 0; i < sat_tracker_count(); i++) {
+        pass_scan(i, now - PASS_LOOKBACK_S, now, now + cfg.horizon_s, scratch, &count);
+        // Let the other tasks at this priority run between satellites
+        vTaskDelay(1);
+    }
+    uint32_t compute_ms = (esp_timer_get_time() - begin) / 1000;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    memcpy(passes, scratch, count * sizeof(pass_t));
+    info.start = now;
+    info.end = now + cfg.horizon_s;
+    info.generation = generation;
+    info.compute_ms = compute_ms;
+    info.evaluations = evaluations;
+    info.count = count;
+    valid = true;
+    xSemaphoreGive(lock);
+    xSemaphoreGive(update_lock);
+
+    ESP_LOGI(TAG, "%d passes in the next %"PRIu32" h, %"PRIu32" propagations in %"PRIu32" ms",
+             count, cfg.horizon_s / 3600, evaluations, compute_ms);
+    return true;
+}
+
+int pass_predictor_get(pass_t *out, int max, pass_predictor_info_t *out_info) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int count = valid ? info.count : 0;
+    if (count > max) {
+        count = max;
+    }
+    memcpy(out, passes, count * sizeof(pass_t));
+    if (out_info != NULL) {
+        *out_info = info;
+        out_info->count = valid ? info.count : 0;
+    }
+    xSemaphoreGive(lock);
+    return count;
+}
+
+double pass_next_gap(double now, uint32_t needed_s) {
+    double t = now;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; valid && i < info.count && t < info.end; i++) {
+        if (passes[i].aos - cfg.guard_s >= t + needed_s) {
+            break;
+        }
+        if (passes[i].los + cfg.guard_s > t) {
+            t = passes[i].los + cfg.guard_s;
+        }
+    }
+    xSemaphoreGive(lock);
+    return t;
+}
+
+bool pass_window_free(double now, uint32_t needed_s) {
+    return pass_next_gap(now, needed_s) <= now;
+}
+
+void pass_wait_gap(uint32_t needed_s) {
+    while (true) {
+        double now = sat_tracker_now();
+        double at = pass_next_gap(now, needed_s);
+        if (at <= now) {
+            return;
+        }
+        ESP_LOGI(TAG, "Waiting %.0f s for %"PRIu32" s free of passes", at - now, needed_s);
+        double wait_ms = (at - now) * 1000;
+        vTaskDelay(pdMS_TO_TICKS(wait_ms < PASS_WAIT_STEP_MS ? (uint32_t)wait_ms + 1 : PASS_WAIT_STEP_MS));
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sgp4.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PASS_PREDICTOR_MAX 32 // Passes kept over all satellites, the earliest ones
+
+typedef struct {
+    float min_elevation; // deg, a pass is the time above it
+    uint32_t horizon_s;  // How far ahead passes are predicted
+    uint32_t guard_s;    // Added before AOS and after LOS when looking for gaps
+} pass_predictor_config_t;
+
+typedef struct {
+    int sat;                 // Index in the tracker list when predicted
+    uint32_t catalog;
+    char name[SGP4_NAME_MAX];
+    double aos;              // Unix time, s
+    double tca;              // Time of the highest elevation
+    double los;
+    float max_elevation;     // deg
+    float aos_azimuth;
+    float los_azimuth;
+} pass_t;
+
+typedef struct {
+    double start;            // Span covered by the prediction, Unix time
+    double end;
+    uint32_t generation;     // Of the tracker list it was computed from
+    uint32_t compute_ms;
+    uint32_t evaluations;    // Propagations it took
+    int count;
+} pass_predictor_info_t;
+
+esp_err_t pass_predictor_init(const pass_predictor_config_t *config);
+
+// Predict the passes of every tracked satellite from now when the element
+// sets changed or half of the horizon went by. Not done while a pass is
+// under way unless forced, it takes a few seconds of CPU. True if the
+// prediction was recomputed.
+bool pass_predictor_update(double now, bool force);
+
+// Copy up to max passes, ordered by AOS, and the prediction info. Returns
+// the number copied.
+int pass_predictor_get(pass_t *passes, int max, pass_predictor_info_t *info);
+
+// Earliest time from now when needed_s seconds are free of passes, guard
+// included. Beyond the prediction, or without one, time counts as free.
+double pass_next_gap(double now, uint32_t needed_s);
+
+// No pass, guard included, between now and now + needed_s
+bool pass_window_free(double now, uint32_t needed_s);
+
+// Block until a gap of needed_s starts, for work that must not overlap a pass
+void pass_wait_gap(uint32_t needed_s);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,359 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "rx_scheduler.h"
+
+#define RX_SCHEDULER_NAMESPACE "rx_sched"
+#define RX_SCHEDULER_KEY "profiles"
+#define RX_SCHEDULER_LINGER_MS 2000 // Stay on a profile after a frame, beacons come in bursts
+#define RX_HEADER_SYMBOLS 8 // Explicit header, always sent at CR 4/8
+
+static const char *TAG = "RX_SCHED";
+
+static lora_dev_t *radio;
+static SemaphoreHandle_t table_lock; // Console edits the table while the RX task hops
+static rx_profile_t profiles[RX_SCHEDULER_MAX_PROFILES];
+static rx_profile_stats_t stats[RX_SCHEDULER_MAX_PROFILES];
+static long offsets[RX_SCHEDULER_MAX_PROFILES]; // Doppler correction, not persisted
+static afc_t afcs[RX_SCHEDULER_MAX_PROFILES];   // Measured correction, each satellite has its own crystal
+static afc_config_t afc_config;
+static bool afc_enabled;
+static int count;
+static int current = -1;        // Profile applied to the radio, -1 if none yet
+static long tuned_frequency;    // Frequency of current including its offset
+static int64_t tuned_at;        // When current was applied, for the dwell time
+static int64_t linger_until;    // Keep listening on current until then
+static uint32_t received_seen;  // Radio RX counter already credited to a profile
+
+// CAD measurement handed from the console to the RX task, which owns the radio
+static SemaphoreHandle_t measure_done;
+static int measure_index = -1;
+static int measure_runs;
+static lora_cad_timing_t *measure_timing;
+
+static esp_err_t rx_scheduler_save() {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(RX_SCHEDULER_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, RX_SCHEDULER_KEY, profiles, count * sizeof(rx_profile_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+static void rx_scheduler_load(const rx_profile_t *fallback) {
+    nvs_handle_t nvs;
+    size_t size = sizeof(profiles);
+    esp_err_t err = nvs_open(RX_SCHEDULER_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, RX_SCHEDULER_KEY, profiles, &size);
+        nvs_close(nvs);
+    }
+    if (err == ESP_OK && size > 0 && size % sizeof(rx_profile_t) == 0) {
+        count = size / sizeof(rx_profile_t);
+        ESP_LOGI(TAG, "Loaded %d profiles", count);
+        return;
+    }
+    if (err != ESP_ERR_NVS_NOT_FOUND && err != ESP_OK) {
+        ESP_LOGW(TAG, "Read profiles failed: %s", esp_err_to_name(err));
+    }
+    profiles[0] = *fallback;
+    count = 1;
+    ESP_LOGI(TAG, "No stored profiles, using %s", fallback->name);
+}
+
+// Credit frames read since the last call and the time spent on current
+static void rx_scheduler_account(int64_t now) {
+    lora_rx_stats_t rx;
+    lora_get_rx_stats(radio, &rx);
+    uint32_t received = rx.received - rx.crc_errors;
+    if (current >= 0) {
+        // The driver counters restart from 0 when reset from the console
+        stats[current].frames += received >= received_seen ? received - received_seen : received;
+        stats[current].dwell_us += now - tuned_at;
+    }
+    received_seen = received;
+    tuned_at = now;
+}
+
+// AFC state for a profile, FEI beyond a quarter of the bandwidth is not a real offset
+static void rx_scheduler_afc_init(int index) {
+    afc_config_t config = afc_config;
+    config.max_fei_hz = profiles[index].profile.bandwidth / 4;
+    afc_init(&afcs[index], &config);
+}
+
+// Tune the radio to index, the caller holds table_lock. An offset change
+// on the current profile waits while a frame is being received.
+static void rx_scheduler_tune(int index) {
+    lora_profile_t profile = profiles[index].profile;
+    profile.frequency += offsets[index] + afcs[index].correction;
+    if (index == current && (profile.frequency == tuned_frequency || lora_rx_busy(radio))) {
+        return;
+    }
+    if (index != current) {
+        rx_scheduler_account(esp_timer_get_time());
+    }
+    lora_apply_profile(radio, &profile);
+    current = index;
+    tuned_frequency = profile.frequency;
+}
+
+// Run the pending CAD measurement, the caller holds table_lock
+static void rx_scheduler_measure_pending() {
+    if (measure_index < 0) {
+        return;
+    }
+    if (measure_index < count) {
+        rx_scheduler_tune(measure_index);
+        lora_cad_measure(radio, measure_runs, measure_timing);
+        // Measuring is not listening, leave it out of the dwell time
+        tuned_at = esp_timer_get_time();
+        linger_until = 0;
+    } else {
+        measure_timing->runs = 0;
+    }
+    measure_index = -1;
+    xSemaphoreGive(measure_done);
+}
+
+// Wait for RxDone until the deadline, stray notifications do not cut it short
+static bool rx_scheduler_wait_until(int64_t deadline) {
+    int64_t now;
+    while ((now = esp_timer_get_time()) < deadline) {
+        int ms = (deadline - now + 999) / 1000;
+        if (lora_wait_received(radio, ms)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t rx_scheduler_init(lora_dev_t *dev, const rx_profile_t *fallback, const afc_config_t *afc) {
+    radio = dev;
+    afc_enabled = afc != NULL;
+    if (afc_enabled) {
+        afc_config = *afc;
+    }
+    table_lock = xSemaphoreCreateMutex();
+    measure_done = xSemaphoreCreateBinary();
+    if (table_lock == NULL || measure_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    rx_scheduler_load(fallback);
+    memset(stats, 0, sizeof(stats));
+    for (int i = 0; i < count; i++) {
+        rx_scheduler_afc_init(i);
+    }
+    current = -1;
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    rx_scheduler_tune(0);
+    xSemaphoreGive(table_lock);
+    return ESP_OK;
+}
+
+bool rx_scheduler_wait(int timeout_ms) {
+    int64_t now = esp_timer_get_time();
+    int64_t deadline = now + timeout_ms * 1000LL;
+
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    rx_scheduler_measure_pending();
+    rx_scheduler_account(now);
+    for (int i = 0; i < count; i++) {
+        afc_idle(&afcs[i], now);
+    }
+    if (current >= count) {
+        current = -1;
+    }
+    if (count <= 1 || now < linger_until) {
+        rx_scheduler_tune(current < 0 ? 0 : current);
+        xSemaphoreGive(table_lock);
+        lora_receive_continuous(radio);
+        if (count > 1 && linger_until < deadline) {
+            deadline = linger_until;
+        }
+        return rx_scheduler_wait_until(deadline);
+    }
+
+    while (esp_timer_get_time() < deadline) {
+        int index = (current + 1) % count;
+        rx_scheduler_tune(index);
+        lora_profile_t *profile = &profiles[index].profile;
+        uint32_t symbol_us = lora_symbol_us(profile);
+
+        // CAD takes about two symbols, measured if the console ran it;
+        // allow for the tick granularity when DIO0 is not wired
+        int detected = lora_cad(radio, 2 * lora_cad_duration_us(radio) / 1000 + 20);
+        stats[index].cads++;
+        if (detected <= 0) {
+            continue;
+        }
+        stats[index].detections++;
+
+        // Preamble found: listen until the header, and if the modem is
+        // synchronized by then, until the longest frame could end
+        int64_t header_us = (profile->preamble_length + 5 + RX_HEADER_SYMBOLS) * (int64_t)symbol_us;
+        int64_t frame_us = lora_airtime_us(profile, 255);
+        xSemaphoreGive(table_lock);
+        lora_receive_continuous(radio);
+        int64_t start = esp_timer_get_time();
+        bool received = rx_scheduler_wait_until(start + header_us);
+        if (!received && lora_rx_busy(radio)) {
+            received = rx_scheduler_wait_until(start + frame_us);
+        }
+        if (received) {
+            linger_until = esp_timer_get_time() + RX_SCHEDULER_LINGER_MS * 1000LL;
+            return true;
+        }
+        xSemaphoreTake(table_lock, portMAX_DELAY);
+    }
+    xSemaphoreGive(table_lock);
+    return false;
+}
+
+int rx_scheduler_count() {
+    return count;
+}
+
+bool rx_scheduler_get(int index, rx_profile_t *profile, rx_profile_stats_t *out) {
+    bool found = false;
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    if (index >= 0 && index < count) {
+        *profile = profiles[index];
+        *out = stats[index];
+        out->offset_hz = offsets[index];
+        if (index == current) {
+            out->dwell_us += esp_timer_get_time() - tuned_at;
+        }
+        found = true;
+    }
+    xSemaphoreGive(table_lock);
+    return found;
+}
+
+esp_err_t rx_scheduler_add(const rx_profile_t *profile) {
+    esp_err_t err = ESP_ERR_NO_MEM;
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    if (count < RX_SCHEDULER_MAX_PROFILES) {
+        profiles[count] = *profile;
+        memset(&stats[count], 0, sizeof(stats[count]));
+        offsets[count] = 0;
+        rx_scheduler_afc_init(count);
+        count++;
+        err = rx_scheduler_save();
+    }
+    xSemaphoreGive(table_lock);
+    return err;
+}
+
+esp_err_t rx_scheduler_remove(int index) {
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    // The last profile stays, the radio always needs one
+    if (index >= 0 && index < count && count > 1) {
+        rx_scheduler_account(esp_timer_get_time());
+        memmove(&profiles[index], &profiles[index + 1], (count - index - 1) * sizeof(rx_profile_t));
+        memmove(&stats[index], &stats[index + 1], (count - index - 1) * sizeof(rx_profile_stats_t));
+        memmove(&offsets[index], &offsets[index + 1], (count - index - 1) * sizeof(long));
+        memmove(&afcs[index], &afcs[index + 1], (count - index - 1) * sizeof(afc_t));
+        count--;
+        if (current == index) {
+            // Retune on the next wait
+            current = -1;
+            linger_until = 0;
+        } else if (current > index) {
+            current--;
+        }
+        err = rx_scheduler_save();
+    }
+    xSemaphoreGive(table_lock);
+    return err;
+}
+
+bool rx_scheduler_set_offset(const char *name, long offset_hz) {
+    bool found = false;
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    for (int i = 0; i < count; i++) {
+        if (strncmp(profiles[i].name, name, RX_PROFILE_NAME_MAX) == 0) {
+            offsets[i] = offset_hz;
+            found = true;
+        }
+    }
+    xSemaphoreGive(table_lock);
+    return found;
+}
+
+void rx_scheduler_afc(const lora_packet_info_t *info) {
+    if (!afc_enabled) {
+        return;
+    }
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    // Applied by the next rx_scheduler_tune(), between packets
+    if (current >= 0) {
+        afc_update(&afcs[current], info->freq_error, info->snr, !info->crc_error, info->timestamp_us);
+    }
+    xSemaphoreGive(table_lock);
+}
+
+bool rx_scheduler_get_afc(int index, afc_t *out) {
+    bool found = false;
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    if (afc_enabled && index >= 0 && index < count) {
+        *out = afcs[index];
+        found = true;
+    }
+    xSemaphoreGive(table_lock);
+    return found;
+}
+
+void rx_scheduler_reset_afc() {
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    for (int i = 0; i < count; i++) {
+        afc_reset(&afcs[i]);
+    }
+    xSemaphoreGive(table_lock);
+}
+
+int rx_scheduler_current() {
+    return current;
+}
+
+void rx_scheduler_reset_stats() {
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    memset(stats, 0, sizeof(stats));
+    tuned_at = esp_timer_get_time();
+    xSemaphoreGive(table_lock);
+}
+
+esp_err_t rx_scheduler_measure(int index, int runs, lora_cad_timing_t *timing, int timeout_ms) {
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    if (index < 0 || index >= count || measure_index >= 0) {
+        xSemaphoreGive(table_lock);
+        return index < 0 || index >= count ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    measure_index = index;
+    measure_runs = runs;
+    measure_timing = timing;
+    xSemaphoreGive(table_lock);
+
+    if (xSemaphoreTake(measure_done, pdMS_TO_TICKS(timeout_ms)) == pdTRUE) {
+        return ESP_OK;
+    }
+    // Withdraw the request unless the RX task picked it up meanwhile
+    xSemaphoreTake(table_lock, portMAX_DELAY);
+    bool withdrawn = measure_index >= 0;
+    measure_index = -1;
+    xSemaphoreGive(table_lock);
+    if (withdrawn) {
+        return ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreTake(measure_done, 0);
+    return ESP_OK;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "lora.h"
+#include "afc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RX_SCHEDULER_MAX_PROFILES 8
+#define RX_PROFILE_NAME_MAX 16
+
+// One satellite or channel to listen for
+typedef struct {
+    char name[RX_PROFILE_NAME_MAX];
+    lora_profile_t profile;
+} rx_profile_t;
+
+typedef struct {
+    uint64_t dwell_us;   // Time the radio spent tuned to the profile
+    uint32_t cads;       // Channel activity detections run
+    uint32_t detections; // Of those, preamble found
+    uint32_t frames;     // Frames received on the profile
+    int32_t offset_hz;   // Doppler correction on top of the profile frequency
+} rx_profile_stats_t;
+
+// Load the profile table from NVS, or start with fallback if there is none.
+// The scheduler owns the radio's modem configuration from here on. Each
+// profile gets its own frequency correction with afc, NULL disables it.
+esp_err_t rx_scheduler_init(lora_dev_t *dev, const rx_profile_t *fallback, const afc_config_t *afc);
+
+// Block until a frame is ready to read, false on timeout. With one profile
+// the radio just stays in continuous RX. With several it hops between them
+// running CAD and only dwells where a preamble is present, locked on the
+// profile until the frame completes.
+bool rx_scheduler_wait(int timeout_ms);
+
+// Profile table, persisted to NVS on every change
+int rx_scheduler_count();
+bool rx_scheduler_get(int index, rx_profile_t *profile, rx_profile_stats_t *stats);
+esp_err_t rx_scheduler_add(const rx_profile_t *profile);
+esp_err_t rx_scheduler_remove(int index);
+
+// Shift the profiles named name by offset_hz, applied on the next pass
+// through rx_scheduler_wait() once no frame is in the air. False if no
+// profile has that name.
+bool rx_scheduler_set_offset(const char *name, long offset_hz);
+
+// Feed the FEI of a frame received on the current profile to its AFC
+void rx_scheduler_afc(const lora_packet_info_t *info);
+bool rx_scheduler_get_afc(int index, afc_t *afc);
+void rx_scheduler_reset_afc();
+
+// Index of the profile the radio is tuned to
+int rx_scheduler_current();
+void rx_scheduler_reset_stats();
+
+// Measure CAD on a profile, runs detections back to back. The RX task does
+// it on its next pass through rx_scheduler_wait(), so this blocks up to
+// timeout_ms; the measured duration then sets the CAD timeout for the
+// profile's SF and bandwidth.
+esp_err_t rx_scheduler_measure(int index, int runs, lora_cad_timing_t *timing, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,83 @@
+#include <string.h>
+#include "p2_quantile.h"
+
+void p2_init(p2_quantile_t *est, float p) {
+    memset(est, 0, sizeof(*est));
+    est->p = p;
+}
+
+// Piecewise-parabolic prediction of marker i moved by d
+static float p2_parabolic(const p2_quantile_t *e, int i, int d) {
+    return e->q[i] + (float)d / (e->n[i + 1] - e->n[i - 1]) *
+           ((e->n[i] - e->n[i - 1] + d) * (e->q[i + 1] - e->q[i]) / (e->n[i + 1] - e->n[i]) +
+            (e->n[i + 1] - e->n[i] - d) * (e->q[i] - e->q[i - 1]) / (e->n[i] - e->n[i - 1]));
+}
+
+void p2_add(p2_quantile_t *e, float x) {
+    if (e->count < 5) {
+        // Insertion sort of the first samples, they become the markers
+        int i = e->count++;
+        while (i > 0 && e->q[i - 1] > x) {
+            e->q[i] = e->q[i - 1];
+            i--;
+        }
+        e->q[i] = x;
+        if (e->count == 5) {
+            for (int j = 0; j < 5; j++) {
+                e->n[j] = j + 1;
+            }
+            e->np[0] = 1;
+            e->np[1] = 1 + 2 * e->p;
+            e->np[2] = 1 + 4 * e->p;
+            e->np[3] = 3 + 2 * e->p;
+            e->np[4] = 5;
+        }
+        return;
+    }
+
+    int k;
+    if (x < e->q[0]) {
+        e->q[0] = x;
+        k = 0;
+    } else if (x >= e->q[4]) {
+        e->q[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= e->q[k + 1]) {
+            k++;
+        }
+    }
+    for (int i = k + 1; i < 5; i++) {
+        e->n[i]++;
+    }
+    const float dn[5] = {0, e->p / 2, e->p, (1 + e->p) / 2, 1};
+    for (int i = 0; i < 5; i++) {
+        e->np[i] += dn[i];
+    }
+    e->count++;
+
+    for (int i = 1; i < 4; i++) {
+        float d = e->np[i] - e->n[i];
+        if ((d >= 1 && e->n[i + 1] - e->n[i] > 1) || (d <= -1 && e->n[i - 1] - e->n[i] < -1)) {
+            int step = d > 0 ? 1 : -1;
+            float q = p2_parabolic(e, i, step);
+            if (e->q[i - 1] < q && q < e->q[i + 1]) {
+                e->q[i] = q;
+            } else {
+                e->q[i] += step * (e->q[i + step] - e->q[i]) / (e->n[i + step] - e->n[i]);
+            }
+            e->n[i] += step;
+        }
+    }
+}
+
+float p2_get(const p2_quantile_t *e) {
+    if (e->count == 0) {
+        return 0;
+    }
+    if (e->count < 5) {
+        return e->q[(int)(e->p * (e->count - 1) + 0.5f)];
+    }
+    return e->q[2];
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// P² streaming estimate of one quantile (Jain and Chlamtac, 1985): five
+// markers, constant memory and time per sample, no samples kept
+typedef struct {
+    float p;        // Quantile, 0 to 1
+    float q[5];     // Marker heights, the first samples until there are five
+    float np[5];    // Desired marker positions
+    int32_t n[5];   // Actual marker positions
+    uint32_t count;
+} p2_quantile_t;
+
+void p2_init(p2_quantile_t *est, float p);
+void p2_add(p2_quantile_t *est, float x);
+
+// Current estimate, 0 before the first sample
+float p2_get(const p2_quantile_t *est);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,297 @@
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_crc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "p2_quantile.h"
+#include "rx_stats.h"
+
+#define RX_STATS_NAMESPACE "rx_stats"
+#define RX_STATS_KEY "totals"
+#define RX_STATS_MAGIC 0x52585354    // "RXST"
+#define RX_STATS_RTC_PERIOD_MS 10000 // RTC memory has no wear, NVS writes are coalesced over nvs_interval_s
+#define RX_STATS_TASK_STACK (1024 * 3)
+#define RX_STATS_TASK_PRIORITY 1
+
+static const char *TAG = "RX_STATS";
+
+// Lifetime totals as stored in RTC memory and NVS
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence; // The newer of RTC and NVS wins at boot
+    uint32_t boots;
+    uint32_t totals[RX_STATS_RADIOS][RX_STATS_COUNTERS];
+    uint32_t crc;      // Of the fields above
+} rx_stats_checkpoint_t;
+
+typedef struct {
+    p2_quantile_t rssi[RX_STATS_QUANTILES];
+    p2_quantile_t snr[RX_STATS_QUANTILES];
+    float rssi_min, rssi_max;
+    float snr_min, snr_max;
+    struct {
+        uint32_t minute; // Since boot
+        uint32_t frames;
+    } minutes[RX_STATS_MINUTES];
+} rx_radio_data_t;
+
+// Written only by the RX task of the radio. Readers copy data and retry if
+// seq changed meanwhile or was odd, an update in progress.
+typedef struct {
+    _Atomic uint32_t seq;
+    rx_radio_data_t data;
+} rx_radio_t;
+
+static const float quantiles[RX_STATS_QUANTILES] = {0.1f, 0.5f, 0.9f};
+static const char *names[RX_STATS_COUNTERS] = {
+    [RX_STATS_FRAMES] = "frames",
+    [RX_STATS_CRC_ERRORS] = "crc errors",
+    [RX_STATS_UNKNOWN] = "unknown origin",
+    [RX_STATS_FILTERED] = "filtered",
+    [RX_STATS_OVERFLOWS] = "ring overflows",
+    [RX_STATS_UPLOADED] = "uploaded",
+    [RX_STATS_UPLOAD_FAILED] = "upload failed",
+};
+
+static rx_radio_t radios[RX_STATS_RADIOS];
+static _Atomic uint32_t session[RX_STATS_RADIOS][RX_STATS_COUNTERS];
+static uint32_t base[RX_STATS_RADIOS][RX_STATS_COUNTERS]; // Lifetime totals at boot
+static RTC_NOINIT_ATTR rx_stats_checkpoint_t rtc_checkpoint;
+static rx_stats_checkpoint_t saved; // Last written to NVS
+static SemaphoreHandle_t lock;      // Checkpoint task and rx_stats_flush()
+static uint32_t nvs_interval_ms;
+static rx_stats_persist_t persist;
+static int64_t nvs_time;
+
+static uint32_t rx_stats_crc(const rx_stats_checkpoint_t *cp) {
+    return esp_crc32_le(0, (const uint8_t *)cp, offsetof(rx_stats_checkpoint_t, crc));
+}
+
+static bool rx_stats_valid(const rx_stats_checkpoint_t *cp) {
+    return cp->magic == RX_STATS_MAGIC && cp->crc == rx_stats_crc(cp);
+}
+
+static void rx_stats_totals(uint32_t totals[RX_STATS_RADIOS][RX_STATS_COUNTERS]) {
+    for (int r = 0; r < RX_STATS_RADIOS; r++) {
+        for (int c = 0; c < RX_STATS_COUNTERS; c++) {
+            totals[r][c] = base[r][c] + atomic_load_explicit(&session[r][c], memory_order_relaxed);
+        }
+    }
+}
+
+// Copy the totals to RTC memory when they changed, and to NVS when they
+// differ from the last write and force is set or the interval went by
+static esp_err_t rx_stats_checkpoint(bool force) {
+    esp_err_t err = ESP_OK;
+    rx_stats_checkpoint_t cp = {
+        .magic = RX_STATS_MAGIC,
+        .boots = persist.boots,
+    };
+    xSemaphoreTake(lock, portMAX_DELAY);
+    rx_stats_totals(cp.totals);
+    if (!rx_stats_valid(&rtc_checkpoint) || rtc_checkpoint.boots != cp.boots ||
+        memcmp(rtc_checkpoint.totals, cp.totals, sizeof(cp.totals)) != 0) {
+        cp.sequence = ++persist.sequence;
+        cp.crc = rx_stats_crc(&cp);
+        rtc_checkpoint = cp;
+    } else {
+        cp = rtc_checkpoint;
+    }
+
+    int64_t now = esp_timer_get_time();
+    bool changed = saved.boots != cp.boots || memcmp(saved.totals, cp.totals, sizeof(cp.totals)) != 0;
+    if (changed && (force || now - nvs_time >= nvs_interval_ms * 1000LL)) {
+        nvs_handle_t nvs;
+        err = nvs_open(RX_STATS_NAMESPACE, NVS_READWRITE, &nvs);
+        if (err == ESP_OK) {
+            err = nvs_set_blob(nvs, RX_STATS_KEY, &cp, sizeof(cp));
+            if (err == ESP_OK) {
+                err = nvs_commit(nvs);
+            }
+            nvs_close(nvs);
+        }
+        if (err == ESP_OK) {
+            saved = cp;
+            persist.nvs_writes++;
+        } else {
+            ESP_LOGW(TAG, "Checkpoint to NVS failed: %s", esp_err_to_name(err));
+        }
+        // Retried after a full interval either way, a failing flash is not hammered
+        nvs_time = now;
+    }
+    xSemaphoreGive(lock);
+    return err;
+}
+
+static void rx_stats_task(void *p) {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(RX_STATS_RTC_PERIOD_MS));
+        rx_stats_checkpoint(false);
+    }
+}
+
+esp_err_t rx_stats_init(uint32_t nvs_interval_s) {
+    nvs_interval_ms = nvs_interval_s * 1000;
+    for (int r = 0; r < RX_STATS_RADIOS; r++) {
+        for (int q = 0; q < RX_STATS_QUANTILES; q++) {
+            p2_init(&radios[r].data.rssi[q], quantiles[q]);
+            p2_init(&radios[r].data.snr[q], quantiles[q]);
+        }
+    }
+
+    rx_stats_checkpoint_t stored = {0};
+    size_t size = sizeof(stored);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(RX_STATS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, RX_STATS_KEY, &stored, &size);
+        nvs_close(nvs);
+    }
+    bool nvs_valid = err == ESP_OK && size == sizeof(stored) && rx_stats_valid(&stored);
+    const rx_stats_checkpoint_t *from = nvs_valid ? &stored : NULL;
+    // RTC memory holds garbage after a power on, the CRC tells
+    if (rx_stats_valid(&rtc_checkpoint) && (from == NULL || rtc_checkpoint.sequence > from->sequence)) {
+        from = &rtc_checkpoint;
+        persist.restored_from_rtc = true;
+    }
+    if (from != NULL) {
+        memcpy(base, from->totals, sizeof(base));
+        persist.sequence = from->sequence;
+        persist.boots = from->boots;
+    }
+    persist.boots++;
+    if (nvs_valid) {
+        saved = stored;
+    }
+    ESP_LOGI(TAG, "Boot %"PRIu32", %"PRIu32" frames lifetime, restored from %s", persist.boots,
+             base[0][RX_STATS_FRAMES] + base[1][RX_STATS_FRAMES],
+             from == NULL ? "nothing" : persist.restored_from_rtc ? "RTC memory" : "NVS");
+
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(&rx_stats_task, "rx_stats", RX_STATS_TASK_STACK, NULL, RX_STATS_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void rx_stats_frame(int radio, int16_t rssi, float snr) {
+    if (radio < 0 || radio >= RX_STATS_RADIOS) {
+        return;
+    }
+    rx_radio_t *r = &radios[radio];
+    rx_radio_data_t *d = &r->data;
+    uint32_t minute = esp_timer_get_time() / 60000000;
+    uint32_t seq = atomic_load_explicit(&r->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&r->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    if (d->rssi[0].count == 0) {
+        d->rssi_min = d->rssi_max = rssi;
+        d->snr_min = d->snr_max = snr;
+    }
+    d->rssi_min = rssi < d->rssi_min ? rssi : d->rssi_min;
+    d->rssi_max = rssi > d->rssi_max ? rssi : d->rssi_max;
+    d->snr_min = snr < d->snr_min ? snr : d->snr_min;
+    d->snr_max = snr > d->snr_max ? snr : d->snr_max;
+    for (int q = 0; q < RX_STATS_QUANTILES; q++) {
+        p2_add(&d->rssi[q], rssi);
+        p2_add(&d->snr[q], snr);
+    }
+    int slot = minute % RX_STATS_MINUTES;
+    if (d->minutes[slot].minute != minute) {
+        d->minutes[slot].minute = minute;
+        d->minutes[slot].frames = 0;
+    }
+    d->minutes[slot].frames++;
+    atomic_store_explicit(&r->seq, seq + 2, memory_order_release);
+
+    atomic_fetch_add_explicit(&session[radio][RX_STATS_FRAMES], 1, memory_order_relaxed);
+}
+
+void rx_stats_count(int radio, rx_stats_counter_t counter, uint32_t n) {
+    if (radio < 0 || radio >= RX_STATS_RADIOS || counter >= RX_STATS_COUNTERS) {
+        return;
+    }
+    atomic_fetch_add_explicit(&session[radio][counter], n, memory_order_relaxed);
+}
+
+void rx_stats_get(int radio, rx_stats_t *stats) {
+    static rx_radio_data_t copy; // Only the console reads
+    memset(stats, 0, sizeof(*stats));
+    if (radio < 0 || radio >= RX_STATS_RADIOS) {
+        return;
+    }
+    rx_radio_t *r = &radios[radio];
+    uint32_t before, after;
+    do {
+        before = atomic_load_explicit(&r->seq, memory_order_acquire);
+        memcpy(&copy, &r->data, sizeof(copy));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&r->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    for (int c = 0; c < RX_STATS_COUNTERS; c++) {
+        stats->session[c] = atomic_load_explicit(&session[radio][c], memory_order_relaxed);
+        stats->lifetime[c] = base[radio][c] + stats->session[c];
+    }
+    for (int q = 0; q < RX_STATS_QUANTILES; q++) {
+        stats->rssi[q] = p2_get(&copy.rssi[q]);
+        stats->snr[q] = p2_get(&copy.snr[q]);
+    }
+    stats->rssi_min = copy.rssi_min;
+    stats->rssi_max = copy.rssi_max;
+    stats->snr_min = copy.snr_min;
+    stats->snr_max = copy.snr_max;
+
+    // Complete minutes only, slots not written for an hour are stale
+    uint32_t now = esp_timer_get_time() / 60000000;
+    uint32_t hour = 0;
+    for (int i = 0; i < RX_STATS_MINUTES; i++) {
+        uint32_t minute = copy.minutes[i].minute;
+        if (minute >= now || minute + RX_STATS_MINUTES < now || copy.minutes[i].frames == 0) {
+            continue;
+        }
+        hour += copy.minutes[i].frames;
+        if (copy.minutes[i].frames > stats->peak_minute) {
+            stats->peak_minute = copy.minutes[i].frames;
+        }
+        if (minute + 1 == now) {
+            stats->last_minute = copy.minutes[i].frames;
+        }
+    }
+    uint32_t span = now < RX_STATS_MINUTES ? now : RX_STATS_MINUTES;
+    stats->hour_rate = span > 0 ? (float)hour / span : 0;
+}
+
+void rx_stats_get_persist(rx_stats_persist_t *out) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *out = persist;
+    out->nvs_age_ms = persist.nvs_writes > 0 ? (esp_timer_get_time() - nvs_time) / 1000 : -1;
+    xSemaphoreGive(lock);
+}
+
+uint32_t rx_stats_session(rx_stats_counter_t counter) {
+    uint32_t total = 0;
+    for (int r = 0; r < RX_STATS_RADIOS; r++) {
+        total += atomic_load_explicit(&session[r][counter], memory_order_relaxed);
+    }
+    return total;
+}
+
+const char *rx_stats_counter_name(rx_stats_counter_t counter) {
+    return counter < RX_STATS_COUNTERS ? names[counter] : "?";
+}
+
+esp_err_t rx_stats_flush() {
+    return rx_stats_checkpoint(true);
+}
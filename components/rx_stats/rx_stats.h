@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RX_STATS_RADIOS 2
+#define RX_STATS_MINUTES 60 // Per-minute frame counts kept for the rates
+#define RX_STATS_QUANTILES 3 // p10, p50 and p90 of RSSI and SNR
+
+typedef enum {
+    RX_STATS_FRAMES,        // Payloads read from the radio
+    RX_STATS_CRC_ERRORS,    // Dropped on a payload CRC error
+    RX_STATS_UNKNOWN,       // From no known mission
+    RX_STATS_FILTERED,      // From a known mission, rejected by its filter
+    RX_STATS_OVERFLOWS,     // Dropped with the RX ring full
+    RX_STATS_UPLOADED,      // Delivered to the server, live or replayed from the journal
+    RX_STATS_UPLOAD_FAILED, // Live upload failed, left to the journal
+    RX_STATS_COUNTERS
+} rx_stats_counter_t;
+
+typedef struct {
+    uint32_t session[RX_STATS_COUNTERS];  // Since boot
+    uint32_t lifetime[RX_STATS_COUNTERS]; // Restored from the last checkpoint plus session
+    float rssi[RX_STATS_QUANTILES];       // dBm, this session
+    float snr[RX_STATS_QUANTILES];        // dB
+    float rssi_min, rssi_max;
+    float snr_min, snr_max;
+    uint32_t last_minute;                 // Frames in the last complete minute
+    uint32_t peak_minute;                 // Most frames in one minute of the last hour
+    float hour_rate;                      // Frames per minute over the last hour
+} rx_stats_t;
+
+typedef struct {
+    uint32_t boots;         // Including this one
+    uint32_t sequence;      // Checkpoints taken, lifetime
+    uint32_t nvs_writes;    // This session
+    int64_t nvs_age_ms;     // Since the last NVS write, -1 if none this session
+    bool restored_from_rtc; // RTC memory was newer than NVS at boot
+} rx_stats_persist_t;
+
+// Restore the lifetime totals and start the checkpoint task. RTC memory is
+// updated every few seconds and survives a reset, NVS at most once per
+// nvs_interval_s when something changed and survives power loss.
+esp_err_t rx_stats_init(uint32_t nvs_interval_s);
+
+// One frame read from radio, only called by the RX task of that radio
+void rx_stats_frame(int radio, int16_t rssi, float snr);
+
+// Any counter but RX_STATS_FRAMES, from any task
+void rx_stats_count(int radio, rx_stats_counter_t counter, uint32_t n);
+
+// Snapshot of one radio, never blocks the RX tasks
+void rx_stats_get(int radio, rx_stats_t *stats);
+void rx_stats_get_persist(rx_stats_persist_t *persist);
+
+uint32_t rx_stats_session(rx_stats_counter_t counter); // Summed over the radios
+const char *rx_stats_counter_name(rx_stats_counter_t counter);
+
+// Write the lifetime totals to NVS now, before a planned restart
+esp_err_t rx_stats_flush();
+
+#ifdef __cplusplus
+}
+#endif
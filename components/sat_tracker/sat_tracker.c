@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "nvs.h"
+#include "api_calls.h"
+#include "sat_tracker.h"
+
+#define SAT_TRACKER_NAMESPACE "tracker"
+#define SAT_TRACKER_KEY "tle"
+#define SAT_TRACKER_MIN_TIME 1577836800 // 2020-01-01, the clock is not set before SNTP
+#define SPEED_OF_LIGHT 299792.458       // km/s
+
+static const char *TAG = "TRACKER";
+
+typedef struct {
+    sgp4_tle_t tle;
+    sgp4_t sat;
+    char text[SAT_TRACKER_TLE_MAX]; // Normalized lines, as stored
+} sat_entry_t;
+
+static sat_tracker_config_t station;
+static sgp4_observer_t observer;
+static SemaphoreHandle_t lock; // The console replaces element sets while the Doppler task propagates
+static sat_entry_t entries[SAT_TRACKER_MAX];
+static sat_entry_t parsed[SAT_TRACKER_MAX]; // Replacement list, under lock
+static int count;
+static uint32_t generation;
+
+// Parse every element set in text into out: a line 1 followed by a line 2,
+// with the line before them as the name when it is neither. Lines end in
+// \n or \r\n. Returns the number of sets, -1 if one does not parse or
+// propagate or there are more than max.
+static int sat_tracker_parse(const char *text, sat_entry_t *out, int max) {
+    char buf[SAT_TRACKER_TEXT_MAX];
+    char *lines[SAT_TRACKER_MAX * 3];
+    int nlines = 0;
+    char *save = NULL;
+
+    if (strlcpy(buf, text, sizeof(buf)) >= sizeof(buf)) {
+        return -1;
+    }
+    for (char *line = strtok_r(buf, "\r\n", &save); line != NULL; line = strtok_r(NULL, "\r\n", &save)) {
+        if (line[strspn(line, " ")] == '\0') {
+            continue;
+        }
+        if (nlines == sizeof(lines) / sizeof(lines[0])) {
+            return -1;
+        }
+        lines[nlines++] = line;
+    }
+
+    int found = 0;
+    for (int i = 0; i + 1 < nlines; i++) {
+        if (lines[i][0] != '1' || lines[i + 1][0] != '2') {
+            continue;
+        }
+        if (found == max) {
+            return -1;
+        }
+        const char *name = i > 0 && lines[i - 1][0] != '1' && lines[i - 1][0] != '2' ? lines[i - 1] : NULL;
+        sat_entry_t *entry = &out[found];
+        if (!sgp4_parse_tle(name, lines[i], lines[i + 1], &entry->tle)) {
+            return -1;
+        }
+        sgp4_err_t err = sgp4_init(&entry->sat, &entry->tle);
+        if (err != SGP4_OK) {
+            ESP_LOGW(TAG, "Elements of %05"PRIu32" do not propagate, error %d", entry->tle.catalog, err);
+            return -1;
+        }
+        snprintf(entry->text, sizeof(entry->text), "%s\n%.69s\n%.69s\n", entry->tle.name, lines[i], lines[i + 1]);
+        found++;
+        i++;
+    }
+    return found;
+}
+
+// Store the list after a change, the caller holds lock
+static esp_err_t sat_tracker_save() {
+    char text[SAT_TRACKER_TEXT_MAX] = "";
+    for (int i = 0; i < count; i++) {
+        strlcat(text, entries[i].text, sizeof(text));
+    }
+    generation++;
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SAT_TRACKER_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (count > 0) {
+        err = nvs_set_str(nvs, SAT_TRACKER_KEY, text);
+    } else {
+        err = nvs_erase_key(nvs, SAT_TRACKER_KEY);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+esp_err_t sat_tracker_init(const sat_tracker_config_t *config) {
+    station = *config;
+    sgp4_observer_init(&observer, config->latitude, config->longitude, config->altitude);
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    char text[SAT_TRACKER_TEXT_MAX];
+    size_t size = sizeof(text);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SAT_TRACKER_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_str(nvs, SAT_TRACKER_KEY, text, &size);
+        nvs_close(nvs);
+    }
+    if (err == ESP_OK) {
+        count = sat_tracker_parse(text, entries, SAT_TRACKER_MAX);
+        if (count <= 0) {
+            count = 0;
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Tracking %s (%05"PRIu32") and %d more", entries[0].tle.name, entries[0].tle.catalog, count - 1);
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No stored elements, Doppler correction is off");
+    } else {
+        ESP_LOGW(TAG, "Stored elements unusable: %s", esp_err_to_name(err));
+    }
+    return ESP_OK;
+}
+
+esp_err_t sat_tracker_set_tle(const char *text) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int found = sat_tracker_parse(text, parsed, SAT_TRACKER_MAX);
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (found > 0) {
+        memcpy(entries, parsed, found * sizeof(sat_entry_t));
+        count = found;
+        err = sat_tracker_save();
+        ESP_LOGI(TAG, "Tracking %s (%05"PRIu32") and %d more", entries[0].tle.name, entries[0].tle.catalog, count - 1);
+    }
+    xSemaphoreGive(lock);
+    return err;
+}
+
+esp_err_t sat_tracker_add_tle(const char *text) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (sat_tracker_parse(text, parsed, 1) == 1) {
+        int index = 0;
+        while (index < count && entries[index].tle.catalog != parsed[0].tle.catalog) {
+            index++;
+        }
+        if (index < count && parsed[0].tle.name[0] == '\0') {
+            // New elements for the same satellite given without the name line,
+            // stored as "\n<line 1>\n<line 2>\n"
+            char lines[SAT_TRACKER_TLE_MAX];
+            strlcpy(lines, parsed[0].text, sizeof(lines));
+            char *line2 = strchr(lines + 1, '\n');
+            *line2++ = '\0';
+            line2[strcspn(line2, "\n")] = '\0';
+            strlcpy(parsed[0].tle.name, entries[index].tle.name, sizeof(parsed[0].tle.name));
+            snprintf(parsed[0].text, sizeof(parsed[0].text), "%s\n%.69s\n%.69s\n", parsed[0].tle.name, lines + 1, line2);
+        }
+        if (index < SAT_TRACKER_MAX) {
+            entries[index] = parsed[0];
+            if (index == count) {
+                count++;
+            }
+            err = sat_tracker_save();
+            ESP_LOGI(TAG, "Elements of %s (%05"PRIu32") in slot %d", parsed[0].tle.name, parsed[0].tle.catalog, index);
+        } else {
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+    xSemaphoreGive(lock);
+    return err;
+}
+
+esp_err_t sat_tracker_remove(int index) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (index >= 0 && index < count) {
+        memmove(&entries[index], &entries[index + 1], (count - index - 1) * sizeof(sat_entry_t));
+        count--;
+        err = sat_tracker_save();
+    }
+    xSemaphoreGive(lock);
+    return err;
+}
+
+esp_err_t sat_tracker_refresh(const char *url) {
+    char res[DEFAULT_HTTP_BUF_SIZE] = "";
+    if (http_get(url, res)) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = sat_tracker_set_tle(res);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No element sets in the response of %s", url);
+    }
+    return err;
+}
+
+int sat_tracker_count() {
+    return count;
+}
+
+bool sat_tracker_get_tle(int index, sgp4_tle_t *out) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = index >= 0 && index < count;
+    if (found) {
+        *out = entries[index].tle;
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+uint32_t sat_tracker_generation() {
+    return generation;
+}
+
+bool sat_tracker_time_valid() {
+    return sat_tracker_now() > SAT_TRACKER_MIN_TIME;
+}
+
+double sat_tracker_now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+bool sat_tracker_update(int index, double t, sat_tracker_state_t *state) {
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = index >= 0 && index < count;
+    bool ok = found && sgp4_look(&entries[index].sat, &observer, t, &state->look) == SGP4_OK;
+    if (found) {
+        state->tle_age_days = (t - entries[index].tle.epoch) / 86400.0;
+    }
+    xSemaphoreGive(lock);
+    if (!ok) {
+        return false;
+    }
+    state->time = t;
+    state->doppler_hz = -(double)station.downlink_hz * state->look.range_rate / SPEED_OF_LIGHT;
+    state->compute_us = esp_timer_get_time() - start;
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sgp4.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SAT_TRACKER_MAX 4 // Satellites with an element set
+#define SAT_TRACKER_TLE_MAX (SGP4_NAME_MAX + 2 * (SGP4_TLE_LINE_LEN + 2)) // Three lines of one set as text
+#define SAT_TRACKER_TEXT_MAX (SAT_TRACKER_MAX * SAT_TRACKER_TLE_MAX)
+
+typedef struct {
+    double latitude;  // deg, north positive
+    double longitude; // deg, east positive
+    double altitude;  // m above the ellipsoid
+    long downlink_hz; // Carrier the first satellite transmits on
+} sat_tracker_config_t;
+
+// Where a satellite is seen from the station, at one instant
+typedef struct {
+    double time;           // Unix time, s
+    sgp4_look_t look;
+    long doppler_hz;       // Received minus transmitted frequency on downlink_hz
+    double tle_age_days;   // Time since the element set epoch
+    uint32_t compute_us;   // Propagation and look angles
+} sat_tracker_state_t;
+
+// Load the element sets stored in NVS, if any
+esp_err_t sat_tracker_init(const sat_tracker_config_t *config);
+
+// Replace the list with the element sets in text, two or three lines each
+// with the name line optional. The first one is the satellite followed for
+// Doppler. Stored in NVS once every set parses and propagates.
+esp_err_t sat_tracker_set_tle(const char *text);
+
+// Add one element set, replacing the one with the same catalog number
+esp_err_t sat_tracker_add_tle(const char *text);
+esp_err_t sat_tracker_remove(int index);
+
+// Fetch the element sets from url with the API client and store them. The
+// response buffer of the client holds three sets with their names.
+esp_err_t sat_tracker_refresh(const char *url);
+
+int sat_tracker_count();
+bool sat_tracker_get_tle(int index, sgp4_tle_t *tle);
+
+// Changes on every update of the list, for caches of derived data
+uint32_t sat_tracker_generation();
+
+// Wall clock set by SNTP, required for propagation
+bool sat_tracker_time_valid();
+double sat_tracker_now();
+
+// Propagate satellite index to Unix time t, false without that element
+// set or on a propagation error (decayed or out of range)
+bool sat_tracker_update(int index, double t, sat_tracker_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,425 @@
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include "sgp4.h"
+
+// Near-earth SGP4 as in Vallado et al., "Revisiting Spacetrack Report #3"
+// (AIAA 2006-6753), with the WGS-72 constants the element sets are fitted to.
+
+#define TWO_PI (2.0 * M_PI)
+#define DEG2RAD (M_PI / 180.0)
+#define MIN_PER_DAY 1440.0
+
+#define EARTH_RADIUS 6378.135         // km, WGS-72
+#define EARTH_MU 398600.8             // km^3/s^2, WGS-72
+#define J2 0.001082616
+#define J3 -0.00000253881
+#define J4 -0.00000165597
+#define J3OJ2 (J3 / J2)
+#define EARTH_ROTATION 7.292115146706979e-5 // rad/s
+
+#define WGS84_A 6378.137              // km, for the observer
+#define WGS84_F (1.0 / 298.257223563)
+
+#define UNIX_JD 2440587.5             // Julian date of 1970-01-01 00:00 UTC
+
+// Minutes per radian of time: sqrt(r^3 / mu) / 60 expressed as 1/xke
+static double xke() {
+    return 60.0 / sqrt(EARTH_RADIUS * EARTH_RADIUS * EARTH_RADIUS / EARTH_MU);
+}
+
+// Field of a TLE line: columns first to last, 1-based as in the format description
+static double tle_field(const char *line, int first, int last) {
+    char buf[16];
+    int n = last - first + 1;
+    memcpy(buf, line + first - 1, n);
+    buf[n] = '\0';
+    return atof(buf);
+}
+
+// Field with an assumed leading decimal point and an exponent, " 28098-4" is 0.28098e-4
+static double tle_exp_field(const char *line, int first, int last) {
+    char buf[20];
+    int n = 0;
+    const char *p = line + first - 1;
+    const char *end = line + last;
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    if (p < end && (*p == '-' || *p == '+')) {
+        buf[n++] = *p++;
+    }
+    buf[n++] = '.';
+    while (p < end && isdigit((unsigned char)*p)) {
+        buf[n++] = *p++;
+    }
+    if (p < end && (*p == '-' || *p == '+')) {
+        buf[n++] = 'e';
+        buf[n++] = *p++;
+        while (p < end && isdigit((unsigned char)*p)) {
+            buf[n++] = *p++;
+        }
+    }
+    buf[n] = '\0';
+    return atof(buf);
+}
+
+static bool tle_checksum(const char *line) {
+    int sum = 0;
+    for (int i = 0; i < SGP4_TLE_LINE_LEN - 1; i++) {
+        if (isdigit((unsigned char)line[i])) {
+            sum += line[i] - '0';
+        } else if (line[i] == '-') {
+            sum += 1;
+        }
+    }
+    return line[SGP4_TLE_LINE_LEN - 1] - '0' == sum % 10;
+}
+
+// Unix time of a TLE epoch: two digit year and fractional day of year
+static double tle_epoch(int year, double day) {
+    year += year < 57 ? 2000 : 1900;
+    // Days from 1970-01-01 to January 1st of year
+    int y = year - 1;
+    long days = 365L * (year - 1970) + (y / 4 - y / 100 + y / 400) - (1969 / 4 - 1969 / 100 + 1969 / 400);
+    return (days + day - 1.0) * 86400.0;
+}
+
+bool sgp4_parse_tle(const char *name, const char *line1, const char *line2, sgp4_tle_t *tle) {
+    if (strnlen(line1, SGP4_TLE_LINE_LEN) < SGP4_TLE_LINE_LEN ||
+        strnlen(line2, SGP4_TLE_LINE_LEN) < SGP4_TLE_LINE_LEN ||
+        line1[0] != '1' || line2[0] != '2' ||
+        !tle_checksum(line1) || !tle_checksum(line2) ||
+        strncmp(line1 + 2, line2 + 2, 5) != 0) {
+        return false;
+    }
+
+    memset(tle, 0, sizeof(*tle));
+    if (name != NULL) {
+        // Some sources prefix line 0 with "0 "
+        if (name[0] == '0' && name[1] == ' ') {
+            name += 2;
+        }
+        size_t len = strcspn(name, "\r\n");
+        while (len > 0 && name[len - 1] == ' ') {
+            len--;
+        }
+        if (len >= SGP4_NAME_MAX) {
+            len = SGP4_NAME_MAX - 1;
+        }
+        memcpy(tle->name, name, len);
+    }
+    tle->catalog = (uint32_t)tle_field(line1, 3, 7);
+    tle->epoch = tle_epoch((int)tle_field(line1, 19, 20), tle_field(line1, 21, 32));
+    tle->bstar = tle_exp_field(line1, 54, 61);
+    tle->inclination = tle_field(line2, 9, 16);
+    tle->raan = tle_field(line2, 18, 25);
+    tle->eccentricity = tle_field(line2, 27, 33) * 1e-7;
+    tle->arg_perigee = tle_field(line2, 35, 42);
+    tle->mean_anomaly = tle_field(line2, 44, 51);
+    tle->mean_motion = tle_field(line2, 53, 63);
+    return tle->mean_motion > 0;
+}
+
+sgp4_err_t sgp4_init(sgp4_t *sat, const sgp4_tle_t *tle) {
+    const double x2o3 = 2.0 / 3.0;
+    const double k = xke();
+
+    memset(sat, 0, sizeof(*sat));
+    sat->epoch = tle->epoch;
+    sat->bstar = tle->bstar;
+    sat->ecco = tle->eccentricity;
+    sat->inclo = tle->inclination * DEG2RAD;
+    sat->nodeo = tle->raan * DEG2RAD;
+    sat->argpo = tle->arg_perigee * DEG2RAD;
+    sat->mo = tle->mean_anomaly * DEG2RAD;
+    double no_kozai = tle->mean_motion * TWO_PI / MIN_PER_DAY;
+
+    // Recover the original mean motion and semi-major axis from the Kozai mean motion
+    double eccsq = sat->ecco * sat->ecco;
+    double omeosq = 1.0 - eccsq;
+    double rteosq = sqrt(omeosq);
+    double cosio = cos(sat->inclo);
+    double cosio2 = cosio * cosio;
+    double ak = pow(k / no_kozai, x2o3);
+    double d1 = 0.75 * J2 * (3.0 * cosio2 - 1.0) / (rteosq * omeosq);
+    double del = d1 / (ak * ak);
+    double adel = ak * (1.0 - del * del - del * (1.0 / 3.0 + 134.0 * del * del / 81.0));
+    del = d1 / (adel * adel);
+    sat->no_unkozai = no_kozai / (1.0 + del);
+    if (TWO_PI / sat->no_unkozai >= 225.0) {
+        return SGP4_ERR_DEEP_SPACE;
+    }
+
+    double ao = pow(k / sat->no_unkozai, x2o3);
+    double sinio = sin(sat->inclo);
+    double po = ao * omeosq;
+    double con42 = 1.0 - 5.0 * cosio2;
+    double posq = po * po;
+    double rp = ao * (1.0 - sat->ecco);
+    sat->ao = ao;
+    sat->cosio = cosio;
+    sat->sinio = sinio;
+    sat->con41 = -con42 - cosio2 - cosio2;
+
+    if (omeosq < 0.0 || sat->no_unkozai < 0.0) {
+        return SGP4_ERR_MEAN_MOTION;
+    }
+    sat->isimp = rp < 220.0 / EARTH_RADIUS + 1.0;
+
+    // Atmospheric density parameters move down for perigees below 156 km
+    double sfour = 78.0 / EARTH_RADIUS + 1.0;
+    double qzms24 = pow((120.0 - 78.0) / EARTH_RADIUS, 4);
+    double perige = (rp - 1.0) * EARTH_RADIUS;
+    if (perige < 156.0) {
+        sfour = perige < 98.0 ? 20.0 : perige - 78.0;
+        qzms24 = pow((120.0 - sfour) / EARTH_RADIUS, 4);
+        sfour = sfour / EARTH_RADIUS + 1.0;
+    }
+
+    double pinvsq = 1.0 / posq;
+    double tsi = 1.0 / (ao - sfour);
+    double eta = ao * sat->ecco * tsi;
+    double etasq = eta * eta;
+    double eeta = sat->ecco * eta;
+    double psisq = fabs(1.0 - etasq);
+    double coef = qzms24 * pow(tsi, 4);
+    double coef1 = coef / pow(psisq, 3.5);
+    double cc2 = coef1 * sat->no_unkozai * (ao * (1.0 + 1.5 * etasq + eeta * (4.0 + etasq)) +
+                 0.375 * J2 * tsi / psisq * sat->con41 * (8.0 + 3.0 * etasq * (8.0 + etasq)));
+    sat->cc1 = sat->bstar * cc2;
+    double cc3 = 0.0;
+    if (sat->ecco > 1.0e-4) {
+        cc3 = -2.0 * coef * tsi * J3OJ2 * sat->no_unkozai * sinio / sat->ecco;
+    }
+    sat->x1mth2 = 1.0 - cosio2;
+    sat->cc4 = 2.0 * sat->no_unkozai * coef1 * ao * omeosq *
+               (eta * (2.0 + 0.5 * etasq) + sat->ecco * (0.5 + 2.0 * etasq) -
+                J2 * tsi / (ao * psisq) *
+                (-3.0 * sat->con41 * (1.0 - 2.0 * eeta + etasq * (1.5 - 0.5 * eeta)) +
+                 0.75 * sat->x1mth2 * (2.0 * etasq - eeta * (1.0 + etasq)) * cos(2.0 * sat->argpo)));
+    sat->cc5 = 2.0 * coef1 * ao * omeosq * (1.0 + 2.75 * (etasq + eeta) + eeta * etasq);
+
+    // Secular rates of the mean anomaly, perigee and node
+    double cosio4 = cosio2 * cosio2;
+    double temp1 = 1.5 * J2 * pinvsq * sat->no_unkozai;
+    double temp2 = 0.5 * temp1 * J2 * pinvsq;
+    double temp3 = -0.46875 * J4 * pinvsq * pinvsq * sat->no_unkozai;
+    sat->mdot = sat->no_unkozai + 0.5 * temp1 * rteosq * sat->con41 +
+                0.0625 * temp2 * rteosq * (13.0 - 78.0 * cosio2 + 137.0 * cosio4);
+    sat->argpdot = -0.5 * temp1 * con42 + 0.0625 * temp2 * (7.0 - 114.0 * cosio2 + 395.0 * cosio4) +
+                   temp3 * (3.0 - 36.0 * cosio2 + 49.0 * cosio4);
+    double xhdot1 = -temp1 * cosio;
+    sat->nodedot = xhdot1 + (0.5 * temp2 * (4.0 - 19.0 * cosio2) + 2.0 * temp3 * (3.0 - 7.0 * cosio2)) * cosio;
+    sat->omgcof = sat->bstar * cc3 * cos(sat->argpo);
+    if (sat->ecco > 1.0e-4) {
+        sat->xmcof = -x2o3 * coef * sat->bstar / eeta;
+    }
+    sat->nodecf = 3.5 * omeosq * xhdot1 * sat->cc1;
+    sat->t2cof = 1.5 * sat->cc1;
+    // Avoid the division by zero at 180 degrees inclination
+    double den = fabs(cosio + 1.0) > 1.5e-12 ? 1.0 + cosio : 1.5e-12;
+    sat->xlcof = -0.25 * J3OJ2 * sinio * (3.0 + 5.0 * cosio) / den;
+    sat->aycof = -0.5 * J3OJ2 * sinio;
+    sat->eta = eta;
+    sat->delmo = pow(1.0 + eta * cos(sat->mo), 3);
+    sat->sinmao = sin(sat->mo);
+    sat->x7thm1 = 7.0 * cosio2 - 1.0;
+
+    if (!sat->isimp) {
+        double cc1sq = sat->cc1 * sat->cc1;
+        sat->d2 = 4.0 * ao * tsi * cc1sq;
+        double temp = sat->d2 * tsi * sat->cc1 / 3.0;
+        sat->d3 = (17.0 * ao + sfour) * temp;
+        sat->d4 = 0.5 * temp * ao * tsi * (221.0 * ao + 31.0 * sfour) * sat->cc1;
+        sat->t3cof = sat->d2 + 2.0 * cc1sq;
+        sat->t4cof = 0.25 * (3.0 * sat->d3 + sat->cc1 * (12.0 * sat->d2 + 10.0 * cc1sq));
+        sat->t5cof = 0.2 * (3.0 * sat->d4 + 12.0 * sat->cc1 * sat->d3 + 6.0 * sat->d2 * sat->d2 +
+                            15.0 * cc1sq * (2.0 * sat->d2 + cc1sq));
+    }
+
+    double r[3], v[3];
+    return sgp4_propagate(sat, 0.0, r, v);
+}
+
+sgp4_err_t sgp4_propagate(const sgp4_t *sat, double tsince, double r[3], double v[3]) {
+    const double x2o3 = 2.0 / 3.0;
+    const double k = xke();
+    const double vkmpersec = EARTH_RADIUS * k / 60.0;
+    double t = tsince;
+
+    // Secular gravity and atmospheric drag
+    double xmdf = sat->mo + sat->mdot * t;
+    double argpdf = sat->argpo + sat->argpdot * t;
+    double nodedf = sat->nodeo + sat->nodedot * t;
+    double argpm = argpdf;
+    double mm = xmdf;
+    double t2 = t * t;
+    double nodem = nodedf + sat->nodecf * t2;
+    double tempa = 1.0 - sat->cc1 * t;
+    double tempe = sat->bstar * sat->cc4 * t;
+    double templ = sat->t2cof * t2;
+
+    if (!sat->isimp) {
+        double delomg = sat->omgcof * t;
+        double delmtemp = 1.0 + sat->eta * cos(xmdf);
+        double delm = sat->xmcof * (delmtemp * delmtemp * delmtemp - sat->delmo);
+        double temp = delomg + delm;
+        mm = xmdf + temp;
+        argpm = argpdf - temp;
+        double t3 = t2 * t;
+        double t4 = t3 * t;
+        tempa = tempa - sat->d2 * t2 - sat->d3 * t3 - sat->d4 * t4;
+        tempe = tempe + sat->bstar * sat->cc5 * (sin(mm) - sat->sinmao);
+        templ = templ + sat->t3cof * t3 + t4 * (sat->t4cof + t * sat->t5cof);
+    }
+
+    double nm = sat->no_unkozai;
+    double em = sat->ecco;
+    if (nm <= 0.0) {
+        return SGP4_ERR_MEAN_MOTION;
+    }
+    double am = pow(k / nm, x2o3) * tempa * tempa;
+    nm = k / pow(am, 1.5);
+    em = em - tempe;
+    if (em >= 1.0 || em < -0.001) {
+        return SGP4_ERR_ECCENTRICITY;
+    }
+    if (em < 1.0e-6) {
+        em = 1.0e-6;
+    }
+    mm = mm + sat->no_unkozai * templ;
+    double xlm = mm + argpm + nodem;
+    nodem = fmod(nodem, TWO_PI);
+    argpm = fmod(argpm, TWO_PI);
+    xlm = fmod(xlm, TWO_PI);
+    mm = fmod(xlm - argpm - nodem, TWO_PI);
+
+    // Long period periodics
+    double axnl = em * cos(argpm);
+    double temp = 1.0 / (am * (1.0 - em * em));
+    double aynl = em * sin(argpm) + temp * sat->aycof;
+    double xl = mm + argpm + nodem + temp * sat->xlcof * axnl;
+
+    // Kepler's equation
+    double u = fmod(xl - nodem, TWO_PI);
+    double eo1 = u;
+    double tem5 = 9999.9;
+    double sineo1 = 0.0, coseo1 = 0.0;
+    for (int ktr = 1; fabs(tem5) >= 1.0e-12 && ktr <= 10; ktr++) {
+        sineo1 = sin(eo1);
+        coseo1 = cos(eo1);
+        tem5 = 1.0 - coseo1 * axnl - sineo1 * aynl;
+        tem5 = (u - aynl * coseo1 + axnl * sineo1 - eo1) / tem5;
+        if (fabs(tem5) >= 0.95) {
+            tem5 = tem5 > 0.0 ? 0.95 : -0.95;
+        }
+        eo1 = eo1 + tem5;
+    }
+
+    // Short period preliminary quantities
+    double ecose = axnl * coseo1 + aynl * sineo1;
+    double esine = axnl * sineo1 - aynl * coseo1;
+    double el2 = axnl * axnl + aynl * aynl;
+    double pl = am * (1.0 - el2);
+    if (pl < 0.0) {
+        return SGP4_ERR_SEMI_LATUS;
+    }
+    double rl = am * (1.0 - ecose);
+    double rdotl = sqrt(am) * esine / rl;
+    double rvdotl = sqrt(pl) / rl;
+    double betal = sqrt(1.0 - el2);
+    temp = esine / (1.0 + betal);
+    double sinu = am / rl * (sineo1 - aynl - axnl * temp);
+    double cosu = am / rl * (coseo1 - axnl + aynl * temp);
+    double su = atan2(sinu, cosu);
+    double sin2u = (cosu + cosu) * sinu;
+    double cos2u = 1.0 - 2.0 * sinu * sinu;
+    temp = 1.0 / pl;
+    double temp1 = 0.5 * J2 * temp;
+    double temp2 = temp1 * temp;
+
+    // Short periodics
+    double mrt = rl * (1.0 - 1.5 * temp2 * betal * sat->con41) + 0.5 * temp1 * sat->x1mth2 * cos2u;
+    su = su - 0.25 * temp2 * sat->x7thm1 * sin2u;
+    double xnode = nodem + 1.5 * temp2 * sat->cosio * sin2u;
+    double xinc = sat->inclo + 1.5 * temp2 * sat->cosio * sat->sinio * cos2u;
+    double mvt = rdotl - nm * temp1 * sat->x1mth2 * sin2u / k;
+    double rvdot = rvdotl + nm * temp1 * (sat->x1mth2 * cos2u + 1.5 * sat->con41) / k;
+
+    // Orientation vectors
+    double sinsu = sin(su), cossu = cos(su);
+    double snod = sin(xnode), cnod = cos(xnode);
+    double sini = sin(xinc), cosi = cos(xinc);
+    double xmx = -snod * cosi;
+    double xmy = cnod * cosi;
+    double ux = xmx * sinsu + cnod * cossu;
+    double uy = xmy * sinsu + snod * cossu;
+    double uz = sini * sinsu;
+    double vx = xmx * cossu - cnod * sinsu;
+    double vy = xmy * cossu - snod * sinsu;
+    double vz = sini * cossu;
+
+    r[0] = mrt * ux * EARTH_RADIUS;
+    r[1] = mrt * uy * EARTH_RADIUS;
+    r[2] = mrt * uz * EARTH_RADIUS;
+    v[0] = (mvt * ux + rvdot * vx) * vkmpersec;
+    v[1] = (mvt * uy + rvdot * vy) * vkmpersec;
+    v[2] = (mvt * uz + rvdot * vz) * vkmpersec;
+    return mrt < 1.0 ? SGP4_ERR_DECAYED : SGP4_OK;
+}
+
+double sgp4_gmst(double t) {
+    // IAU 1982, UT1 taken as UTC
+    double tut1 = (t / 86400.0 + UNIX_JD - 2451545.0) / 36525.0;
+    double temp = -6.2e-6 * tut1 * tut1 * tut1 + 0.093104 * tut1 * tut1 +
+                  (876600.0 * 3600.0 + 8640184.812866) * tut1 + 67310.54841;
+    temp = fmod(temp * DEG2RAD / 240.0, TWO_PI);
+    return temp < 0.0 ? temp + TWO_PI : temp;
+}
+
+void sgp4_observer_init(sgp4_observer_t *obs, double lat_deg, double lon_deg, double alt_m) {
+    const double e2 = WGS84_F * (2.0 - WGS84_F);
+    obs->lat = lat_deg * DEG2RAD;
+    obs->lon = lon_deg * DEG2RAD;
+    double sinlat = sin(obs->lat);
+    double n = WGS84_A / sqrt(1.0 - e2 * sinlat * sinlat);
+    double h = alt_m / 1000.0;
+    obs->ecef[0] = (n + h) * cos(obs->lat) * cos(obs->lon);
+    obs->ecef[1] = (n + h) * cos(obs->lat) * sin(obs->lon);
+    obs->ecef[2] = (n * (1.0 - e2) + h) * sinlat;
+}
+
+sgp4_err_t sgp4_look(const sgp4_t *sat, const sgp4_observer_t *obs, double t, sgp4_look_t *look) {
+    double r[3], v[3];
+    sgp4_err_t err = sgp4_propagate(sat, (t - sat->epoch) / 60.0, r, v);
+    if (err != SGP4_OK) {
+        return err;
+    }
+
+    // TEME to earth fixed, polar motion is well below what Doppler needs
+    double g = sgp4_gmst(t);
+    double cg = cos(g), sg = sin(g);
+    double x = cg * r[0] + sg * r[1];
+    double y = -sg * r[0] + cg * r[1];
+    double vx = cg * v[0] + sg * v[1] + EARTH_ROTATION * y;
+    double vy = -sg * v[0] + cg * v[1] - EARTH_ROTATION * x;
+
+    double rho[3] = { x - obs->ecef[0], y - obs->ecef[1], r[2] - obs->ecef[2] };
+    double range = sqrt(rho[0] * rho[0] + rho[1] * rho[1] + rho[2] * rho[2]);
+
+    // Topocentric south, east, zenith
+    double sinlat = sin(obs->lat), coslat = cos(obs->lat);
+    double sinlon = sin(obs->lon), coslon = cos(obs->lon);
+    double south = sinlat * coslon * rho[0] + sinlat * sinlon * rho[1] - coslat * rho[2];
+    double east = -sinlon * rho[0] + coslon * rho[1];
+    double zenith = coslat * coslon * rho[0] + coslat * sinlon * rho[1] + sinlat * rho[2];
+
+    double azimuth = atan2(east, -south) / DEG2RAD;
+    look->azimuth = azimuth < 0.0 ? azimuth + 360.0 : azimuth;
+    look->elevation = asin(zenith / range) / DEG2RAD;
+    look->range = range;
+    look->range_rate = (rho[0] * vx + rho[1] * vy + rho[2] * v[2]) / range;
+    return SGP4_OK;
+}
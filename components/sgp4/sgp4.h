@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SGP4_TLE_LINE_LEN 69
+#define SGP4_NAME_MAX 25 // Line 0 of a three-line element set
+
+// Mean elements of a two-line element set, in TLE units
+typedef struct {
+    char name[SGP4_NAME_MAX];
+    uint32_t catalog;
+    double epoch;        // Unix time, s
+    double bstar;        // Drag term, 1/earth radii
+    double inclination;  // deg
+    double raan;         // Right ascension of the ascending node, deg
+    double eccentricity;
+    double arg_perigee;  // deg
+    double mean_anomaly; // deg
+    double mean_motion;  // rev/day
+} sgp4_tle_t;
+
+// Propagator state, set up once per element set by sgp4_init()
+typedef struct {
+    double epoch;
+    double bstar, ecco, inclo, nodeo, argpo, mo, no_unkozai;
+    double ao, con41, x1mth2, x7thm1, cosio, sinio;
+    double mdot, argpdot, nodedot, nodecf;
+    double cc1, cc4, cc5, d2, d3, d4, t2cof, t3cof, t4cof, t5cof;
+    double omgcof, xmcof, xlcof, aycof, eta, delmo, sinmao;
+    bool isimp; // Perigee below 220 km, drop the higher order drag terms
+} sgp4_t;
+
+// Ground station position, precomputed from geodetic coordinates
+typedef struct {
+    double lat, lon;   // rad
+    double ecef[3];    // km
+} sgp4_observer_t;
+
+// Satellite as seen from the observer
+typedef struct {
+    double azimuth;    // deg, from north through east
+    double elevation;  // deg
+    double range;      // km
+    double range_rate; // km/s, positive moving away
+} sgp4_look_t;
+
+typedef enum {
+    SGP4_OK = 0,
+    SGP4_ERR_ECCENTRICITY,  // Mean eccentricity out of range
+    SGP4_ERR_MEAN_MOTION,   // Mean motion below zero
+    SGP4_ERR_SEMI_LATUS,    // Semi-latus rectum below zero
+    SGP4_ERR_DECAYED,       // Orbit below the earth surface
+    SGP4_ERR_DEEP_SPACE,    // Period of 225 min or more, SDP4 is not implemented
+} sgp4_err_t;
+
+// Parse the two element lines, name may be NULL. Checks the line numbers,
+// the checksums and that both lines are for the same satellite.
+bool sgp4_parse_tle(const char *name, const char *line1, const char *line2, sgp4_tle_t *tle);
+
+// Initialize the propagator from mean elements, near-earth orbits only
+sgp4_err_t sgp4_init(sgp4_t *sat, const sgp4_tle_t *tle);
+
+// Position and velocity in the TEME frame, km and km/s, at minutes from epoch
+sgp4_err_t sgp4_propagate(const sgp4_t *sat, double tsince, double r[3], double v[3]);
+
+// Greenwich mean sidereal time at Unix time t, rad
+double sgp4_gmst(double t);
+
+void sgp4_observer_init(sgp4_observer_t *obs, double lat_deg, double lon_deg, double alt_m);
+
+// Azimuth, elevation, range and range rate at Unix time t
+sgp4_err_t sgp4_look(const sgp4_t *sat, const sgp4_observer_t *obs, double t, sgp4_look_t *look);
+
+#ifdef __cplusplus
+}
+#endif
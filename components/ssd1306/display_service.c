@@ -0,0 +1,207 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+
+#include "display_service.h"
+
+#define TAG "DISPLAY"
+
+#define DISPLAY_QUEUE_LEN 16
+#define DISPLAY_TASK_STACK (1024 * 3)
+#define DISPLAY_TASK_PRIORITY 2
+
+static SSD1306_t * display_dev;
+static QueueHandle_t display_queue;
+static TickType_t frame_ticks;
+static display_stats_t stats;
+static uint8_t shadow[8][128]; // What the panel shows after the last flush
+static bool synced; // shadow is meaningless until the first full frame
+
+static void display_draw_progress(SSD1306_t * dev, int page, int percent)
+{
+	uint8_t bar[128];
+	int width = dev->_width;
+	int filled = 1 + (width - 2) * percent / 100;
+	for (int seg=0;seg<width;seg++) {
+		if (seg == 0 || seg == width - 1 || seg < filled) {
+			bar[seg] = 0x7E;
+		} else {
+			bar[seg] = 0x42;
+		}
+	}
+	if (dev->_flip) ssd1306_flip(bar, width);
+	ssd1306_display_image(dev, page, 0, bar, width);
+}
+
+static void display_apply(SSD1306_t * dev, display_cmd_t * cmd)
+{
+	switch (cmd->type) {
+	case DISPLAY_CMD_CLEAR:
+		ssd1306_clear_screen(dev, cmd->invert);
+		break;
+	case DISPLAY_CMD_TEXT:
+		ssd1306_clear_line(dev, cmd->page, cmd->invert);
+		ssd1306_display_text(dev, cmd->page, cmd->text, strlen(cmd->text), cmd->invert);
+		break;
+	case DISPLAY_CMD_TEXT_X3:
+		ssd1306_clear_line(dev, cmd->page, cmd->invert);
+		ssd1306_display_text_x3(dev, cmd->page, cmd->text, strlen(cmd->text), cmd->invert);
+		break;
+	case DISPLAY_CMD_BITMAP:
+		ssd1306_bitmaps(dev, cmd->bitmap.xpos, cmd->bitmap.ypos, (uint8_t *)cmd->bitmap.data,
+			cmd->bitmap.width, cmd->bitmap.height, cmd->invert);
+		break;
+	case DISPLAY_CMD_PROGRESS:
+		display_draw_progress(dev, cmd->page, cmd->percent);
+		break;
+	}
+}
+
+// Trim dirty spans to the columns that differ from what the panel already
+// shows, so a clear followed by the same text sends nothing.
+static bool display_trim(SSD1306_t * dev)
+{
+	bool dirty = false;
+	if (!synced) {
+		for (int page=0;page<dev->_pages;page++) {
+			memcpy(shadow[page], dev->_page[page]._segs, dev->_width);
+		}
+		synced = true;
+		return true;
+	}
+	for (int page=0;page<dev->_pages;page++) {
+		PAGE_t * _page = &dev->_page[page];
+		while (_page->_dirtyStart <= _page->_dirtyEnd &&
+			_page->_segs[_page->_dirtyStart] == shadow[page][_page->_dirtyStart]) {
+			_page->_dirtyStart++;
+		}
+		while (_page->_dirtyEnd >= _page->_dirtyStart &&
+			_page->_segs[_page->_dirtyEnd] == shadow[page][_page->_dirtyEnd]) {
+			_page->_dirtyEnd--;
+		}
+		if (_page->_dirtyStart <= _page->_dirtyEnd) {
+			memcpy(&shadow[page][_page->_dirtyStart], &_page->_segs[_page->_dirtyStart],
+				_page->_dirtyEnd - _page->_dirtyStart + 1);
+			dirty = true;
+		} else {
+			_page->_dirtyStart = dev->_width;
+			_page->_dirtyEnd = -1;
+		}
+	}
+	return dirty;
+}
+
+static void display_task(void * arg)
+{
+	SSD1306_t * dev = display_dev;
+	TickType_t last_flush = xTaskGetTickCount() - frame_ticks;
+	display_cmd_t cmd;
+
+	while (true) {
+		xQueueReceive(display_queue, &cmd, portMAX_DELAY);
+		display_apply(dev, &cmd);
+
+		// Keep applying until the next frame slot, then render once
+		TickType_t next = last_flush + frame_ticks;
+		while (true) {
+			TickType_t now = xTaskGetTickCount();
+			TickType_t wait = (int32_t)(next - now) > 0 ? next - now : 0;
+			if (xQueueReceive(display_queue, &cmd, wait) != pdTRUE) break;
+			display_apply(dev, &cmd);
+		}
+
+		if (display_trim(dev)) {
+			ssd1306_flush(dev);
+			stats.frames++;
+		} else {
+			stats.skipped++;
+		}
+		last_flush = xTaskGetTickCount();
+	}
+}
+
+esp_err_t display_service_start(SSD1306_t * dev, int max_fps)
+{
+	if (display_queue != NULL) return ESP_ERR_INVALID_STATE;
+	if (max_fps <= 0) max_fps = 1;
+
+	display_dev = dev;
+	frame_ticks = pdMS_TO_TICKS(1000 / max_fps);
+	if (frame_ticks == 0) frame_ticks = 1;
+	// The panel content is unknown, force the first frame out entirely
+	synced = false;
+	for (int page=0;page<dev->_pages;page++) {
+		dev->_page[page]._dirtyStart = 0;
+		dev->_page[page]._dirtyEnd = dev->_width - 1;
+	}
+	ssd1306_framebuffer(dev, true);
+
+	display_queue = xQueueCreate(DISPLAY_QUEUE_LEN, sizeof(display_cmd_t));
+	if (display_queue == NULL) return ESP_ERR_NO_MEM;
+	if (xTaskCreate(&display_task, "display", DISPLAY_TASK_STACK, NULL, DISPLAY_TASK_PRIORITY, NULL) != pdPASS) {
+		vQueueDelete(display_queue);
+		display_queue = NULL;
+		return ESP_ERR_NO_MEM;
+	}
+	ESP_LOGI(TAG, "Display service started, %d fps max", max_fps);
+	return ESP_OK;
+}
+
+void display_service_get_stats(display_stats_t * out)
+{
+	*out = stats;
+}
+
+static bool display_post(display_cmd_t * cmd)
+{
+	if (display_queue == NULL) return false;
+	// Never block the caller on the display
+	if (xQueueSend(display_queue, cmd, 0) != pdTRUE) {
+		stats.dropped++;
+		return false;
+	}
+	stats.posted++;
+	return true;
+}
+
+bool display_clear(void)
+{
+	display_cmd_t cmd = { .type = DISPLAY_CMD_CLEAR };
+	return display_post(&cmd);
+}
+
+bool display_text(int page, const char * text, bool invert)
+{
+	display_cmd_t cmd = { .type = DISPLAY_CMD_TEXT, .page = page, .invert = invert };
+	strlcpy(cmd.text, text, sizeof(cmd.text));
+	return display_post(&cmd);
+}
+
+bool display_text_x3(int page, const char * text, bool invert)
+{
+	display_cmd_t cmd = { .type = DISPLAY_CMD_TEXT_X3, .page = page, .invert = invert };
+	strlcpy(cmd.text, text, sizeof(cmd.text));
+	return display_post(&cmd);
+}
+
+bool display_bitmap(int xpos, int ypos, const uint8_t * bitmap, int width, int height, bool invert)
+{
+	display_cmd_t cmd = {
+		.type = DISPLAY_CMD_BITMAP,
+		.invert = invert,
+		.bitmap = { .data = bitmap, .xpos = xpos, .ypos = ypos, .width = width, .height = height },
+	};
+	return display_post(&cmd);
+}
+
+bool display_progress(int page, int percent)
+{
+	if (percent < 0) percent = 0;
+	if (percent > 100) percent = 100;
+	display_cmd_t cmd = { .type = DISPLAY_CMD_PROGRESS, .page = page, .percent = percent };
+	return display_post(&cmd);
+}
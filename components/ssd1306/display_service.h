@@ -0,0 +1,67 @@
+#ifndef MAIN_DISPLAY_SERVICE_H_
+#define MAIN_DISPLAY_SERVICE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "ssd1306.h"
+
+// The display service owns an SSD1306_t. Any task posts draw commands
+// without waiting on the bus; the service task applies them to the
+// framebuffer and flushes at most max_fps times per second, so a burst of
+// commands ends up as a single transfer of the columns that changed.
+
+#define DISPLAY_TEXT_MAX 16
+
+typedef enum {
+	DISPLAY_CMD_CLEAR,
+	DISPLAY_CMD_TEXT,
+	DISPLAY_CMD_TEXT_X3,
+	DISPLAY_CMD_BITMAP,
+	DISPLAY_CMD_PROGRESS,
+} display_cmd_type_t;
+
+typedef struct {
+	display_cmd_type_t type;
+	uint8_t page;
+	bool invert;
+	union {
+		char text[DISPLAY_TEXT_MAX + 1];
+		uint8_t percent;
+		struct {
+			const uint8_t * data; // Must stay valid until drawn
+			int16_t xpos;
+			int16_t ypos;
+			int16_t width;
+			int16_t height;
+		} bitmap;
+	};
+} display_cmd_t;
+
+typedef struct {
+	uint32_t posted;
+	uint32_t dropped; // Queue was full
+	uint32_t frames;
+	uint32_t skipped; // Flushes that found nothing different on screen
+} display_stats_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t display_service_start(SSD1306_t * dev, int max_fps);
+void display_service_get_stats(display_stats_t * stats);
+
+// All of these return false if the command was dropped
+bool display_clear(void);
+bool display_text(int page, const char * text, bool invert);
+bool display_text_x3(int page, const char * text, bool invert);
+bool display_bitmap(int xpos, int ypos, const uint8_t * bitmap, int width, int height, bool invert);
+bool display_progress(int page, int percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MAIN_DISPLAY_SERVICE_H_ */
@@ -10,8 +10,19 @@
 
 #define TAG "SSD1306"
 
+#define SPAN_OVERHEAD 14 // Addressing bytes of one span in horizontal mode
+
 #define PACK8 __attribute__((aligned( __alignof__( uint8_t ) ), packed ))
 
+// Bit reversal of every byte value, used to flip column bytes upside down
+#define R2(n) n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n) R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
+static const uint8_t ssd1306_reverse_lut[256] = { R6(0), R6(2), R6(1), R6(3) };
+#undef R2
+#undef R4
+#undef R6
+
 typedef union out_column_t {
 	uint32_t u32;
 	uint8_t  u8[4];
@@ -27,7 +38,11 @@ void ssd1306_init(SSD1306_t * dev, int width, int height)
 	// Initialize internal buffer
 	for (int i=0;i<dev->_pages;i++) {
 		memset(dev->_page[i]._segs, 0, 128);
+		dev->_page[i]._dirtyStart = dev->_width;
+		dev->_page[i]._dirtyEnd = -1;
 	}
+	dev->_framebuffer = false;
+	ssd1306_reset_stats(dev);
 }
 
 int ssd1306_get_width(SSD1306_t * dev)
@@ -45,8 +60,86 @@ int ssd1306_get_pages(SSD1306_t * dev)
 	return dev->_pages;
 }
 
+static void ssd1306_mark_dirty(SSD1306_t * dev, int page, int seg, int width)
+{
+	PAGE_t * _page = &dev->_page[page];
+	if (seg + width > dev->_width) width = dev->_width - seg;
+	if (seg < _page->_dirtyStart) _page->_dirtyStart = seg;
+	if (seg + width - 1 > _page->_dirtyEnd) _page->_dirtyEnd = seg + width - 1;
+}
+
+static void ssd1306_mark_clean(SSD1306_t * dev)
+{
+	for (int page=0; page<dev->_pages;page++) {
+		dev->_page[page]._dirtyStart = dev->_width;
+		dev->_page[page]._dirtyEnd = -1;
+	}
+}
+
+void ssd1306_framebuffer(SSD1306_t * dev, bool enable)
+{
+	if (dev->_framebuffer && !enable) ssd1306_flush(dev);
+	dev->_framebuffer = enable;
+}
+
+static void ssd1306_display_frame(SSD1306_t * dev)
+{
+	if (dev->_address == SPIAddress) {
+		spi_display_frame(dev);
+	} else {
+		i2c_display_frame(dev);
+	}
+}
+
+// Send every dirty span, one transfer per page
+void ssd1306_flush(SSD1306_t * dev)
+{
+	bool sent = false;
+#if CONFIG_HORIZONTAL_ADDRESSING
+	// Once the spans cost about as much as the whole frame, send it in one burst
+	int cost = 0;
+	for (int page=0; page<dev->_pages;page++) {
+		PAGE_t * _page = &dev->_page[page];
+		if (_page->_dirtyEnd < _page->_dirtyStart) continue;
+		cost += _page->_dirtyEnd - _page->_dirtyStart + 1 + SPAN_OVERHEAD;
+	}
+	if (cost >= dev->_pages * dev->_width) {
+		ssd1306_mark_clean(dev);
+		ssd1306_display_frame(dev);
+		dev->_flushCount++;
+		return;
+	}
+#endif
+	for (int page=0; page<dev->_pages;page++) {
+		PAGE_t * _page = &dev->_page[page];
+		if (_page->_dirtyEnd < _page->_dirtyStart) continue;
+		int seg = _page->_dirtyStart;
+		int width = _page->_dirtyEnd - _page->_dirtyStart + 1;
+		if (dev->_address == SPIAddress) {
+			spi_display_image(dev, page, seg, &_page->_segs[seg], width);
+		} else {
+			i2c_display_image(dev, page, seg, &_page->_segs[seg], width);
+		}
+		_page->_dirtyStart = dev->_width;
+		_page->_dirtyEnd = -1;
+		sent = true;
+	}
+	if (sent) dev->_flushCount++;
+}
+
+void ssd1306_reset_stats(SSD1306_t * dev)
+{
+	dev->_txCount = 0;
+	dev->_txBytes = 0;
+	dev->_flushCount = 0;
+}
+
 void ssd1306_show_buffer(SSD1306_t * dev)
 {
+	ssd1306_mark_clean(dev);
+#if CONFIG_HORIZONTAL_ADDRESSING
+	ssd1306_display_frame(dev);
+#else
 	if (dev->_address == SPIAddress) {
 		for (int page=0; page<dev->_pages;page++) {
 			spi_display_image(dev, page, 0, dev->_page[page]._segs, dev->_width);
@@ -56,6 +149,7 @@ void ssd1306_show_buffer(SSD1306_t * dev)
 			i2c_display_image(dev, page, 0, dev->_page[page]._segs, dev->_width);
 		}
 	}
+#endif
 }
 
 void ssd1306_set_buffer(SSD1306_t * dev, uint8_t * buffer)
@@ -78,6 +172,24 @@ void ssd1306_get_buffer(SSD1306_t * dev, uint8_t * buffer)
 
 void ssd1306_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width)
 {
+	if (dev->_framebuffer) {
+		if (page >= dev->_pages) return;
+		if (seg + width > dev->_width) width = dev->_width - seg;
+		// Only the columns that really change go on the bus
+		uint8_t * segs = &dev->_page[page]._segs[seg];
+		int first = -1;
+		int last = -1;
+		for (int i=0;i<width;i++) {
+			if (segs[i] != images[i]) {
+				if (first < 0) first = i;
+				last = i;
+			}
+		}
+		if (first < 0) return;
+		memcpy(&segs[first], &images[first], last - first + 1);
+		ssd1306_mark_dirty(dev, page, seg + first, last - first + 1);
+		return;
+	}
 	if (dev->_address == SPIAddress) {
 		spi_display_image(dev, page, seg, images, width);
 	} else {
@@ -154,12 +266,7 @@ ssd1306_display_text_x3(SSD1306_t * dev, int page, char * text, int text_len, bo
 			}
 			if (invert) ssd1306_invert(image, 24);
 			if (dev->_flip) ssd1306_flip(image, 24);
-			if (dev->_address == SPIAddress) {
-				spi_display_image(dev, page+yy, seg, image, 24);
-			} else {
-				i2c_display_image(dev, page+yy, seg, image, 24);
-			}
-			memcpy(&dev->_page[page+yy]._segs[seg], image, 24);
+			ssd1306_display_image(dev, page+yy, seg, image, 24);
 		}
 		seg = seg + 24;
 	}
@@ -167,11 +274,19 @@ ssd1306_display_text_x3(SSD1306_t * dev, int page, char * text, int text_len, bo
 
 void ssd1306_clear_screen(SSD1306_t * dev, bool invert)
 {
-	char space[16];
-	memset(space, 0x00, sizeof(space));
+	uint8_t blank[128];
+	memset(blank, invert ? 0xFF : 0x00, sizeof(blank));
+	if (dev->_framebuffer) {
+		for (int page = 0; page < dev->_pages; page++) {
+			ssd1306_display_image(dev, page, 0, blank, dev->_width);
+		}
+		return;
+	}
+	// Whole screen at once instead of one transfer per glyph
 	for (int page = 0; page < dev->_pages; page++) {
-		ssd1306_display_text(dev, page, space, sizeof(space), invert);
+		memcpy(dev->_page[page]._segs, blank, sizeof(blank));
 	}
+	ssd1306_show_buffer(dev);
 }
 
 void ssd1306_clear_line(SSD1306_t * dev, int page, bool invert)
@@ -226,7 +341,11 @@ void ssd1306_scroll_text(SSD1306_t * dev, char * text, int text_len, bool invert
 		for(int seg = 0; seg < dev->_width; seg++) {
 			dev->_page[dstIndex]._segs[seg] = dev->_page[srcIndex]._segs[seg];
 		}
-		(*func)(dev, dstIndex, 0, dev->_page[dstIndex]._segs, sizeof(dev->_page[dstIndex]._segs));
+		if (dev->_framebuffer) {
+			ssd1306_mark_dirty(dev, dstIndex, 0, dev->_width);
+		} else {
+			(*func)(dev, dstIndex, 0, dev->_page[dstIndex]._segs, sizeof(dev->_page[dstIndex]._segs));
+		}
 		if (srcIndex == dev->_scStart) break;
 		srcIndex = srcIndex - dev->_scDirection;
 	}
@@ -410,6 +529,42 @@ void ssd1306_wrap_arround(SSD1306_t * dev, ssd1306_scroll_type_t scroll, int sta
 
 }
 
+// 8x8 bit matrix transpose (Hacker's Delight, 7-7).
+// rows[n] holds 8 pixels with the leftmost in bit 7, cols[c] gets column c with row n in bit n.
+static inline void ssd1306_transpose8(const uint8_t * rows, uint8_t * cols)
+{
+	// Rows go in bottom up so row 0 ends up in bit 0 of every column
+	uint32_t x = (rows[7] << 24) | (rows[6] << 16) | (rows[5] << 8) | rows[4];
+	uint32_t y = (rows[3] << 24) | (rows[2] << 16) | (rows[1] << 8) | rows[0];
+	uint32_t t;
+
+	t = (x ^ (x >> 7)) & 0x00AA00AA; x = x ^ t ^ (t << 7);
+	t = (y ^ (y >> 7)) & 0x00AA00AA; y = y ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+	t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+	t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+	y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+	x = t;
+
+	cols[0] = x >> 24; cols[1] = x >> 16; cols[2] = x >> 8; cols[3] = x;
+	cols[4] = y >> 24; cols[5] = y >> 16; cols[6] = y >> 8; cols[7] = y;
+}
+
+// Merge the masked bits of one column byte into a page
+static inline void ssd1306_blit_byte(SSD1306_t * dev, int page, int seg, uint8_t bits, uint8_t mask)
+{
+	if (page >= dev->_pages) return;
+	if (dev->_flip) {
+		bits = ssd1306_reverse_lut[bits];
+		mask = ssd1306_reverse_lut[mask];
+	}
+	uint8_t * dst = &dev->_page[page]._segs[seg];
+	*dst = (*dst & ~mask) | bits;
+}
+
+// bitmap is row-major 1bpp, leftmost pixel in the MSB. Eight rows are
+// transposed at a time into page-major column bytes, an unaligned ypos
+// splits each column byte across two pages.
 void ssd1306_bitmaps(SSD1306_t * dev, int xpos, int ypos, uint8_t * bitmap, int width, int height, bool invert)
 {
 	if ( (width % 8) != 0) {
@@ -417,50 +572,45 @@ void ssd1306_bitmaps(SSD1306_t * dev, int xpos, int ypos, uint8_t * bitmap, int
 		return;
 	}
 	int _width = width / 8;
-	uint8_t wk0;
-	uint8_t wk1;
-	uint8_t wk2;
-	uint8_t page = (ypos / 8);
-	uint8_t _seg = xpos;
-	uint8_t dstBits = (ypos % 8);
-	ESP_LOGD(TAG, "ypos=%d page=%d dstBits=%d", ypos, page, dstBits);
-	int offset = 0;
-	for(int _height=0;_height<height;_height++) {
-		for (int index=0;index<_width;index++) {
-			for (int srcBits=7; srcBits>=0; srcBits--) {
-				wk0 = dev->_page[page]._segs[_seg];
-				if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
-
-				wk1 = bitmap[index+offset];
-				if (invert) wk1 = ~wk1;
-
-				//wk2 = ssd1306_copy_bit(bitmap[index+offset], srcBits, wk0, dstBits);
-				wk2 = ssd1306_copy_bit(wk1, srcBits, wk0, dstBits);
-				if (dev->_flip) wk2 = ssd1306_rotate_byte(wk2);
+	int shift = ypos % 8;
+	uint8_t xor = invert ? 0xFF : 0x00;
+	uint8_t rows[8];
+	uint8_t cols[8];
+
+	for (int row=0; row<height; row+=8) {
+		int count = height - row;
+		if (count > 8) count = 8;
+		uint8_t mask = 0xFF >> (8 - count);
+		int page = (ypos + row) / 8;
+		if (page >= dev->_pages) break;
+
+		for (int index=0; index<_width; index++) {
+			int seg = xpos + index * 8;
+			if (seg >= dev->_width) break;
+			const uint8_t * src = &bitmap[row * _width + index];
+			for (int n=0; n<8; n++) {
+				rows[n] = n < count ? src[n * _width] ^ xor : 0;
+			}
+			ssd1306_transpose8(rows, cols);
 
-				ESP_LOGD(TAG, "index=%d offset=%d page=%d _seg=%d, wk2=%02x", index, offset, page, _seg, wk2);
-				dev->_page[page]._segs[_seg] = wk2;
-				_seg++;
+			for (int n=0; n<8 && seg + n < dev->_width; n++) {
+				uint8_t bits = cols[n] & mask;
+				ssd1306_blit_byte(dev, page, seg + n, bits << shift, mask << shift);
+				if (shift) {
+					ssd1306_blit_byte(dev, page + 1, seg + n, bits >> (8 - shift), mask >> (8 - shift));
+				}
 			}
 		}
-		vTaskDelay(1);
-		offset = offset + _width;
-		dstBits++;
-		_seg = xpos;
-		if (dstBits == 8) {
-			page++;
-			dstBits=0;
-		}
 	}
 
-#if 0
-	for (int _seg=ypos;_seg<ypos+width;_seg++) {
-		ssd1306_dump_page(dev, page-1, _seg);
-	}
-	for (int _seg=ypos;_seg<ypos+width;_seg++) {
-		ssd1306_dump_page(dev, page, _seg);
+	if (dev->_framebuffer) {
+		int last = (ypos + height - 1) / 8;
+		if (last >= dev->_pages) last = dev->_pages - 1;
+		for (int _page=ypos/8;_page<=last;_page++) {
+			ssd1306_mark_dirty(dev, _page, xpos, width);
+		}
+		return;
 	}
-#endif
 	ssd1306_show_buffer(dev);
 }
 
@@ -569,12 +719,7 @@ uint8_t ssd1306_copy_bit(uint8_t src, int srcBits, uint8_t dst, int dstBits)
 // Rotate 8-bit data
 // 0x12-->0x48
 uint8_t ssd1306_rotate_byte(uint8_t ch1) {
-	uint8_t ch2 = 0;
-	for (int j=0;j<8;j++) {
-		ch2 = (ch2 << 1) + (ch1 & 0x01);
-		ch1 = ch1 >> 1;
-	}
-	return ch2;
+	return ssd1306_reverse_lut[ch1];
 }
 
 
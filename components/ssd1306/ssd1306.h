@@ -83,6 +83,8 @@ typedef struct {
 	bool _valid; // Not using it anymore
 	int _segLen; // Not using it anymore
 	uint8_t _segs[128];
+	int _dirtyStart; // First changed column, framebuffer mode only
+	int _dirtyEnd; // Last changed column, clean when below _dirtyStart
 } PAGE_t;
 
 typedef struct {
@@ -98,6 +100,10 @@ typedef struct {
 	int _scDirection;
 	PAGE_t _page[8];
 	bool _flip;
+	bool _framebuffer; // Draw calls only update _page, ssd1306_flush() sends them
+	uint32_t _txCount; // Image transfers on the bus
+	uint32_t _txBytes; // Bytes of those transfers, addressing included
+	uint32_t _flushCount; // Flushes that sent at least one span
 } SSD1306_t;
 
 #ifdef __cplusplus
@@ -113,6 +119,9 @@ void ssd1306_show_buffer(SSD1306_t * dev);
 void ssd1306_set_buffer(SSD1306_t * dev, uint8_t * buffer);
 void ssd1306_get_buffer(SSD1306_t * dev, uint8_t * buffer);
 void ssd1306_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
+void ssd1306_framebuffer(SSD1306_t * dev, bool enable);
+void ssd1306_flush(SSD1306_t * dev);
+void ssd1306_reset_stats(SSD1306_t * dev);
 void ssd1306_display_text(SSD1306_t * dev, int page, char * text, int text_len, bool invert);
 void ssd1306_display_text_x3(SSD1306_t * dev, int page, char * text, int text_len, bool invert);
 void ssd1306_clear_screen(SSD1306_t * dev, bool invert);
@@ -137,6 +146,7 @@ void ssd1306_dump_page(SSD1306_t * dev, int page, int seg);
 void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset);
 void i2c_init(SSD1306_t * dev, int width, int height);
 void i2c_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
+void i2c_display_frame(SSD1306_t * dev);
 void i2c_contrast(SSD1306_t * dev, int contrast);
 void i2c_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll);
 
@@ -146,6 +156,7 @@ bool spi_master_write_command(SSD1306_t * dev, uint8_t Command );
 bool spi_master_write_data(SSD1306_t * dev, const uint8_t* Data, size_t DataLength );
 void spi_init(SSD1306_t * dev, int width, int height);
 void spi_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
+void spi_display_frame(SSD1306_t * dev);
 void spi_contrast(SSD1306_t * dev, int contrast);
 void spi_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll);
 
@@ -14,6 +14,12 @@
 //#define I2C_NUM I2C_NUM_1
 
 #define I2C_MASTER_FREQ_HZ 400000 /*!< I2C clock of SSD1306 can run at 400 kHz max. */
+#define I2C_FRAME_TIMEOUT_MS 100 /*!< A full frame takes ~25 ms at 400 kHz. */
+
+// Start, address, 4 range commands, data control byte, one write per page, stop
+#define I2C_FRAME_LINK_SIZE I2C_LINK_RECOMMENDED_SIZE(8 + 8)
+
+static uint8_t frame_link[I2C_FRAME_LINK_SIZE];
 
 void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset)
 {
@@ -77,8 +83,11 @@ void i2c_init(SSD1306_t * dev, int width, int height) {
 	i2c_master_write_byte(cmd, OLED_CMD_SET_VCOMH_DESELCT, true);		// DB
 	i2c_master_write_byte(cmd, 0x40, true);
 	i2c_master_write_byte(cmd, OLED_CMD_SET_MEMORY_ADDR_MODE, true);	// 20
-	//i2c_master_write_byte(cmd, OLED_CMD_SET_HORI_ADDR_MODE, true);	// 00
+#if CONFIG_HORIZONTAL_ADDRESSING
+	i2c_master_write_byte(cmd, OLED_CMD_SET_HORI_ADDR_MODE, true);		// 00
+#else
 	i2c_master_write_byte(cmd, OLED_CMD_SET_PAGE_ADDR_MODE, true);		// 02
+#endif
 	// Set Lower Column Start Address for Page Addressing Mode
 	i2c_master_write_byte(cmd, 0x00, true);
 	// Set Higher Column Start Address for Page Addressing Mode
@@ -116,32 +125,77 @@ void i2c_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int
 		_page = (dev->_pages - page) - 1;
 	}
 
+	// Addressing and data in one transaction: each command goes behind its own
+	// single-command control byte, then a data stream control byte takes the rest
 	cmd = i2c_cmd_link_create();
 	i2c_master_start(cmd);
 	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
 
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
-	// Set Lower Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, (0x00 + columLow), true);
-	// Set Higher Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, (0x10 + columHigh), true);
-	// Set Page Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, 0xB0 | _page, true);
+#if CONFIG_HORIZONTAL_ADDRESSING
+	// Column and page window, the start address commands only work in page mode
+	uint8_t commands[] = {
+		OLED_CMD_SET_COLUMN_RANGE, _seg, _seg + width - 1,
+		OLED_CMD_SET_PAGE_RANGE, _page, _page,
+	};
+	(void)columLow;
+	(void)columHigh;
+#else
+	uint8_t commands[] = {
+		// Set Lower Column Start Address for Page Addressing Mode
+		0x00 + columLow,
+		// Set Higher Column Start Address for Page Addressing Mode
+		0x10 + columHigh,
+		// Set Page Start Address for Page Addressing Mode
+		0xB0 | _page,
+	};
+#endif
+	for (int i=0;i<sizeof(commands);i++) {
+		i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_SINGLE, true);
+		i2c_master_write_byte(cmd, commands[i], true);
+	}
+
+	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);
+	i2c_master_write(cmd, images, width, true);
 
 	i2c_master_stop(cmd);
 	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
 	i2c_cmd_link_delete(cmd);
 
-	cmd = i2c_cmd_link_create();
+	dev->_txCount++;
+	dev->_txBytes += 2 + 2 * sizeof(commands) + width; // Address, commands with control bytes, data control byte
+}
+
+// Whole frame in one transaction, needs horizontal addressing mode
+void i2c_display_frame(SSD1306_t * dev) {
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(frame_link, sizeof(frame_link));
+	int first = CONFIG_OFFSETX;
+	uint8_t commands[] = {
+		OLED_CMD_SET_COLUMN_RANGE, first, first + dev->_width - 1,
+		OLED_CMD_SET_PAGE_RANGE, 0, dev->_pages - 1,
+	};
+
 	i2c_master_start(cmd);
 	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-
+	for (int i=0;i<sizeof(commands);i++) {
+		i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_SINGLE, true);
+		i2c_master_write_byte(cmd, commands[i], true);
+	}
 	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);
-	i2c_master_write(cmd, images, width, true);
-
+	// Pages are sent straight from the buffer, bottom up when flipped
+	for (int i=0;i<dev->_pages;i++) {
+		int page = dev->_flip ? (dev->_pages - i) - 1 : i;
+		i2c_master_write(cmd, dev->_page[page]._segs, dev->_width, true);
+	}
 	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
+
+	esp_err_t espRc = i2c_master_cmd_begin(I2C_NUM, cmd, pdMS_TO_TICKS(I2C_FRAME_TIMEOUT_MS));
+	if (espRc != ESP_OK) {
+		ESP_LOGE(tag, "Frame transfer failed. code: 0x%.2X", espRc);
+	}
+	i2c_cmd_link_delete_static(cmd);
+
+	dev->_txCount++;
+	dev->_txBytes += 2 + 2 * sizeof(commands) + dev->_pages * dev->_width;
 }
 
 void i2c_contrast(SSD1306_t * dev, int contrast) {
@@ -6,6 +6,7 @@
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 
 #include "ssd1306.h"
 
@@ -23,6 +24,9 @@ static const int SPI_Command_Mode = 0;
 static const int SPI_Data_Mode = 1;
 static const int SPI_Frequency = 1000000; // 1MHz
 
+// Whole frame staged in DMA capable memory, the pages are not contiguous in SSD1306_t
+DMA_ATTR static uint8_t frame_buffer[8 * 128];
+
 void spi_master_init(SSD1306_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET)
 {
 	esp_err_t ret;
@@ -139,8 +143,11 @@ void spi_init(SSD1306_t * dev, int width, int height)
 	spi_master_write_command(dev, OLED_CMD_SET_VCOMH_DESELCT);		// DB
 	spi_master_write_command(dev, 0x40);
 	spi_master_write_command(dev, OLED_CMD_SET_MEMORY_ADDR_MODE);	// 20
-	//spi_master_write_command(dev, OLED_CMD_SET_HORI_ADDR_MODE);	// 00
+#if CONFIG_HORIZONTAL_ADDRESSING
+	spi_master_write_command(dev, OLED_CMD_SET_HORI_ADDR_MODE);		// 00
+#else
 	spi_master_write_command(dev, OLED_CMD_SET_PAGE_ADDR_MODE);		// 02
+#endif
 	// Set Lower Column Start Address for Page Addressing Mode
 	spi_master_write_command(dev, 0x00);
 	// Set Higher Column Start Address for Page Addressing Mode
@@ -167,6 +174,25 @@ void spi_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int
 		_page = (dev->_pages - page) - 1;
 	}
 
+#if CONFIG_HORIZONTAL_ADDRESSING
+	// Column and page window in a single command transaction
+	static uint8_t commands[6];
+	commands[0] = OLED_CMD_SET_COLUMN_RANGE;
+	commands[1] = _seg;
+	commands[2] = _seg + width - 1;
+	commands[3] = OLED_CMD_SET_PAGE_RANGE;
+	commands[4] = _page;
+	commands[5] = _page;
+	gpio_set_level( dev->_dc, SPI_Command_Mode );
+	spi_master_write_byte( dev->_SPIHandle, commands, sizeof(commands) );
+	(void)columLow;
+	(void)columHigh;
+
+	spi_master_write_data(dev, images, width);
+
+	dev->_txCount += 2;
+	dev->_txBytes += sizeof(commands) + width;
+#else
 	// Set Lower Column Start Address for Page Addressing Mode
 	spi_master_write_command(dev, (0x00 + columLow));
 	// Set Higher Column Start Address for Page Addressing Mode
@@ -176,6 +202,34 @@ void spi_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int
 
 	spi_master_write_data(dev, images, width);
 
+	dev->_txCount += 4;
+	dev->_txBytes += 3 + width;
+#endif
+}
+
+// Whole frame in one DMA transaction, needs horizontal addressing mode
+void spi_display_frame(SSD1306_t * dev)
+{
+	static uint8_t commands[6];
+	int first = CONFIG_OFFSETX;
+	commands[0] = OLED_CMD_SET_COLUMN_RANGE;
+	commands[1] = first;
+	commands[2] = first + dev->_width - 1;
+	commands[3] = OLED_CMD_SET_PAGE_RANGE;
+	commands[4] = 0;
+	commands[5] = dev->_pages - 1;
+	gpio_set_level( dev->_dc, SPI_Command_Mode );
+	spi_master_write_byte( dev->_SPIHandle, commands, sizeof(commands) );
+
+	// Bottom up when flipped
+	for (int i=0;i<dev->_pages;i++) {
+		int page = dev->_flip ? (dev->_pages - i) - 1 : i;
+		memcpy(&frame_buffer[i * dev->_width], dev->_page[page]._segs, dev->_width);
+	}
+	spi_master_write_data(dev, frame_buffer, dev->_pages * dev->_width);
+
+	dev->_txCount += 2;
+	dev->_txBytes += sizeof(commands) + dev->_pages * dev->_width;
 }
 
 void spi_contrast(SSD1306_t * dev, int contrast) {
@@ -0,0 +1,69 @@
+#include <string.h>
+#include "upload_batch.h"
+
+// The body is built as "[obj,obj,obj" and closed by upload_batch_body().
+// With a single object the leading '[' is skipped so the request stays
+// identical to a one-frame POST.
+
+void upload_batch_init(upload_batch_t *batch, char *body, size_t max_bytes, int max_frames, int max_age_ms) {
+    batch->body = body;
+    batch->size = max_bytes;
+    batch->max_frames = max_frames;
+    batch->max_age_ms = max_age_ms;
+    upload_batch_reset(batch);
+}
+
+bool upload_batch_add(upload_batch_t *batch, const char *object, size_t len, int64_t now_us) {
+    // Separator plus closing "]" and NUL
+    if (batch->len + 1 + len + 2 > batch->size) {
+        return false;
+    }
+    batch->body[batch->len++] = batch->count == 0 ? '[' : ',';
+    memcpy(batch->body + batch->len, object, len);
+    batch->len += len;
+    batch->body[batch->len] = '\0';
+    if (batch->count == 0) {
+        batch->first_us = now_us;
+    }
+    batch->count++;
+    return true;
+}
+
+bool upload_batch_ready(upload_batch_t *batch, int64_t now_us) {
+    if (batch->count == 0) {
+        return false;
+    }
+    return batch->count >= batch->max_frames || upload_batch_wait_ms(batch, now_us) == 0;
+}
+
+int upload_batch_wait_ms(upload_batch_t *batch, int64_t now_us) {
+    if (batch->count == 0) {
+        return -1;
+    }
+    int64_t age_ms = (now_us - batch->first_us) / 1000;
+    if (age_ms >= batch->max_age_ms) {
+        return 0;
+    }
+    return batch->max_age_ms - (int)age_ms;
+}
+
+const char *upload_batch_body(upload_batch_t *batch) {
+    if (batch->count == 0) {
+        return "";
+    }
+    if (batch->count == 1) {
+        return batch->body + 1;
+    }
+    batch->body[batch->len] = ']';
+    batch->body[batch->len + 1] = '\0';
+    return batch->body;
+}
+
+void upload_batch_reset(upload_batch_t *batch) {
+    batch->len = 0;
+    batch->count = 0;
+    batch->first_us = 0;
+    if (batch->size) {
+        batch->body[0] = '\0';
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// JSON objects accumulated for one POST.
+// A single object is sent as is, several are sent as a JSON array.
+typedef struct {
+    char *body;
+    size_t size;
+    size_t len;
+    int count;
+    int64_t first_us; // When the oldest object was added
+    int max_frames;
+    int max_age_ms;
+} upload_batch_t;
+
+// Batch setup, body must hold at least max_bytes
+void upload_batch_init(upload_batch_t *batch, char *body, size_t max_bytes, int max_frames, int max_age_ms);
+
+// Append one JSON object, false if it does not fit (flush and retry)
+bool upload_batch_add(upload_batch_t *batch, const char *object, size_t len, int64_t now_us);
+
+// Count or age threshold reached
+bool upload_batch_ready(upload_batch_t *batch, int64_t now_us);
+
+// Milliseconds until the age threshold, -1 if the batch is empty
+int upload_batch_wait_ms(upload_batch_t *batch, int64_t now_us);
+
+// Close the batch and return the request body
+const char *upload_batch_body(upload_batch_t *batch);
+
+void upload_batch_reset(upload_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
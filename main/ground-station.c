@@ -1,4 +1,6 @@
 #include <string.h>
+#include <stdlib.h>
+#include <assert.h>
 #include <inttypes.h>
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
@@ -11,13 +13,31 @@
 #include "esp_ota_ops.h"
 #include "esp_http_client.h"
 #include "esp_https_ota.h"
+#include "esp_timer.h"
+#include "esp_sntp.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "cmd_wifi.h"
 #include "api_calls.h"
 #include "cmd_api.h"
+#include "cmd_lora.h"
+#include "cmd_display.h"
 #include "ssd1306.h"
+#include "display_service.h"
 #include "lora.h"
+#include "rx_scheduler.h"
+#include "packet_ring.h"
+#include "journal.h"
+#include "upload_batch.h"
+#include "json_writer.h"
+#include "latency.h"
+#include "rx_stats.h"
+#include "dedup.h"
+#include "mission_filter.h"
+#include "cmd_filter.h"
+#include "sat_tracker.h"
+#include "pass_predictor.h"
+#include "cmd_tracker.h"
 
 #define MI_VARIABLE CONFIG_MI_VARIABLE
 
@@ -31,7 +51,22 @@
 #define OTA_WAIT_PERIOD_MS 300000 // Fetch OTA Updates every 5 minutes
 #define MAX_OTA_SIZE 4194304 // 4MB
 
-#define LORA_MESSAGE_LENGTH 190
+#define LORA_RX_WAIT_MS 1000 // Check at least once per second that RX is still armed
+#define DISPLAY_MAX_FPS 10 // Screen refresh cap, draw commands in between are coalesced
+#define RX_RING_SIZE 16 // Frames buffered between RX and upload, power of two
+#define JOURNAL_RETRY_MS 30000 // Backoff before replaying the journal again after a failure
+#define RX_DIVERSITY_US 100000 // Same payload on two radios this close in time is one frame
+#define UPLOAD_OBJECT_SIZE (JSON_STRING_MAX(PACKET_PAYLOAD_MAX) + 64) // One frame object, worst case escaping
+#define TLE_URL CONFIG_TLE_URL
+#define TLE_REFRESH_MS (CONFIG_TLE_REFRESH_HOURS * 3600000LL)
+#define TLE_RETRY_MS 600000 // Backoff after a failed element set fetch
+#define TLE_REFRESH_GAP_S 120 // A fetch does not start this close to a pass
+
+#if CONFIG_LORA2_ENABLE
+#define LORA_RADIOS 2
+#else
+#define LORA_RADIOS 1
+#endif
 
 static const char* TAG = "GroundStation";
 
@@ -40,9 +75,26 @@ extern const char server_cert_pem_end[] asm("_binary_amazonaws_com_root_cert_pem
 
 SSD1306_t screen;
 
-uint8_t msg[LORA_MESSAGE_LENGTH];
-int packets = 0;
-int rssi = 0;
+static lora_dev_t radios[LORA_RADIOS];
+static packet_t rx_slots[LORA_RADIOS][RX_RING_SIZE];
+static packet_ring_t rx_rings[LORA_RADIOS]; // One per radio, merged by timestamp in the upload task
+static uint32_t rx_duplicates = 0;
+static TaskHandle_t upload_task_handle;
+static char upload_body[CONFIG_UPLOAD_BATCH_MAX_BYTES];
+static upload_batch_t upload_batch;
+static packet_t upload_frames[CONFIG_UPLOAD_BATCH_MAX_FRAMES]; // Frames in the batch, journaled if the POST fails
+static int64_t upload_encoded_us[CONFIG_UPLOAD_BATCH_MAX_FRAMES]; // When each frame joined the batch
+static int64_t rx_queued_us[LORA_RADIOS][RX_RING_SIZE]; // Commit time of each ring slot
+static uint8_t rx_actions[LORA_RADIOS][RX_RING_SIZE]; // mission_action_t of each ring slot
+static int64_t replay_after = 0;
+static char upload_object[UPLOAD_OBJECT_SIZE];
+static char replay_object[UPLOAD_OBJECT_SIZE];
+static volatile int32_t doppler_ppb = 0; // Doppler shift as a fraction of the carrier, for the other radios
+#if CONFIG_LORA2_ENABLE
+static lora_profile_t lora2_profile;
+static afc_t lora2_afc; // Radio 0 has one per profile in the RX scheduler
+#endif
+
 
 void log_env_variables() {
   ESP_LOGI(TAG, "BASE_FIRMWARE_UPGRADE_URL=%s", BASE_FIRMWARE_UPGRADE_URL);
@@ -54,79 +106,569 @@ void screen_init() {
   i2c_master_init(&screen, CONFIG_SDA_GPIO, CONFIG_SCL_GPIO, CONFIG_RESET_GPIO);
   ssd1306_init(&screen, 128, 64);
   ssd1306_contrast(&screen, 0xFF);
+  // From here on only the display task touches the device
+  display_service_start(&screen, DISPLAY_MAX_FPS);
 }
 
 void screen_clear() {
-  ssd1306_clear_screen(&screen, false);
+  display_clear();
 }
 
 void screen_print(char * str, int page) {
-  ssd1306_clear_line(&screen, page, false);
-  ssd1306_display_text(&screen, page, str, strlen(str), false);
+  display_text(page, str, false);
 }
 
 void screen_print_big(char * str, int page) {
-  ssd1306_clear_line(&screen, page, false);
-  ssd1306_display_text_x3(&screen, page, str, strlen(str), false);
+  display_text_x3(page, str, false);
+}
+
+void screen_progress(int percent, int page) {
+  display_progress(page, percent);
 }
 
 void screen_draw(uint8_t *img) {
-  ssd1306_bitmaps(&screen, 0, 0, img, 128, 64, false);
+  display_bitmap(0, 0, img, 128, 64, false);
+}
+
+// Radio 0 follows the RX scheduler, the others stay on their profile
+bool rx_wait(int index) {
+  if (index == 0) {
+    return rx_scheduler_wait(LORA_RX_WAIT_MS);
+  }
+#if CONFIG_LORA2_ENABLE
+  // Same Doppler shift as radio 0, scaled to this carrier, plus this radio's
+  // own AFC; kept while a frame is in the air
+  afc_idle(&lora2_afc, esp_timer_get_time());
+  long frequency = CONFIG_LORA2_FREQUENCY + (int64_t)CONFIG_LORA2_FREQUENCY * doppler_ppb / 1000000000 +
+                   lora2_afc.correction;
+  if (frequency != lora2_profile.frequency && !lora_rx_busy(&radios[index])) {
+    lora2_profile.frequency = frequency;
+    lora_apply_profile(&radios[index], &lora2_profile);
+  }
+#endif
+  lora_receive_continuous(&radios[index]);
+  return lora_wait_received(&radios[index], LORA_RX_WAIT_MS);
 }
 
+// Frequency error of a frame from our satellite, applied before the next wait
+void rx_afc(int index, const lora_packet_info_t *info) {
+#if CONFIG_AFC_ENABLE
+  if (index == 0) {
+    rx_scheduler_afc(info);
+  }
+#if CONFIG_LORA2_ENABLE
+  else if (afc_update(&lora2_afc, info->freq_error, info->snr, !info->crc_error, info->timestamp_us)) {
+    ESP_LOGI(TAG, "Radio %d AFC correction %+"PRId32" Hz", index, lora2_afc.correction);
+  }
+#endif
+#endif
+}
+
+// One task per radio, p is the radio index
 void task_rx(void *p) {
-  ESP_LOGI(TAG, "Start LoRa RX task...");
-  char packets_count[64];
-  char rssi_str[64];
+  int index = (int)(intptr_t)p;
+  lora_dev_t *radio = &radios[index];
+  packet_ring_t *ring = &rx_rings[index];
+  ESP_LOGI(TAG, "Start LoRa RX task for radio %d...", index);
+  packet_t *pkt;
+  lora_packet_info_t info;
   int len = 0;
   while(true) {
-    lora_receive();
-    while(lora_received()) {
-      ESP_LOGI(TAG, "New LoRa message received!");
-      len = lora_receive_packet(msg, LORA_MESSAGE_LENGTH);
-      msg[len] = 0;
-      ESP_LOG_BUFFER_HEX(TAG, msg, len);
-      ESP_LOGI(TAG, "LoRa msg: %s, len: %i", (char*)msg, len);
-
-      rssi = lora_packet_rssi();
-      packets++;
-
-      char msg_code[6];
-      snprintf(msg_code, 6, "%.5s", (char*)msg);
-
-      if (strcmp(msg_code, "FO014") == 0) {
-        ESP_LOGI(TAG, "Starts with FO014, is the PlatziSat-1!");
-        sprintf(packets_count, "Recibiendo...");
-        sprintf(rssi_str, "RSSI: %d dBm", rssi);
-        screen_clear();
-        screen_print(packets_count, 0);
-        screen_print(rssi_str, 1);
-        char message[1024 * 8] = "";
-        sprintf(message, "{\"message\":\"%s\"}", (char*)msg);
-        ESP_LOGI(TAG, "JSON message: %s", message);
-        char res[240] = "";
-        http_post(SAVE_MESSAGE_URL, message, res);
-        screen_clear();
-        packets_count[64] = '\0';
-        sprintf(packets_count, "Mensajes: %d", packets);
-        screen_print(packets_count, 0);
-      } else {
+    if (!rx_wait(index)) continue;
+    while(lora_received(radio)) {
+      ESP_LOGI(TAG, "New LoRa message received on radio %d!", index);
+      pkt = packet_ring_reserve(ring);
+      if (pkt == NULL) {
+        // Uploader is behind, drain the radio anyway and drop the frame
+        lora_receive_packet(radio, NULL, 0);
+        rx_stats_count(index, RX_STATS_OVERFLOWS, 1);
+        ESP_LOGW(TAG, "RX ring full, frame dropped (%"PRIu32" overflows)", packet_ring_overflows(ring));
+        continue;
+      }
+      len = lora_receive_packet_info(radio, pkt->payload, sizeof(pkt->payload) - 1, &info); // Room for the NUL
+      if (len == 0) {
+        if (info.crc_error) {
+          ESP_LOGW(TAG, "CRC error, RSSI %d dBm, SNR %.2f dB", info.rssi, info.snr);
+          rx_stats_count(index, RX_STATS_CRC_ERRORS, 1);
+        }
+        continue;
+      }
+      if (info.len > len) {
+        ESP_LOGW(TAG, "Frame of %d bytes truncated to %d, dropped", info.len, len);
+        continue;
+      }
+      int64_t drained = esp_timer_get_time();
+      latency_record(LATENCY_DRAIN, drained - info.timestamp_us);
+      pkt->payload[len] = 0;
+      pkt->len = len;
+      pkt->rssi = info.rssi;
+      pkt->snr = info.snr;
+      pkt->freq_error = info.freq_error;
+      pkt->crc_on = info.crc_on;
+      pkt->coding_rate = info.coding_rate;
+      pkt->timestamp = info.timestamp_us;
+      pkt->radio = index;
+      ESP_LOG_BUFFER_HEX(TAG, pkt->payload, len);
+      ESP_LOGI(TAG, "LoRa msg: %s, len: %i, RSSI %d dBm, SNR %.2f dB, FEI %"PRId32" Hz",
+               (char*)pkt->payload, len, pkt->rssi, pkt->snr, pkt->freq_error);
+
+      rx_stats_frame(index, pkt->rssi, pkt->snr);
+
+      mission_route_t route;
+      mission_filter_match(pkt->payload, len, &route);
+      if (route.rule < 0) {
         ESP_LOGI(TAG, "Unknown origin message");
+        rx_stats_count(index, RX_STATS_UNKNOWN, 1);
+        continue;
+      }
+      ESP_LOGI(TAG, "Mission rule %d, %s", route.rule, mission_action_name(route.action));
+      if (route.action == MISSION_DROP) {
+        rx_stats_count(index, RX_STATS_FILTERED, 1);
+        continue;
+      }
+      rx_afc(index, &info);
+      if (route.action == MISSION_DISPLAY) {
+        screen_clear();
+        screen_print((char*)pkt->payload, 0);
+        continue;
+      }
+      pkt->endpoint = route.endpoint;
+      int64_t queued = esp_timer_get_time();
+      rx_queued_us[index][pkt - rx_slots[index]] = queued;
+      rx_actions[index][pkt - rx_slots[index]] = route.action;
+      latency_record(LATENCY_ENQUEUE, queued - drained);
+      packet_ring_commit(ring);
+      xTaskNotifyGive(upload_task_handle);
+    }
+  }
+}
+
+// Upload object for one frame, -1 if it does not fit in out
+int frame_to_json(const packet_t *pkt, char *out, size_t size) {
+  json_writer_t w;
+  json_writer_init(&w, out, size);
+  json_object_begin(&w);
+  json_key(&w, "message");
+#if CONFIG_UPLOAD_PAYLOAD_HEX
+  json_hex(&w, pkt->payload, pkt->len);
+  json_key(&w, "encoding");
+  json_string(&w, (const uint8_t *)"hex", 3);
+#elif CONFIG_UPLOAD_PAYLOAD_BASE64
+  json_base64(&w, pkt->payload, pkt->len);
+  json_key(&w, "encoding");
+  json_string(&w, (const uint8_t *)"base64", 6);
+#else
+  json_string(&w, pkt->payload, pkt->len);
+#endif
+  json_key(&w, "rssi");
+  json_int(&w, pkt->rssi);
+  json_key(&w, "snr");
+  json_float(&w, pkt->snr, 2);
+  json_key(&w, "freq_error");
+  json_int(&w, pkt->freq_error);
+  json_key(&w, "crc");
+  json_int(&w, pkt->crc_on);
+  json_key(&w, "coding_rate");
+  json_int(&w, pkt->coding_rate);
+  json_key(&w, "rx_time_us");
+  json_int(&w, pkt->timestamp);
+  json_key(&w, "radio");
+  json_int(&w, pkt->radio);
+  json_object_end(&w);
+  return json_writer_finish(&w);
+}
+
+void upload_journal(int count) {
+  esp_err_t err;
+  ESP_LOGW(TAG, "Upload failed, journal %d frames, %"PRIu32" pending", count, journal_pending() + count);
+  for (int i = 0; i < count; i++) {
+    err = journal_append(PACKET_FORMAT_VERSION, &upload_frames[i], PACKET_RECORD_SIZE(&upload_frames[i]));
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Frame lost, journal append failed: %s", esp_err_to_name(err));
+    }
+  }
+}
+
+// Stages of a delivered batch, from the request times and each frame's own
+void upload_latency(const http_timing_t *timing) {
+  int64_t sent = timing->connected_us ? timing->connected_us : timing->start_us;
+  int64_t ack = timing->response_us ? timing->response_us : timing->done_us;
+  if (timing->connected_us) {
+    latency_record(LATENCY_CONNECT, timing->connected_us - timing->start_us);
+  }
+  latency_record(LATENCY_RESPONSE, ack - sent);
+  for (int i = 0; i < upload_batch.count; i++) {
+    latency_record(LATENCY_BATCH, timing->start_us - upload_encoded_us[i]);
+    latency_record(LATENCY_TOTAL, ack - upload_frames[i].timestamp);
+  }
+}
+
+void upload_flush() {
+  char packets_count[64];
+  char res[DEFAULT_HTTP_BUF_SIZE] = "";
+  http_timing_t timing;
+  bool failed = true;
+  ESP_LOGI(TAG, "Upload batch of %d frames, %d bytes", upload_batch.count, (int)upload_batch.len);
+  const char *body = upload_batch_body(&upload_batch);
+  ESP_LOGI(TAG, "JSON message: %s", body);
+  if (wifi_is_connected()) {
+    failed = http_post_timed(SAVE_MESSAGE_URL, body, res, &timing);
+  }
+  for (int i = 0; i < upload_batch.count; i++) {
+    rx_stats_count(upload_frames[i].radio, failed ? RX_STATS_UPLOAD_FAILED : RX_STATS_UPLOADED, 1);
+    if (!failed) {
+      dedup_delivered(&upload_frames[i]);
+    }
+  }
+  if (!failed) {
+    upload_latency(&timing);
+  } else {
+    upload_journal(upload_batch.count);
+    replay_after = esp_timer_get_time() + JOURNAL_RETRY_MS * 1000LL;
+  }
+  upload_batch_reset(&upload_batch);
+  screen_clear();
+  sprintf(packets_count, "Mensajes: %"PRIu32, rx_stats_session(RX_STATS_FRAMES));
+  screen_print(packets_count, 0);
+}
+
+// URL of a mission endpoint, the message API when it is not set
+void mission_url(int endpoint, char *url, size_t size) {
+  if (!mission_filter_get_endpoint(endpoint, url, size)) {
+    strlcpy(url, SAVE_MESSAGE_URL, size);
+  }
+}
+
+// Frame for an endpoint other than the message API, posted on its own and
+// journaled if that fails
+void upload_single(const packet_t *pkt) {
+  char url[MISSION_URL_MAX];
+  char res[DEFAULT_HTTP_BUF_SIZE] = "";
+  http_timing_t timing;
+  bool failed = true;
+  mission_url(pkt->endpoint, url, sizeof(url));
+  ESP_LOGI(TAG, "Upload frame to endpoint %d: %s", pkt->endpoint, url);
+  if (frame_to_json(pkt, upload_object, sizeof(upload_object)) >= 0 && wifi_is_connected()) {
+    failed = http_post_timed(url, upload_object, res, &timing);
+  }
+  rx_stats_count(pkt->radio, failed ? RX_STATS_UPLOAD_FAILED : RX_STATS_UPLOADED, 1);
+  if (!failed) {
+    latency_record(LATENCY_TOTAL, (timing.response_us ? timing.response_us : timing.done_us) - pkt->timestamp);
+    dedup_delivered(pkt);
+  } else if (journal_append(PACKET_FORMAT_VERSION, pkt, PACKET_RECORD_SIZE(pkt)) != ESP_OK) {
+    ESP_LOGE(TAG, "Frame lost, journal append failed");
+  } else {
+    replay_after = esp_timer_get_time() + JOURNAL_RETRY_MS * 1000LL;
+  }
+}
+
+// Bulk work waits for the gaps between passes, leaving the CPU, SPI bus and
+// network to the RX path while the satellite is up
+bool pass_under_way() {
+  return !pass_window_free(sat_tracker_now(), 0);
+}
+
+// Send the oldest journaled frame on its own, true if one was delivered or discarded
+bool upload_replay() {
+  packet_t pkt;
+  char url[MISSION_URL_MAX];
+  char res[DEFAULT_HTTP_BUF_SIZE] = "";
+  size_t len = sizeof(pkt);
+  uint8_t tag;
+  if (journal_pending() == 0 || !wifi_is_connected() || esp_timer_get_time() < replay_after || pass_under_way()) {
+    return false;
+  }
+  esp_err_t err = journal_peek(&tag, &pkt, &len);
+  if (err == ESP_ERR_NOT_FOUND) {
+    return false;
+  }
+  if (err == ESP_OK && tag == 3 && len >= offsetof(packet_t, endpoint)) {
+    // Journaled before the mission endpoints, all frames went to the message API
+    memmove(pkt.payload, (uint8_t *)&pkt + offsetof(packet_t, endpoint), len - offsetof(packet_t, endpoint));
+    pkt.endpoint = 0;
+    len++;
+    tag = PACKET_FORMAT_VERSION;
+  }
+  if (err != ESP_OK || tag != PACKET_FORMAT_VERSION || len < offsetof(packet_t, payload) ||
+      pkt.len > PACKET_PAYLOAD_MAX || len != PACKET_RECORD_SIZE(&pkt)) {
+    ESP_LOGW(TAG, "Discard unreadable journal record (%s, format %d)", esp_err_to_name(err), tag);
+    journal_consume();
+    return true;
+  }
+  if (frame_to_json(&pkt, replay_object, sizeof(replay_object)) < 0) {
+    ESP_LOGW(TAG, "Discard journaled frame, JSON does not fit");
+    journal_consume();
+    return true;
+  }
+  if (dedup_replayed(&pkt)) {
+    // Journaled copy of a frame that reached the server meanwhile, live or from an earlier record
+    ESP_LOGI(TAG, "Discard journaled frame, a copy was already delivered");
+    journal_consume();
+    return true;
+  }
+  mission_url(pkt.endpoint, url, sizeof(url));
+  ESP_LOGI(TAG, "Replay journaled frame to endpoint %d, %"PRIu32" pending", pkt.endpoint, journal_pending());
+  if (http_post(url, replay_object, res)) {
+    replay_after = esp_timer_get_time() + JOURNAL_RETRY_MS * 1000LL;
+    return false;
+  }
+  journal_consume();
+  rx_stats_count(pkt.radio, RX_STATS_UPLOADED, 1);
+  dedup_delivered(&pkt);
+  return true;
+}
+
+// Oldest frame over all radios, *index is set to its ring. A frame heard by
+// two radios is taken once, keeping the copy with the best SNR; while the
+// other radios have nothing queued, a fresh frame is held up to RX_DIVERSITY_US
+// for its copy to arrive and *hold_ms says how long to wait.
+packet_t *rx_next(int *index, int *hold_ms) {
+  packet_t *pkt = packet_ring_peek_oldest(rx_rings, LORA_RADIOS, index);
+  *hold_ms = 0;
+  if (pkt == NULL || LORA_RADIOS == 1) return pkt;
+
+  bool others_empty = true;
+  for (int i = 0; i < LORA_RADIOS; i++) {
+    if (i == *index) continue;
+    packet_t *other = packet_ring_peek(&rx_rings[i]);
+    if (other == NULL) continue;
+    others_empty = false;
+    if (other->len != pkt->len || llabs(other->timestamp - pkt->timestamp) > RX_DIVERSITY_US ||
+        memcmp(other->payload, pkt->payload, pkt->len) != 0) continue;
+    rx_duplicates++;
+    if (other->snr > pkt->snr) {
+      packet_ring_release(&rx_rings[*index]);
+      *index = i;
+      pkt = other;
+    } else {
+      packet_ring_release(&rx_rings[i]);
+    }
+  }
+
+  int64_t age = esp_timer_get_time() - pkt->timestamp;
+  if (others_empty && age < RX_DIVERSITY_US) {
+    *hold_ms = (RX_DIVERSITY_US - age) / 1000 + 1;
+    return NULL;
+  }
+  return pkt;
+}
+
+void task_upload(void *p) {
+  ESP_LOGI(TAG, "Start upload task...");
+  char packets_count[64];
+  char rssi_str[64];
+  packet_t *pkt;
+  int radio;
+  int hold_ms;
+  int wait_ms;
+  int len;
+  bool added;
+  upload_batch_init(&upload_batch, upload_body, sizeof(upload_body),
+                    CONFIG_UPLOAD_BATCH_MAX_FRAMES, CONFIG_UPLOAD_BATCH_MAX_AGE_MS);
+  while(true) {
+    pkt = rx_next(&radio, &hold_ms);
+    if (pkt == NULL) {
+      wait_ms = upload_batch_wait_ms(&upload_batch, esp_timer_get_time());
+      if (hold_ms > 0 && (wait_ms < 0 || hold_ms < wait_ms)) {
+        wait_ms = hold_ms;
+      }
+      if (wait_ms == 0) {
+        upload_flush();
+        upload_replay();
+        continue;
+      }
+      // Idle: drain the backlog one frame per pass so new frames are picked up in between
+      if (upload_replay()) continue;
+      if (!pass_under_way()) {
+        journal_maintain();
+      }
+      if (journal_pending() > 0 && (wait_ms < 0 || wait_ms > JOURNAL_RETRY_MS)) {
+        wait_ms = JOURNAL_RETRY_MS;
+      }
+      ulTaskNotifyTake(pdTRUE, wait_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms));
+      continue;
+    }
+    dedup_entry_t copy;
+    if (dedup_frame(pkt, &copy)) {
+      // Repeated beacon or a late copy from the other radio, already on its way
+      ESP_LOGI(TAG, "Duplicate frame, %u copies in %"PRId64" s, best RSSI %d dBm on radio %u",
+               copy.copies, (copy.last_us - copy.first_us) / 1000000, copy.rssi, copy.radio);
+      packet_ring_release(&rx_rings[radio]);
+      continue;
+    }
+    ESP_LOGI(TAG, "Upload frame from radio %d, %"PRIu32" queued, high-water %"PRIu32", %"PRIu32" duplicates",
+             radio, packet_ring_count(&rx_rings[radio]), packet_ring_high_water(&rx_rings[radio]), rx_duplicates);
+    sprintf(packets_count, "Recibiendo...");
+    sprintf(rssi_str, "RSSI: %d dBm", pkt->rssi);
+    screen_clear();
+    screen_print(packets_count, 0);
+    screen_print(rssi_str, 1);
+    if (rx_actions[radio][pkt - rx_slots[radio]] == MISSION_STORE) {
+      // Store and forward, the replay sends it between passes
+      if (journal_append(PACKET_FORMAT_VERSION, pkt, PACKET_RECORD_SIZE(pkt)) != ESP_OK) {
+        ESP_LOGE(TAG, "Frame lost, journal append failed");
       }
+      packet_ring_release(&rx_rings[radio]);
+      continue;
+    }
+    if (pkt->endpoint != 0) {
+      upload_single(pkt);
+      packet_ring_release(&rx_rings[radio]);
+      continue;
+    }
+    len = frame_to_json(pkt, upload_object, sizeof(upload_object));
+    int64_t encoded = esp_timer_get_time();
+    latency_record(LATENCY_ENCODE, encoded - rx_queued_us[radio][pkt - rx_slots[radio]]);
+
+    added = len >= 0 && upload_batch_add(&upload_batch, upload_object, len, esp_timer_get_time());
+    if (!added && len >= 0) {
+      upload_flush();
+      upload_replay();
+      added = upload_batch_add(&upload_batch, upload_object, len, esp_timer_get_time());
+    }
+    if (added) {
+      memcpy(&upload_frames[upload_batch.count - 1], pkt, PACKET_RECORD_SIZE(pkt));
+      upload_encoded_us[upload_batch.count - 1] = encoded;
+    } else if (journal_append(PACKET_FORMAT_VERSION, pkt, PACKET_RECORD_SIZE(pkt)) == ESP_OK) {
+      // Larger than a whole batch, it goes out on its own through the replay path
+      ESP_LOGW(TAG, "Frame does not fit in a batch, journaled");
+    }
+    packet_ring_release(&rx_rings[radio]);
+    if (upload_batch_ready(&upload_batch, esp_timer_get_time())) {
+      upload_flush();
+      upload_replay();
     }
-    vTaskDelay(1);
   }
 }
 
+// PlatziSat-1 beacon. LDRO stays off as before, it has to match the satellite.
+// Radio 0 starts with it when no RX profiles are stored in NVS.
+static const rx_profile_t lora_profile = {
+  .name = "PlatziSat-1",
+  .profile = {
+    .frequency = 401.7e6,
+    .spreading_factor = 11,
+    .bandwidth = 125e3,
+    .coding_rate = 8,
+    .sync_word = 0x12,
+    .preamble_length = 8,
+    .crc = 1,
+    .implicit_len = 0,
+    .ldro = LORA_LDRO_OFF,
+  },
+};
+
+#if CONFIG_LORA2_ENABLE
+static const lora_config_t lora2_config = {
+  .host = VSPI_HOST,
+  .miso = CONFIG_MISO_GPIO,
+  .mosi = CONFIG_MOSI_GPIO,
+  .sck = CONFIG_SCK_GPIO,
+  .cs = CONFIG_LORA2_CS_GPIO,
+  .rst = CONFIG_LORA2_RST_GPIO,
+  .dio0 = CONFIG_LORA2_DIO0_GPIO,
+};
+#endif
+
+#if CONFIG_AFC_ENABLE
+static const afc_config_t afc_config = {
+  .max_step_hz = CONFIG_AFC_MAX_STEP_HZ,
+  .max_offset_hz = CONFIG_AFC_MAX_OFFSET_HZ,
+  .deadband_hz = CONFIG_AFC_DEADBAND_HZ,
+  .min_snr = CONFIG_AFC_MIN_SNR,
+  .hold_ms = CONFIG_AFC_HOLD_S * 1000,
+#if CONFIG_AFC_FEI_INVERT
+  .invert = true,
+#endif
+};
+#define AFC_CONFIG (&afc_config)
+#else
+#define AFC_CONFIG NULL
+#endif
+
 void lora_config_init() {
   printf("lora config init!\n");
-  lora_init();
-  lora_set_frequency(401.7e6);
-  lora_set_spreading_factor(11);
-  lora_set_coding_rate(8);
-  lora_set_bandwidth(125e3);
-  lora_set_sync_word(0x12);
-  lora_enable_crc();
+  const lora_config_t config = LORA_CONFIG_DEFAULT();
+  int ok = lora_init(&radios[0], &config);
+  assert(ok);
+  ESP_ERROR_CHECK(rx_scheduler_init(&radios[0], &lora_profile, AFC_CONFIG));
+#if CONFIG_LORA2_ENABLE
+  lora2_profile = lora_profile.profile;
+  lora2_profile.frequency = CONFIG_LORA2_FREQUENCY;
+  lora2_profile.spreading_factor = CONFIG_LORA2_SPREADING_FACTOR;
+  ok = lora_init(&radios[1], &lora2_config);
+  assert(ok);
+  lora_apply_profile(&radios[1], &lora2_profile);
+#if CONFIG_AFC_ENABLE
+  afc_config_t afc2_config = afc_config;
+  afc2_config.max_fei_hz = lora2_profile.bandwidth / 4;
+  afc_init(&lora2_afc, &afc2_config);
+#endif
+#endif
+}
+
+void initialize_sntp() {
+  ESP_LOGI(TAG, "SNTP server %s", CONFIG_SNTP_SERVER);
+  sntp_setoperatingmode(SNTP_OPMODE_POLL);
+  sntp_setservername(0, CONFIG_SNTP_SERVER);
+  sntp_init();
+}
+
+bool tracker_init() {
+  const pass_predictor_config_t pass_config = {
+    .min_elevation = CONFIG_PASS_MIN_ELEVATION,
+    .horizon_s = CONFIG_PASS_HORIZON_HOURS * 3600,
+    .guard_s = CONFIG_PASS_GUARD_S,
+  };
+  ESP_ERROR_CHECK(pass_predictor_init(&pass_config));
+  if (CONFIG_STATION_LATITUDE[0] == '\0' || CONFIG_STATION_LONGITUDE[0] == '\0') {
+    ESP_LOGW(TAG, "Station coordinates not configured, Doppler correction is off");
+    return false;
+  }
+  const sat_tracker_config_t config = {
+    .latitude = strtod(CONFIG_STATION_LATITUDE, NULL),
+    .longitude = strtod(CONFIG_STATION_LONGITUDE, NULL),
+    .altitude = CONFIG_STATION_ALTITUDE,
+    .downlink_hz = lora_profile.profile.frequency,
+  };
+  ESP_ERROR_CHECK(sat_tracker_init(&config));
+  return true;
+}
+
+// Follows the first satellite during passes and retunes the radios to the
+// Doppler shifted carrier. Between passes it refreshes the element sets and
+// predicts the next passes of all of them.
+void task_doppler(void *p) {
+  sat_tracker_state_t state = {0};
+  int64_t refresh_at = 0;
+  long applied = 0;
+  bool in_pass = false;
+  while (true) {
+    int64_t now = esp_timer_get_time();
+    if (TLE_URL[0] != '\0' && !in_pass && now >= refresh_at && wifi_is_connected() &&
+        pass_window_free(sat_tracker_now(), TLE_REFRESH_GAP_S)) {
+      bool ok = sat_tracker_refresh(TLE_URL) == ESP_OK;
+      refresh_at = now + (ok ? TLE_REFRESH_MS : TLE_RETRY_MS) * 1000LL;
+    }
+    if (!in_pass) {
+      pass_predictor_update(sat_tracker_now(), false);
+    }
+
+    bool visible = sat_tracker_time_valid() && sat_tracker_update(0, sat_tracker_now(), &state) &&
+                   state.look.elevation >= CONFIG_DOPPLER_MIN_ELEVATION;
+    if (visible != in_pass) {
+      ESP_LOGI(TAG, "%s, az %.0f, Doppler %+ld Hz", visible ? "Pass start" : "Pass end",
+               state.look.azimuth, visible ? state.doppler_hz : 0L);
+      in_pass = visible;
+    }
+    long offset = visible ? state.doppler_hz : 0;
+    if (offset != applied && (labs(offset - applied) >= CONFIG_DOPPLER_STEP_HZ || offset == 0)) {
+      rx_scheduler_set_offset(lora_profile.name, offset);
+      doppler_ppb = (int64_t)offset * 1000000000 / lora_profile.profile.frequency;
+      applied = offset;
+    }
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_DOPPLER_INTERVAL_MS));
+  }
 }
 
 esp_err_t _http_get_event_handler(esp_http_client_event_t *evt) {
@@ -287,6 +829,8 @@ void ota_task(void *pvParameter) {
     esp_err_t err;
 
     while (true) {
+      // Download, flash writes and the reboot must not fall in a pass
+      pass_wait_gap(CONFIG_PASS_OTA_GAP_S);
       ESP_LOGI(TAG, "Search for OTA updates...");
       version = get_firmware_version(BASE_FIRMWARE_UPGRADE_URL);
       ESP_LOGI(TAG, "Last firmware version: %s", version);
@@ -333,6 +877,7 @@ void ota_task(void *pvParameter) {
           float percent = (bytes_len * 100) / MAX_OTA_SIZE;
           sprintf(bytes_str, "%*.0f%%", 4, percent);
           screen_print_big(bytes_str, 4);
+          screen_progress(percent, 7);
           ESP_LOGI(TAG, "Image bytes read: %d", bytes_len);
       }
 
@@ -344,6 +889,7 @@ void ota_task(void *pvParameter) {
         ota_finish_err = esp_https_ota_finish(https_ota_handle);
         if ((err == ESP_OK) && (ota_finish_err == ESP_OK)) {
           ESP_LOGI(TAG, "ESP_HTTPS_OTA upgrade successful. Rebooting ...");
+          rx_stats_flush();
           vTaskDelay(1000 / portTICK_PERIOD_MS);
           esp_restart();
         } else {
@@ -462,16 +1008,32 @@ void app_main(void) {
   repl_config.prompt = ">";
 
   initialize_nvs();
+  journal_init();
+  ESP_ERROR_CHECK(rx_stats_init(CONFIG_RX_STATS_NVS_INTERVAL_MIN * 60));
+  ESP_ERROR_CHECK(mission_filter_init(SAVE_MESSAGE_URL));
+  dedup_init(CONFIG_DEDUP_WINDOW_S);
   initialize_wifi();
+  initialize_sntp();
   initialize_api();
+  http_client_init();
 
   nvs_session_init();
   lora_config_init();
+  bool tracking = tracker_init();
 
   /* Register commands */
   esp_console_register_help_command();
   register_wifi();
   register_api();
+  register_lora(radios, LORA_RADIOS);
+#if CONFIG_LORA2_ENABLE && CONFIG_AFC_ENABLE
+  register_lora_afc(1, &lora2_afc);
+#endif
+  register_display(&screen);
+  register_filter();
+  if (tracking) {
+    register_tracker(TLE_URL);
+  }
 
   /* Setup console REPL over UART */
   esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
@@ -480,7 +1042,16 @@ void app_main(void) {
   /* Run REPL */
   ESP_ERROR_CHECK(esp_console_start_repl(repl));
 
-  xTaskCreate(&task_rx, "task_rx", 1024 * 16, NULL, configMAX_PRIORITIES-1, NULL);
+  for (int i = 0; i < LORA_RADIOS; i++) {
+    packet_ring_init(&rx_rings[i], rx_slots[i], RX_RING_SIZE);
+  }
+  xTaskCreate(&task_upload, "task_upload", 1024 * 16, NULL, 5, &upload_task_handle);
+  for (int i = 0; i < LORA_RADIOS; i++) {
+    xTaskCreate(&task_rx, "task_rx", 1024 * 4, (void *)(intptr_t)i, configMAX_PRIORITIES-1, NULL);
+  }
+  if (tracking) {
+    xTaskCreate(&task_doppler, "task_doppler", 1024 * 8, NULL, 5, NULL);
+  }
 
   ESP_LOGI(TAG, "Wait 5 seconds after start OTA updates task...");
   vTaskDelay(5000 / portTICK_PERIOD_MS);
@@ -0,0 +1,123 @@
+// ssd1306_bitmaps() against the per-bit loop it replaced, on a 128x64
+// framebuffer. Both run on random bitmaps, positions, flip and invert and
+// must leave the same pages behind. The old loop also slept one tick per
+// row and pushed the whole screen to the bus; neither is counted here.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "ssd1306.h"
+
+#define ROUNDS 2000
+
+// Framebuffer mode only, nothing reaches a bus
+void i2c_init(SSD1306_t * dev, int width, int height)
+{
+	dev->_width = width;
+	dev->_height = height;
+	dev->_pages = height == 32 ? 4 : 8;
+}
+void spi_init(SSD1306_t * dev, int width, int height) { assert(0); }
+void i2c_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width) { assert(0); }
+void i2c_display_frame(SSD1306_t * dev) { assert(0); }
+void i2c_contrast(SSD1306_t * dev, int contrast) { assert(0); }
+void i2c_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll) { assert(0); }
+void spi_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width) { assert(0); }
+void spi_display_frame(SSD1306_t * dev) { assert(0); }
+void spi_contrast(SSD1306_t * dev, int contrast) { assert(0); }
+void spi_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll) { assert(0); }
+
+// The previous ssd1306_bitmaps(), without its vTaskDelay(1) per row and the
+// ssd1306_show_buffer() at the end
+static void bitmaps_per_bit(SSD1306_t * dev, int xpos, int ypos, uint8_t * bitmap, int width, int height, bool invert)
+{
+	int _width = width / 8;
+	uint8_t page = (ypos / 8);
+	uint8_t _seg = xpos;
+	uint8_t dstBits = (ypos % 8);
+	int offset = 0;
+	for(int _height=0;_height<height;_height++) {
+		for (int index=0;index<_width;index++) {
+			for (int srcBits=7; srcBits>=0; srcBits--) {
+				uint8_t wk0 = dev->_page[page]._segs[_seg];
+				if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
+				uint8_t wk1 = bitmap[index+offset];
+				if (invert) wk1 = ~wk1;
+				uint8_t wk2 = ssd1306_copy_bit(wk1, srcBits, wk0, dstBits);
+				if (dev->_flip) wk2 = ssd1306_rotate_byte(wk2);
+				dev->_page[page]._segs[_seg] = wk2;
+				_seg++;
+			}
+		}
+		offset = offset + _width;
+		dstBits++;
+		_seg = xpos;
+		if (dstBits == 8) {
+			page++;
+			dstBits=0;
+		}
+	}
+}
+
+static void screen(SSD1306_t * dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	ssd1306_init(dev, 128, 64);
+	ssd1306_framebuffer(dev, true);
+}
+
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main()
+{
+	static SSD1306_t old, new;
+	uint8_t bitmap[128 * 64 / 8];
+	srand(1);
+	screen(&old);
+	screen(&new);
+
+	for (int trial=0; trial<500; trial++) {
+		for (int i=0;i<sizeof(bitmap);i++) bitmap[i] = rand();
+		for (int page=0;page<8;page++) {
+			for (int seg=0;seg<128;seg++) old._page[page]._segs[seg] = new._page[page]._segs[seg] = rand();
+		}
+		old._flip = new._flip = trial & 1;
+		bool invert = trial & 2;
+		int width = 8 * (1 + rand() % 16);
+		int height = 1 + rand() % 64;
+		int xpos = rand() % (128 - width + 1);
+		int ypos = rand() % (64 - height + 1);
+		if (trial < 4) {
+			width = 128; height = 64; xpos = 0; ypos = 0;
+		}
+		bitmaps_per_bit(&old, xpos, ypos, bitmap, width, height, invert);
+		ssd1306_bitmaps(&new, xpos, ypos, bitmap, width, height, invert);
+		for (int page=0;page<8;page++) {
+			assert(memcmp(old._page[page]._segs, new._page[page]._segs, 128) == 0);
+		}
+	}
+
+	old._flip = new._flip = false;
+	double start = now_ns();
+	for (int i=0;i<ROUNDS;i++) bitmaps_per_bit(&old, 0, 0, bitmap, 128, 64, false);
+	double per_bit_us = (now_ns() - start) / ROUNDS / 1000;
+	start = now_ns();
+	for (int i=0;i<ROUNDS;i++) ssd1306_bitmaps(&new, 0, 3, bitmap, 128, 61, false);
+	double unaligned_us = (now_ns() - start) / ROUNDS / 1000;
+	start = now_ns();
+	for (int i=0;i<ROUNDS;i++) ssd1306_bitmaps(&new, 0, 0, bitmap, 128, 64, false);
+	double blit_us = (now_ns() - start) / ROUNDS / 1000;
+
+	printf("128x64 blit, us:\n");
+	printf("  per bit:             %7.2f\n", per_bit_us);
+	printf("  transposing:         %7.2f\n", blit_us);
+	printf("  transposing, ypos 3: %7.2f\n", unaligned_us);
+	assert(blit_us < per_bit_us);
+	return 0;
+}
@@ -0,0 +1,294 @@
+// I2C traffic per screen update of the ground station, drawing straight
+// to the panel against the display service's framebuffer and flush. The
+// bus is a model of the SSD1306 that decodes the control bytes and
+// commands into its own GDDRAM, so every frame is also checked against
+// what the driver believes the panel shows.
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <assert.h>
+#include "driver/i2c.h"
+#include "display_service.c"
+
+#define I2C_HZ 400000
+#define BITS_PER_TRANSACTION 20 // Start, stop and the address byte
+#define LINK_MAX 2048
+
+// --- SSD1306 model -----------------------------------------------------------
+
+static struct {
+    uint8_t ram[8][128];
+    int mode; // 0 horizontal, 2 page addressing
+    int col, col_start, col_end;
+    int page, page_start, page_end;
+    uint32_t transactions;
+    uint32_t bytes; // Written after the address byte
+} panel = {.mode = 2, .col_end = 127, .page_end = 7};
+
+static int command_args(uint8_t c) {
+    switch (c) {
+    case 0x21: case 0x22: case 0xA3:
+        return 2;
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+        return 1;
+    case 0x26: case 0x27:
+        return 6;
+    case 0x29: case 0x2A:
+        return 5;
+    default:
+        return 0;
+    }
+}
+
+static void panel_command(const uint8_t *c) {
+    if (c[0] == 0x20) {
+        panel.mode = c[1];
+    } else if (c[0] == 0x21) {
+        panel.col = panel.col_start = c[1];
+        panel.col_end = c[2];
+    } else if (c[0] == 0x22) {
+        panel.page = panel.page_start = c[1];
+        panel.page_end = c[2];
+    } else if (c[0] <= 0x0F) {
+        panel.col = (panel.col & 0xF0) | c[0];
+    } else if (c[0] >= 0x10 && c[0] <= 0x1F) {
+        panel.col = (panel.col & 0x0F) | (c[0] & 0x0F) << 4;
+    } else if (c[0] >= 0xB0 && c[0] <= 0xB7) {
+        panel.page = c[0] & 0x07;
+    }
+}
+
+static void panel_data(uint8_t d) {
+    panel.ram[panel.page][panel.col] = d;
+    if (panel.mode == 2) {
+        panel.col = (panel.col + 1) & 0x7F;
+    } else if (panel.col++ == panel.col_end) {
+        panel.col = panel.col_start;
+        panel.page = panel.page == panel.page_end ? panel.page_start : panel.page + 1;
+    }
+}
+
+// Decode one write: control byte, then a command, a command stream or data
+static void panel_write(const uint8_t *b, int len) {
+    int i = 0;
+    while (i < len) {
+        uint8_t control = b[i++];
+        if (control == OLED_CONTROL_BYTE_DATA_STREAM) {
+            while (i < len) panel_data(b[i++]);
+        } else if (control == OLED_CONTROL_BYTE_CMD_SINGLE) {
+            uint8_t c[8] = {b[i++]};
+            // Arguments of a single command come with their own control bytes
+            for (int a = 1; a <= command_args(c[0]); a++) {
+                assert(b[i++] == OLED_CONTROL_BYTE_CMD_SINGLE);
+                c[a] = b[i++];
+            }
+            panel_command(c);
+        } else {
+            assert(control == OLED_CONTROL_BYTE_CMD_STREAM);
+            while (i < len) {
+                panel_command(&b[i]);
+                i += 1 + command_args(b[i]);
+            }
+        }
+    }
+}
+
+// --- I2C driver mock ---------------------------------------------------------
+
+struct i2c_cmd_link {
+    uint8_t data[LINK_MAX];
+    int len;
+};
+
+static struct i2c_cmd_link link;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_buf, size_t tx_buf, int flags) {
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void) {
+    link.len = 0;
+    return &link;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size) {
+    return i2c_cmd_link_create();
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd) {
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd) {
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack) {
+    assert(cmd->len < LINK_MAX);
+    cmd->data[cmd->len++] = data;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t len, bool ack) {
+    for (size_t i = 0; i < len; i++) {
+        i2c_master_write_byte(cmd, data[i], ack);
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks) {
+    assert(cmd->len > 0 && cmd->data[0] == (I2CAddress << 1 | I2C_MASTER_WRITE));
+    panel_write(cmd->data + 1, cmd->len - 1);
+    panel.transactions++;
+    panel.bytes += cmd->len - 1;
+    return ESP_OK;
+}
+
+// Only the I2C panel is wired
+void spi_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width) { assert(0); }
+void spi_display_frame(SSD1306_t * dev) { assert(0); }
+void spi_init(SSD1306_t * dev, int width, int height) { assert(0); }
+void spi_contrast(SSD1306_t * dev, int contrast) { assert(0); }
+void spi_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll) { assert(0); }
+
+// --- Display task -------------------------------------------------------------
+
+// The queue holds the posted commands; the task runs until it would block
+// for the next one
+static display_cmd_t queue[DISPLAY_QUEUE_LEN];
+static int queued;
+static int queue_head;
+static jmp_buf task_blocked;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    assert(length == DISPLAY_QUEUE_LEN && item_size == sizeof(display_cmd_t));
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks) {
+    if (queued == DISPLAY_QUEUE_LEN) {
+        return pdFALSE;
+    }
+    memcpy(&queue[(queue_head + queued++) % DISPLAY_QUEUE_LEN], item, sizeof(display_cmd_t));
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks) {
+    if (queued == 0) {
+        if (ticks == portMAX_DELAY) {
+            longjmp(task_blocked, 1);
+        }
+        return pdFALSE;
+    }
+    memcpy(item, &queue[queue_head], sizeof(display_cmd_t));
+    queue_head = (queue_head + 1) % DISPLAY_QUEUE_LEN;
+    queued--;
+    return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t q) {
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+    return pdPASS;
+}
+
+static void run_display_task() {
+    if (setjmp(task_blocked) == 0) {
+        display_task(NULL);
+    }
+}
+
+// --- Screens -------------------------------------------------------------------
+
+typedef void (*screen_fn)(int step);
+
+// Upload task after each frame: packet count and RSSI
+static void packet_screen(int step) {
+    char count[24];
+    char rssi[20];
+    snprintf(count, sizeof(count), "Packets: %d", 120 + step);
+    snprintf(rssi, sizeof(rssi), "RSSI: %d", -110 + step % 3);
+    display_clear();
+    display_text(0, count, false);
+    display_text(1, rssi, false);
+}
+
+// Firmware update progress
+static void ota_screen(int step) {
+    char bytes[20];
+    snprintf(bytes, sizeof(bytes), "%dK", 100 + step * 7);
+    display_clear();
+    display_text(1, "  Actualizando", false);
+    display_text_x3(4, bytes, false);
+    display_progress(7, step * 10);
+}
+
+static void check_panel(SSD1306_t * dev) {
+    for (int page = 0; page < dev->_pages; page++) {
+        assert(memcmp(panel.ram[page], dev->_page[page]._segs, dev->_width) == 0);
+    }
+}
+
+static void report(const char *name, uint32_t transactions, uint32_t bytes, int frames) {
+    double bits = transactions * BITS_PER_TRANSACTION + bytes * 9.0;
+    printf("  %-26s %5.1f transactions %7.1f bytes %6.2f ms\n", name, (double)transactions / frames,
+           (double)bytes / frames, bits / frames * 1000 / I2C_HZ);
+}
+
+// Each screen drawn frames times, directly and through the framebuffer
+static void bench(const char *name, screen_fn draw, int frames) {
+    SSD1306_t dev;
+    memset(&dev, 0, sizeof(dev));
+    memset(&panel.ram, 0, sizeof(panel.ram));
+    i2c_master_init(&dev, 21, 22, -1);
+    ssd1306_init(&dev, 128, 64);
+
+    // Straight to the panel, as every draw call did before the framebuffer
+    display_cmd_t cmd;
+    display_queue = queue;
+    panel.transactions = panel.bytes = 0;
+    for (int step = 0; step < frames; step++) {
+        draw(step);
+        while (xQueueReceive(queue, &cmd, 0) == pdTRUE) {
+            display_apply(&dev, &cmd);
+        }
+        check_panel(&dev);
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "%s, direct", name);
+    report(label, panel.transactions, panel.bytes, frames);
+    uint32_t direct_bytes = panel.bytes;
+
+    // Through the service: one flush of the changed columns per frame
+    display_queue = NULL;
+    assert(display_service_start(&dev, 10) == ESP_OK);
+    run_display_task(); // First frame goes out whole
+    panel.transactions = panel.bytes = 0;
+    for (int step = 0; step < frames; step++) {
+        draw(step);
+        run_display_task();
+        check_panel(&dev);
+    }
+    snprintf(label, sizeof(label), "%s, framebuffer", name);
+    report(label, panel.transactions, panel.bytes, frames);
+    assert(panel.bytes * 4 < direct_bytes);
+    ssd1306_framebuffer(&dev, false);
+}
+
+int main() {
+    printf("I2C per screen update at %d kHz:\n", I2C_HZ / 1000);
+    bench("packet count", packet_screen, 10);
+    bench("OTA progress", ota_screen, 10);
+    return 0;
+}
@@ -0,0 +1,79 @@
+// JSON writer against the snprintf("%s") it replaced, on 190-byte frames.
+// snprintf is only comparable on printable text, where both must produce
+// the same object; UTF-8 and binary frames show the cost of escaping.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "json_writer.h"
+
+#define FRAME_LEN 190
+#define ROUNDS 200000
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int frame_to_json(const uint8_t *payload, size_t len, char *out, size_t size) {
+    json_writer_t w;
+    json_writer_init(&w, out, size);
+    json_object_begin(&w);
+    json_key(&w, "message");
+    json_string(&w, payload, len);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+static double bench_writer(const uint8_t *payload, char *out, size_t size) {
+    volatile int sink = 0;
+    double start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        sink += frame_to_json(payload, FRAME_LEN, out, size);
+    }
+    return (now_ns() - start) / ROUNDS;
+}
+
+int main() {
+    static char out[JSON_STRING_MAX(FRAME_LEN) + 64];
+    static char ref[sizeof(out)];
+    uint8_t text[FRAME_LEN + 1];
+    uint8_t utf8[FRAME_LEN];
+    uint8_t binary[FRAME_LEN];
+    for (int i = 0; i < FRAME_LEN; i++) {
+        text[i] = 'a' + i % 26;
+        binary[i] = i * 37;
+    }
+    text[FRAME_LEN] = '\0';
+    for (int i = 0; i < FRAME_LEN; i += 2) {
+        utf8[i] = 0xC3;     // "ñ", two bytes
+        utf8[i + 1] = 0xB1;
+    }
+
+    volatile int sink = 0;
+    double start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        sink += snprintf(ref, sizeof(ref), "{\"message\":\"%s\"}", (char *)text);
+    }
+    double printf_ns = (now_ns() - start) / ROUNDS;
+
+    double text_ns = bench_writer(text, out, sizeof(out));
+    assert(strcmp(out, ref) == 0);
+    double utf8_ns = bench_writer(utf8, out, sizeof(out));
+    assert(strncmp(out, "{\"message\":\"", 12) == 0 && memcmp(out + 12, utf8, FRAME_LEN) == 0);
+    assert(strcmp(out + 12 + FRAME_LEN, "\"}") == 0);
+    double binary_ns = bench_writer(binary, out, sizeof(out));
+
+    // A buffer too small for the worst case takes the sizing pass, same output
+    int len = strlen(out);
+    assert(frame_to_json(binary, FRAME_LEN, ref, len + 1) == len && strcmp(ref, out) == 0);
+    assert(frame_to_json(binary, FRAME_LEN, ref, len) == -1);
+
+    printf("%d-byte frame object, ns per frame:\n", FRAME_LEN);
+    printf("  snprintf, text:  %6.0f\n", printf_ns);
+    printf("  writer, text:    %6.0f\n", text_ns);
+    printf("  writer, UTF-8:   %6.0f\n", utf8_ns);
+    printf("  writer, binary:  %6.0f\n", binary_ns);
+    return 0;
+}
@@ -0,0 +1,189 @@
+// SPI cost of moving a 190-byte frame through the SX127x FIFO: the burst
+// transfers of the driver against the one transaction per byte it used
+// before. The bus is a register-level model of the radio that counts
+// transactions and clocked bytes.
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "lora.h"
+
+#define FRAME_LEN 190
+#define SPI_CLOCK_HZ 9000000 // lora_init() sets up the device at 9 MHz
+#define TRANSACTION_US 25.0  // spi_device_transmit() overhead per call on the ESP32, interrupt mode
+
+#define REG_FIFO 0x00
+#define REG_OP_MODE 0x01
+#define REG_FIFO_ADDR_PTR 0x0d
+#define REG_FIFO_RX_CURRENT_ADDR 0x10
+#define REG_IRQ_FLAGS 0x12
+#define REG_RX_NB_BYTES 0x13
+#define REG_VERSION 0x42
+#define IRQ_TX_DONE 0x08
+#define IRQ_RX_DONE 0x40
+
+static struct {
+    uint8_t regs[128];
+    uint8_t fifo[256];
+    uint32_t transactions;
+    uint32_t bytes; // Clocked on the bus, address bytes included
+} radio;
+
+static uint8_t radio_access(uint8_t addr, uint8_t value) {
+    int write = addr & 0x80;
+    addr &= 0x7f;
+    if (addr == REG_FIFO) {
+        uint8_t *data = &radio.fifo[radio.regs[REG_FIFO_ADDR_PTR]++];
+        if (write) {
+            *data = value;
+        }
+        return *data;
+    }
+    if (!write) {
+        return radio.regs[addr];
+    }
+    if (addr == REG_IRQ_FLAGS) {
+        radio.regs[addr] &= ~value; // Write 1 to clear
+    } else {
+        radio.regs[addr] = value;
+    }
+    if (addr == REG_OP_MODE && (value & 0x07) == 0x03) {
+        radio.regs[REG_IRQ_FLAGS] |= IRQ_TX_DONE; // Transmission completes at once
+    }
+    return value;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma) {
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config, spi_device_handle_t *handle) {
+    assert(config->clock_speed_hz == SPI_CLOCK_HZ);
+    *handle = (spi_device_handle_t)&radio;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle) {
+    return ESP_OK;
+}
+
+// Plain transactions carry the address as the first data byte, extended
+// ones in an 8-bit address phase; the radio increments the address after
+// every byte except on the FIFO
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans) {
+    const uint8_t *tx = trans->tx_buffer;
+    uint8_t *rx = trans->rx_buffer;
+    size_t len = trans->length / 8;
+    assert(trans->length % 8 == 0);
+    uint8_t addr;
+    size_t first = 0;
+    if (trans->flags & SPI_TRANS_VARIABLE_ADDR) {
+        assert(((spi_transaction_ext_t *)trans)->address_bits == 8);
+        addr = trans->addr;
+        radio.bytes += 1;
+    } else {
+        addr = tx[0];
+        first = 1;
+    }
+    for (size_t i = first; i < len; i++) {
+        uint8_t value = radio_access(addr, tx != NULL ? tx[i] : 0xff);
+        if (rx != NULL) {
+            rx[i] = value;
+        }
+        if ((addr & 0x7f) != REG_FIFO) {
+            addr++;
+        }
+    }
+    radio.transactions++;
+    radio.bytes += len;
+    return ESP_OK;
+}
+
+// The receive and send paths before burst access, one register per transaction
+static int receive_per_byte(lora_dev_t *dev, uint8_t *buf, int size) {
+    int irq = lora_read_reg(dev, REG_IRQ_FLAGS);
+    lora_write_reg(dev, REG_IRQ_FLAGS, irq);
+    if ((irq & IRQ_RX_DONE) == 0) {
+        return 0;
+    }
+    int len = lora_read_reg(dev, REG_RX_NB_BYTES);
+    lora_idle(dev);
+    lora_write_reg(dev, REG_FIFO_ADDR_PTR, lora_read_reg(dev, REG_FIFO_RX_CURRENT_ADDR));
+    if (len > size) {
+        len = size;
+    }
+    for (int i = 0; i < len; i++) {
+        buf[i] = lora_read_reg(dev, REG_FIFO);
+    }
+    return len;
+}
+
+static void send_per_byte(lora_dev_t *dev, const uint8_t *buf, int size) {
+    lora_idle(dev);
+    lora_write_reg(dev, REG_FIFO_ADDR_PTR, 0);
+    for (int i = 0; i < size; i++) {
+        lora_write_reg(dev, REG_FIFO, buf[i]);
+    }
+    lora_write_reg(dev, 0x22, size); // REG_PAYLOAD_LENGTH
+    lora_write_reg(dev, REG_OP_MODE, 0x80 | 0x03);
+    while ((lora_read_reg(dev, REG_IRQ_FLAGS) & IRQ_TX_DONE) == 0) {
+    }
+    lora_write_reg(dev, REG_IRQ_FLAGS, IRQ_TX_DONE);
+}
+
+// A frame that arrived at FIFO address 0x80
+static void deliver(const uint8_t *frame) {
+    for (int i = 0; i < FRAME_LEN; i++) {
+        radio.fifo[(0x80 + i) & 0xff] = frame[i];
+    }
+    radio.regs[REG_FIFO_RX_CURRENT_ADDR] = 0x80;
+    radio.regs[REG_RX_NB_BYTES] = FRAME_LEN;
+    radio.regs[REG_IRQ_FLAGS] = IRQ_RX_DONE;
+}
+
+static void report(const char *name, uint32_t transactions, uint32_t bytes) {
+    double us = transactions * TRANSACTION_US + bytes * 8 * 1e6 / SPI_CLOCK_HZ;
+    printf("  %-18s %4u transactions %5u bytes %8.0f us\n", name, transactions, bytes, us);
+}
+
+int main() {
+    lora_dev_t dev;
+    const lora_config_t config = {.host = VSPI_HOST, .miso = 19, .mosi = 27, .sck = 5, .cs = 18, .rst = 14, .dio0 = -1};
+    radio.regs[REG_VERSION] = 0x12;
+    assert(lora_init(&dev, &config));
+
+    uint8_t frame[FRAME_LEN];
+    uint8_t buf[FRAME_LEN];
+    for (int i = 0; i < FRAME_LEN; i++) {
+        frame[i] = i * 7 + 1;
+    }
+    printf("%d-byte frame, SPI at %d MHz plus %.0f us per transaction:\n", FRAME_LEN, SPI_CLOCK_HZ / 1000000, TRANSACTION_US);
+
+    deliver(frame);
+    radio.transactions = radio.bytes = 0;
+    assert(receive_per_byte(&dev, buf, sizeof(buf)) == FRAME_LEN);
+    assert(memcmp(buf, frame, FRAME_LEN) == 0);
+    uint32_t old_transactions = radio.transactions;
+    report("receive, per byte", radio.transactions, radio.bytes);
+
+    deliver(frame);
+    memset(buf, 0, sizeof(buf));
+    radio.transactions = radio.bytes = 0;
+    lora_packet_info_t info;
+    assert(lora_receive_packet_info(&dev, buf, sizeof(buf), &info) == FRAME_LEN);
+    assert(memcmp(buf, frame, FRAME_LEN) == 0);
+    assert(radio.transactions < 10 && radio.transactions * 20 < old_transactions);
+    report("receive, burst", radio.transactions, radio.bytes);
+
+    radio.transactions = radio.bytes = 0;
+    send_per_byte(&dev, frame, FRAME_LEN);
+    assert(memcmp(radio.fifo, frame, FRAME_LEN) == 0);
+    report("send, per byte", radio.transactions, radio.bytes);
+
+    memset(radio.fifo, 0, sizeof(radio.fifo));
+    radio.transactions = radio.bytes = 0;
+    lora_send_packet(&dev, frame, FRAME_LEN);
+    assert(memcmp(radio.fifo, frame, FRAME_LEN) == 0);
+    assert(radio.transactions < 10);
+    report("send, burst", radio.transactions, radio.bytes);
+    return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// Same convention as the ROM function: crc is inverted on entry and exit
+uint32_t esp_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,3 @@
+#pragma once
+
+#define DEFAULT_HTTP_BUF_SIZE 512
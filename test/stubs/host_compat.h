@@ -0,0 +1,10 @@
+// Included before every test source: what ESP-IDF's newlib has and glibc may not
+#pragma once
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#define HOST_NEEDS_STRLCPY 1
+#endif
@@ -0,0 +1,212 @@
+// dedup.c is included to reach its table, the probe sequence is checked
+// slot by slot. The window runs on clock_us, set by each step.
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "dedup.c"
+
+#define WINDOW_S 60
+#define SECOND 1000000LL
+
+static int64_t clock_us;
+
+int64_t esp_timer_get_time(void) {
+    return clock_us;
+}
+
+static packet_t frame(const char *text, int64_t t, int16_t rssi) {
+    packet_t pkt = {0};
+    pkt.len = strlen(text);
+    memcpy(pkt.payload, text, pkt.len);
+    pkt.timestamp = t;
+    pkt.rssi = rssi;
+    return pkt;
+}
+
+static uint32_t start_slot(const char *text) {
+    uint64_t hash = dedup_hash((const uint8_t *)text, strlen(text));
+    return (hash * 0x9e3779b97f4a7c15ULL) >> (64 - DEDUP_BITS);
+}
+
+// First count payloads "S<n>" whose probe sequence starts at slot
+static void same_slot(uint32_t slot, char out[][16], int count) {
+    int found = 0;
+    for (int n = 0; found < count; n++) {
+        snprintf(out[found], 16, "S%d", n);
+        if (start_slot(out[found]) == slot) {
+            found++;
+        }
+    }
+}
+
+static bool seen(const char *text, int64_t t) {
+    packet_t pkt = frame(text, t, -100);
+    clock_us = t;
+    return dedup_frame(&pkt, NULL);
+}
+
+static void test_merge() {
+    dedup_init(WINDOW_S);
+    dedup_entry_t entry;
+    packet_t a = frame("BEACON", 0, -110);
+    packet_t b = frame("BEACON", 1 * SECOND, -95);
+    b.radio = 1;
+    packet_t c = frame("BEACON", 2 * SECOND, -120);
+    clock_us = a.timestamp;
+    assert(!dedup_frame(&a, &entry));
+    clock_us = b.timestamp;
+    assert(dedup_frame(&b, &entry));
+    assert(entry.copies == 2 && entry.rssi == -95 && entry.radio == 1);
+    clock_us = c.timestamp;
+    assert(dedup_frame(&c, &entry));
+    assert(entry.copies == 3 && entry.rssi == -95 && entry.last_us == 2 * SECOND);
+    // Every copy restarts the window
+    assert(seen("BEACON", 2 * SECOND + WINDOW_S * SECOND - 1));
+    assert(!seen("BEACON", 3 * SECOND + 2 * WINDOW_S * SECOND));
+}
+
+static void test_probing() {
+    char texts[DEDUP_PROBES][16];
+    dedup_init(WINDOW_S);
+    same_slot(7, texts, DEDUP_PROBES);
+    for (int i = 0; i < DEDUP_PROBES; i++) {
+        assert(!seen(texts[i], i));
+        assert(slots[(7 + i) & (DEDUP_SLOTS - 1)].hash == dedup_hash((const uint8_t *)texts[i], strlen(texts[i])));
+    }
+    for (int i = 0; i < DEDUP_PROBES; i++) {
+        assert(seen(texts[i], 100 + i));
+    }
+    dedup_stats_t stats;
+    dedup_get(&stats);
+    assert(stats.evictions == 0 && stats.collisions == 0 && stats.duplicates == DEDUP_PROBES);
+}
+
+static void test_eviction() {
+    char texts[DEDUP_PROBES + 1][16];
+    dedup_init(WINDOW_S);
+    same_slot(DEDUP_SLOTS - 3, texts, DEDUP_PROBES + 1); // Sequence wraps past the end
+    for (int i = 0; i < DEDUP_PROBES; i++) {
+        assert(!seen(texts[i], i * SECOND));
+    }
+    // Probe sequence full: the least recently seen entry goes
+    assert(!seen(texts[DEDUP_PROBES], DEDUP_PROBES * SECOND));
+    dedup_stats_t stats;
+    dedup_get(&stats);
+    assert(stats.evictions == 1);
+    for (int i = 1; i <= DEDUP_PROBES; i++) {
+        assert(seen(texts[i], 20 * SECOND));
+    }
+    assert(!seen(texts[0], 21 * SECOND));
+}
+
+static void test_expiry() {
+    char texts[DEDUP_PROBES + 2][16];
+    dedup_init(WINDOW_S);
+    same_slot(40, texts, DEDUP_PROBES + 2);
+    for (int i = 0; i < DEDUP_PROBES; i++) {
+        assert(!seen(texts[i], i < 2 ? 0 : 30 * SECOND));
+    }
+    // The first two expired, a new payload takes the first of them without
+    // evicting, and the live ones past it are still found
+    int64_t later = WINDOW_S * SECOND + 1;
+    assert(!seen(texts[DEDUP_PROBES], later));
+    assert(slots[40].hash == dedup_hash((const uint8_t *)texts[DEDUP_PROBES], strlen(texts[DEDUP_PROBES])));
+    dedup_stats_t stats;
+    dedup_get(&stats);
+    assert(stats.evictions == 0);
+    for (int i = 2; i < DEDUP_PROBES; i++) {
+        assert(seen(texts[i], later));
+    }
+    assert(!seen(texts[DEDUP_PROBES + 1], later));
+    assert(slots[41].hash == dedup_hash((const uint8_t *)texts[DEDUP_PROBES + 1], strlen(texts[DEDUP_PROBES + 1])));
+    // Expired payloads come back as new
+    assert(!seen(texts[0], later));
+}
+
+static void test_collision() {
+    dedup_init(WINDOW_S);
+    clock_us = 0;
+    packet_t a = frame("ABCD", 0, -100);
+    uint64_t hash = dedup_hash(a.payload, a.len);
+    uint32_t slot = start_slot("ABCD");
+    assert(!dedup_frame(&a, NULL));
+    // Make the stored entry a different length payload with the same hash
+    slots[slot].len = 3;
+    assert(!dedup_frame(&a, NULL));
+    dedup_stats_t stats;
+    dedup_get(&stats);
+    assert(stats.collisions == 1 && stats.duplicates == 0);
+    assert(slots[(slot + 1) & (DEDUP_SLOTS - 1)].hash == hash);
+    assert(slots[(slot + 1) & (DEDUP_SLOTS - 1)].len == 4);
+    // Both stay apart, the real one is found past the other
+    assert(dedup_frame(&a, NULL));
+    assert(slots[slot].len == 3 && slots[slot].copies == 1);
+}
+
+static void test_replay() {
+    dedup_init(WINDOW_S);
+    packet_t live = frame("TELEMETRY", 10 * SECOND, -100);
+    packet_t journaled = frame("TELEMETRY", 5 * SECOND, -100);
+    clock_us = 10 * SECOND;
+    assert(!dedup_frame(&live, NULL));
+    // Seen but not delivered yet, a journaled copy still goes out
+    assert(!dedup_replayed(&journaled));
+    dedup_delivered(&live);
+    assert(dedup_replayed(&journaled));
+    packet_t other = frame("TELEMETRY2", 10 * SECOND, -100);
+    assert(!dedup_replayed(&other));
+    // Delivered on replay only
+    dedup_delivered(&other);
+    assert(dedup_replayed(&other));
+    dedup_stats_t stats;
+    dedup_get(&stats);
+    assert(stats.replay_duplicates == 2);
+}
+
+// Records journaled by an earlier boot carry timestamps of its clock, here
+// far ahead of this one. Their entries still expire and leave room for live frames.
+static void test_replay_earlier_boot() {
+    char texts[DEDUP_PROBES + 1][16];
+    dedup_init(WINDOW_S);
+    same_slot(90, texts, DEDUP_PROBES + 1);
+    clock_us = 5 * SECOND;
+    for (int i = 0; i < DEDUP_PROBES; i++) {
+        packet_t old = frame(texts[i], 100000 * SECOND + i, -100);
+        assert(!dedup_replayed(&old));
+        dedup_delivered(&old);
+    }
+    // Within the window they are still known
+    packet_t old = frame(texts[0], 100000 * SECOND, -100);
+    assert(dedup_replayed(&old));
+    assert(seen(texts[1], 6 * SECOND));
+    // A window later all have expired: a new payload takes a slot without
+    // evicting, and live copies merge again
+    int64_t later = 5 * SECOND + WINDOW_S * SECOND;
+    assert(!seen(texts[DEDUP_PROBES], later));
+    assert(!seen(texts[2], later + 1));
+    dedup_stats_t stats;
+    dedup_get(&stats);
+    assert(stats.evictions == 0);
+    packet_t first = frame(texts[DEDUP_PROBES], later + 2, -110);
+    packet_t copy = frame(texts[DEDUP_PROBES], later + 3, -90);
+    dedup_entry_t entry;
+    clock_us = first.timestamp;
+    assert(dedup_frame(&first, &entry));
+    clock_us = copy.timestamp;
+    assert(dedup_frame(&copy, &entry));
+    assert(entry.copies == 3 && entry.rssi == -90 && entry.last_us == copy.timestamp);
+    packet_t replay = frame(texts[0], 100000 * SECOND, -100);
+    assert(!dedup_replayed(&replay));
+}
+
+int main() {
+    test_merge();
+    test_probing();
+    test_eviction();
+    test_expiry();
+    test_collision();
+    test_replay();
+    test_replay_earlier_boot();
+    printf("dedup: all tests passed\n");
+    return 0;
+}
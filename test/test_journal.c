@@ -0,0 +1,255 @@
+// Journal recovery after power loss. journal.c runs over a RAM partition
+// with NOR semantics (programming only clears bits, erase sets them) that
+// can lose power after any byte of a write; the test then "reboots" by
+// calling journal_init() again and checks what is replayed.
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "journal.c"
+
+#define FLASH_SECTORS 4
+#define FLASH_SLOTS (FLASH_SECTORS * JOURNAL_SLOTS_PER_SECTOR)
+#define RECORD_LEN 190 // Typical packet record
+#define WRITE_LEN ((sizeof(journal_header_t) + RECORD_LEN + 3) & ~3)
+#define WHOLE_LEN (sizeof(journal_header_t) + RECORD_LEN) // Only padding missing after this
+
+static uint8_t flash[FLASH_SECTORS * JOURNAL_SECTOR_SIZE];
+static const esp_partition_t journal_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_DATA_UNDEFINED,
+    .size = sizeof(flash),
+    .erase_size = JOURNAL_SECTOR_SIZE,
+    .label = JOURNAL_PARTITION_LABEL,
+};
+static long write_budget = -1; // Bytes programmed before power is lost, -1 for no limit
+static bool powered = true;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+    return strcmp(label, JOURNAL_PARTITION_LABEL) == 0 ? &journal_partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size) {
+    assert(offset + size <= sizeof(flash));
+    if (!powered) {
+        return ESP_FAIL;
+    }
+    memcpy(dst, flash + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size) {
+    assert(offset + size <= sizeof(flash));
+    assert(offset % 4 == 0 && size % 4 == 0);
+    if (!powered) {
+        return ESP_FAIL;
+    }
+    size_t programmed = size;
+    if (write_budget >= 0 && size > write_budget) {
+        programmed = write_budget;
+        powered = false;
+    }
+    if (write_budget >= 0) {
+        write_budget -= programmed;
+    }
+    for (size_t i = 0; i < programmed; i++) {
+        flash[offset + i] &= ((const uint8_t *)src)[i];
+    }
+    return powered ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    assert(offset % JOURNAL_SECTOR_SIZE == 0 && size % JOURNAL_SECTOR_SIZE == 0);
+    assert(offset + size <= sizeof(flash));
+    if (!powered) {
+        return ESP_FAIL;
+    }
+    memset(flash + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+static void reboot() {
+    powered = true;
+    write_budget = -1;
+    assert(journal_init() == ESP_OK);
+}
+
+static void format() {
+    memset(flash, 0xFF, sizeof(flash));
+    reboot();
+}
+
+static esp_err_t append(uint32_t id) {
+    uint8_t record[RECORD_LEN];
+    for (int i = 0; i < RECORD_LEN; i++) {
+        record[i] = id * 31 + i;
+    }
+    memcpy(record, &id, sizeof(id));
+    return journal_append(1, record, sizeof(record));
+}
+
+// Peek and consume every pending record, checking each one is intact
+static int replay(uint32_t *ids, int max) {
+    int count = 0;
+    uint8_t record[JOURNAL_RECORD_MAX];
+    uint8_t tag;
+    size_t len = sizeof(record);
+    while (journal_peek(&tag, record, &len) == ESP_OK) {
+        assert(count < max);
+        assert(tag == 1 && len == RECORD_LEN);
+        memcpy(&ids[count], record, sizeof(ids[count]));
+        for (int i = sizeof(uint32_t); i < RECORD_LEN; i++) {
+            assert(record[i] == (uint8_t)(ids[count] * 31 + i));
+        }
+        count++;
+        assert(journal_consume() == ESP_OK);
+        len = sizeof(record);
+    }
+    assert(journal_pending() == 0);
+    return count;
+}
+
+static void expect_replay(const uint32_t *expected, int count) {
+    uint32_t ids[FLASH_SLOTS];
+    int n = replay(ids, FLASH_SLOTS);
+    if (n != count || memcmp(ids, expected, count * sizeof(ids[0])) != 0) {
+        printf("replayed %d records, expected %d:", n, count);
+        for (int i = 0; i < n; i++) {
+            printf(" %u", ids[i]);
+        }
+        printf("\n");
+        assert(0);
+    }
+}
+
+// Append before records and consume the first two, then lose power after
+// every possible number of bytes of the next slot write
+static void test_torn_append(uint32_t before) {
+    for (size_t cut = 0; cut <= WRITE_LEN; cut++) {
+        format();
+        for (uint32_t id = 0; id < before; id++) {
+            assert(append(id) == ESP_OK);
+        }
+        for (int i = 0; i < 2; i++) {
+            uint8_t tag;
+            uint8_t record[JOURNAL_RECORD_MAX];
+            size_t len = sizeof(record);
+            assert(journal_peek(&tag, record, &len) == ESP_OK);
+            assert(journal_consume() == ESP_OK);
+        }
+
+        write_budget = cut;
+        assert((append(100) == ESP_OK) == (cut == WRITE_LEN));
+        reboot();
+
+        // Slots after a torn one can not be programmed, writing resumes on the next sector
+        uint32_t torn = before;
+        bool whole = cut >= WHOLE_LEN;
+        if (cut == 0 || whole || torn % JOURNAL_SLOTS_PER_SECTOR == 0) {
+            assert(head == (whole ? torn + 1 : torn));
+        } else {
+            assert(head == (torn / JOURNAL_SLOTS_PER_SECTOR + 1) * JOURNAL_SLOTS_PER_SECTOR);
+        }
+
+        // The committed records, and the torn one only if its record was written whole
+        uint32_t expected[FLASH_SLOTS];
+        int count = 0;
+        for (uint32_t id = 2; id < before; id++) {
+            expected[count++] = id;
+        }
+        if (whole) {
+            expected[count++] = 100;
+        }
+        expect_replay(expected, count);
+
+        // Nothing written after the power loss is hidden by the torn slot on the next boot
+        assert(append(200) == ESP_OK);
+        assert(append(201) == ESP_OK);
+        reboot();
+        expect_replay((const uint32_t[]){200, 201}, 2);
+    }
+}
+
+// Lose power while the state word of a replayed record is being cleared
+static void test_torn_consume() {
+    for (long cut = 0; cut <= sizeof(uint32_t); cut++) {
+        format();
+        for (uint32_t id = 0; id < 4; id++) {
+            assert(append(id) == ESP_OK);
+        }
+        uint8_t tag;
+        uint8_t record[JOURNAL_RECORD_MAX];
+        size_t len = sizeof(record);
+        assert(journal_peek(&tag, record, &len) == ESP_OK);
+        write_budget = cut;
+        assert((journal_consume() == ESP_OK) == (cut == sizeof(uint32_t)));
+        reboot();
+
+        // Delivered already, replaying it again is allowed until the state word is fully cleared
+        uint32_t ids[FLASH_SLOTS];
+        int n = replay(ids, FLASH_SLOTS);
+        int first = n == 4 ? 0 : 1;
+        assert(n == 4 - first);
+        assert(cut != 0 || first == 0);
+        assert(cut != sizeof(uint32_t) || first == 1);
+        for (int i = 0; i < n; i++) {
+            assert(ids[i] == first + i);
+        }
+    }
+}
+
+// Sequence numbers wrap around 2^32 between records of the same journal
+static void test_seq_rollover() {
+    format();
+    next_seq = UINT32_MAX - 2;
+    for (uint32_t id = 0; id < 6; id++) {
+        assert(append(id) == ESP_OK);
+    }
+    reboot();
+    assert(head == 6 && tail == 0);
+    expect_replay((const uint32_t[]){0, 1, 2, 3, 4, 5}, 6);
+    assert(next_seq == 3);
+
+    assert(append(6) == ESP_OK);
+    assert(append(7) == ESP_OK);
+    reboot();
+    expect_replay((const uint32_t[]){6, 7}, 2);
+}
+
+// More records than slots: whole sectors of the oldest ones are dropped
+static void test_wrap() {
+    format();
+    uint32_t total = FLASH_SLOTS * 2 + 5;
+    for (uint32_t id = 0; id < total; id++) {
+        assert(append(id) == ESP_OK);
+        journal_maintain();
+    }
+    journal_stats_t stats;
+    journal_get_stats(&stats);
+    assert(stats.dropped > 0);
+    assert(stats.appended == total);
+    uint32_t pending_before = journal_pending();
+    assert(pending_before + stats.dropped == total);
+    assert(pending_before >= FLASH_SLOTS - 2 * JOURNAL_SLOTS_PER_SECTOR);
+
+    reboot();
+    assert(journal_pending() == pending_before);
+    uint32_t expected[FLASH_SLOTS];
+    for (uint32_t i = 0; i < pending_before; i++) {
+        expected[i] = total - pending_before + i;
+    }
+    expect_replay(expected, pending_before);
+}
+
+int main() {
+    format();
+    assert(slots == FLASH_SLOTS);
+
+    test_torn_append(5);                            // Middle of a sector
+    test_torn_append(JOURNAL_SLOTS_PER_SECTOR - 1); // Last slot of a sector
+    test_torn_append(JOURNAL_SLOTS_PER_SECTOR);     // First slot of a sector
+    test_torn_consume();
+    test_seq_rollover();
+    test_wrap();
+    printf("journal: ok\n");
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Element set parsing of the tracker. sat_tracker.c is included to reach
+// sat_tracker_parse, NVS and the API client are the stubs that store nothing.
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "sat_tracker.c"
+
+#define L1_00005 "1 00005U 58002B   00179.78495062  .00000023  00000-0  28098-4 0  4753"
+#define L2_00005 "2 00005  34.2682 348.7242 1859667 331.7664  19.3264 10.82419157413667"
+#define L1_25544 "1 25544U 98067A   08264.51782528 -.00002182  00000-0 -11606-4 0  2927"
+#define L2_25544 "2 25544  51.6416 247.4627 0006703 130.5360 325.0288 15.72125391563537"
+
+static sat_entry_t out[SAT_TRACKER_MAX];
+
+// sat_tracker_refresh is not exercised, no server to fetch from
+bool http_get(const char *url, char *res) {
+    return true;
+}
+
+static void test_names() {
+    // Named, unnamed and "0 " prefixed sets in one list
+    const char *text = "VANGUARD 1\n" L1_00005 "\n" L2_00005 "\n"
+                       L1_25544 "\n" L2_25544 "\n"
+                       "0 ISS (ZARYA)  \n" L1_25544 "\n" L2_25544 "\n";
+    assert(sat_tracker_parse(text, out, SAT_TRACKER_MAX) == 3);
+    assert(out[0].tle.catalog == 5);
+    assert(strcmp(out[0].tle.name, "VANGUARD 1") == 0);
+    assert(out[1].tle.catalog == 25544);
+    assert(out[1].tle.name[0] == '\0');
+    assert(strcmp(out[2].tle.name, "ISS (ZARYA)") == 0);
+    assert(strcmp(out[0].text, "VANGUARD 1\n" L1_00005 "\n" L2_00005 "\n") == 0);
+}
+
+static void test_crlf() {
+    const char *text = "VANGUARD 1\r\n" L1_00005 "\r\n" L2_00005 "\r\n\r\n"
+                       "ISS\r\n" L1_25544 "\r\n" L2_25544;
+    assert(sat_tracker_parse(text, out, SAT_TRACKER_MAX) == 2);
+    assert(strcmp(out[0].tle.name, "VANGUARD 1") == 0);
+    assert(strcmp(out[1].tle.name, "ISS") == 0);
+    assert(strchr(out[1].text, '\r') == NULL);
+    assert(out[1].tle.mean_motion > 15.7 && out[1].tle.mean_motion < 15.8);
+}
+
+static void test_checksum() {
+    char line1[] = L1_25544;
+    line1[SGP4_TLE_LINE_LEN - 1] = '8';
+    char text[SAT_TRACKER_TEXT_MAX];
+    snprintf(text, sizeof(text), "ISS\n%s\n%s\n", line1, L2_25544);
+    assert(sat_tracker_parse(text, out, SAT_TRACKER_MAX) == -1);
+
+    // One bad set rejects the whole list
+    snprintf(text, sizeof(text), "%s\n%s\n%s\n%s\n", L1_00005, L2_00005, line1, L2_25544);
+    assert(sat_tracker_parse(text, out, SAT_TRACKER_MAX) == -1);
+
+    // Lines of different satellites
+    assert(sat_tracker_parse(L1_00005 "\n" L2_25544 "\n", out, SAT_TRACKER_MAX) == -1);
+    assert(sat_tracker_parse("no element sets here\n", out, SAT_TRACKER_MAX) == 0);
+}
+
+static void test_too_many() {
+    char text[2 * SAT_TRACKER_TEXT_MAX] = "";
+    for (int i = 0; i < SAT_TRACKER_MAX; i++) {
+        strlcat(text, L1_00005 "\n" L2_00005 "\n", sizeof(text));
+    }
+    assert(sat_tracker_parse(text, out, SAT_TRACKER_MAX) == SAT_TRACKER_MAX);
+    assert(sat_tracker_parse(text, out, SAT_TRACKER_MAX - 1) == -1);
+    strlcat(text, L1_25544 "\n" L2_25544 "\n", sizeof(text));
+    assert(sat_tracker_parse(text, out, SAT_TRACKER_MAX) == -1);
+}
+
+static void test_set_tle() {
+    assert(sat_tracker_set_tle("ISS\n" L1_25544 "\n" L2_25544 "\n") == ESP_OK);
+    assert(sat_tracker_count() == 1);
+    sgp4_tle_t tle;
+    assert(sat_tracker_get_tle(0, &tle) && tle.catalog == 25544);
+    assert(sat_tracker_set_tle("ISS\n" L1_25544 "\n") != ESP_OK);
+    assert(sat_tracker_count() == 1);
+
+    // Updated elements without the name line keep the stored name
+    assert(sat_tracker_add_tle(L1_25544 "\r\n" L2_25544 "\r\n") == ESP_OK);
+    assert(sat_tracker_count() == 1);
+    assert(strcmp(entries[0].text, "ISS\n" L1_25544 "\n" L2_25544 "\n") == 0);
+    assert(sat_tracker_add_tle(L1_00005 "\n" L2_00005 "\n") == ESP_OK);
+    assert(sat_tracker_count() == 2);
+}
+
+int main() {
+    const sat_tracker_config_t config = {.latitude = 19.4, .longitude = -99.1, .altitude = 2240};
+    assert(sat_tracker_init(&config) == ESP_OK);
+    assert(sat_tracker_count() == 0);
+    test_names();
+    test_crlf();
+    test_checksum();
+    test_too_many();
+    test_set_tle();
+    printf("sat_tracker: ok\n");
+    return 0;
+}
@@ -0,0 +1,99 @@
+// SGP4 against the reference vectors of Vallado et al., "Revisiting
+// Spacetrack Report #3" (AIAA 2006-6753), and the propagation time
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+#include "sgp4.h"
+
+#define POSITION_TOLERANCE 1e-3 // km
+#define VELOCITY_TOLERANCE 1e-6 // km/s
+
+// Satellite 00005 from the verification set, WGS-72
+static const char *line1 = "1 00005U 58002B   00179.78495062  .00000023  00000-0  28098-4 0  4753";
+static const char *line2 = "2 00005  34.2682 348.7242 1859667 331.7664  19.3264 10.82419157413667";
+
+static const struct {
+    double tsince; // min
+    double r[3];   // km, TEME
+    double v[3];   // km/s
+} vectors[] = {
+    {0, {7022.46529266, -1400.08296755, 0.03995155}, {1.893841015, 6.405893759, 4.534807250}},
+    {360, {-7154.03120202, -3783.17682504, -3536.19412294}, {4.741887409, -4.151817765, -2.093935425}},
+    {720, {-7134.59340119, 6531.68641334, 3260.27186483}, {-4.113793027, -2.911922039, -2.557327851}},
+};
+
+static void test_vectors() {
+    sgp4_tle_t tle;
+    sgp4_t sat;
+    assert(sgp4_parse_tle("00005", line1, line2, &tle));
+    assert(tle.catalog == 5);
+    assert(sgp4_init(&sat, &tle) == SGP4_OK);
+    for (int i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        double r[3], v[3];
+        assert(sgp4_propagate(&sat, vectors[i].tsince, r, v) == SGP4_OK);
+        for (int k = 0; k < 3; k++) {
+            if (fabs(r[k] - vectors[i].r[k]) > POSITION_TOLERANCE || fabs(v[k] - vectors[i].v[k]) > VELOCITY_TOLERANCE) {
+                printf("t=%.0f min axis %d: r %.8f v %.9f, expected %.8f %.9f\n", vectors[i].tsince, k,
+                       r[k], v[k], vectors[i].r[k], vectors[i].v[k]);
+                assert(0);
+            }
+        }
+    }
+}
+
+// Vallado example 3-5: 1992 August 20 12:14 UT1, GMST 152.578787810 deg
+static void test_gmst() {
+    double gmst = sgp4_gmst(714312840.0) * 180.0 / M_PI;
+    assert(fabs(gmst - 152.578787810) < 1e-6);
+}
+
+static void test_parse_errors() {
+    sgp4_tle_t tle;
+    char bad[SGP4_TLE_LINE_LEN + 1];
+    snprintf(bad, sizeof(bad), "%s", line1);
+    bad[68] = bad[68] == '9' ? '0' : bad[68] + 1; // Checksum
+    assert(!sgp4_parse_tle(NULL, bad, line2, &tle));
+    assert(!sgp4_parse_tle(NULL, line2, line1, &tle)); // Line numbers swapped
+    snprintf(bad, sizeof(bad), "%s", line2);
+    bad[6] = '6'; // Other satellite, checksum fixed below
+    int sum = 0;
+    for (int i = 0; i < 68; i++) {
+        sum += bad[i] == '-' ? 1 : (bad[i] >= '0' && bad[i] <= '9') ? bad[i] - '0' : 0;
+    }
+    bad[68] = '0' + sum % 10;
+    assert(!sgp4_parse_tle(NULL, line1, bad, &tle));
+}
+
+// The Doppler task propagates every second, it has to stay far below that
+static void test_timing() {
+    sgp4_tle_t tle;
+    sgp4_t sat;
+    sgp4_observer_t obs;
+    sgp4_look_t look;
+    const int runs = 100000;
+    sgp4_parse_tle(NULL, line1, line2, &tle);
+    sgp4_init(&sat, &tle);
+    sgp4_observer_init(&obs, 19.43, -99.13, 2240);
+
+    struct timespec start, end;
+    double sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < runs; i++) {
+        sgp4_look(&sat, &obs, tle.epoch + i, &look);
+        sum += look.range;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / runs;
+    printf("sgp4_look: %.2f us per call on the host (checksum %.0f)\n", us, sum);
+    assert(us < 100);
+}
+
+int main() {
+    test_vectors();
+    test_gmst();
+    test_parse_errors();
+    test_timing();
+    printf("sgp4: all tests passed\n");
+    return 0;
+}